@@ -71,6 +71,51 @@ extern "C" {
          },
          "1"
       },
+      {
+         "savestate_compression",
+         "Save state compression",
+         NULL,
+         "Compresses the progress save written every 10 seconds. Higher levels only help on data that barely compresses.",
+         NULL,
+         NULL,
+         {
+            { "disabled", "Disabled" },
+            { "1", "Level 1 (fastest)" },
+            { "3", "Level 3" },
+            { "6", "Level 6" },
+            { "9", "Level 9" },
+            { NULL, NULL },
+         },
+         "1"
+      },
+      {
+         "video_output",
+         "Video output",
+         NULL,
+         "Calculator skin draws the whole calculator at 640x480. Native resolution sends only the LCD (96x64, 320x240 on the color models) and leaves scaling to the frontend.",
+         NULL,
+         NULL,
+         {
+            { "skin", "Calculator skin" },
+            { "native", "Native resolution" },
+            { NULL, NULL },
+         },
+         "skin"
+      },
+      {
+         "pixel_format",
+         "Pixel format (restart)",
+         NULL,
+         "RGB565 sends 16-bit frames, half the memory traffic of XRGB8888, which helps on handhelds and older ARM devices.",
+         NULL,
+         NULL,
+         {
+            { "xrgb8888", "XRGB8888 (32-bit)" },
+            { "rgb565", "RGB565 (16-bit)" },
+            { NULL, NULL },
+         },
+         "xrgb8888"
+      },
       { NULL, NULL, NULL, NULL, NULL, NULL, {{0}}, NULL },
    };
 
@@ -36,6 +36,7 @@
 #include "stdafx.h"
 #include "corecalc.h"
 #include "83phw.h"
+#include "colorlcd.h"
 #include "device.h"
 #include "var.h"
 #include "neil_controller.h"
@@ -64,22 +65,48 @@ static bool libretro_supports_option_categories = false;
 static std::string rom_path;
 bool buttonPressed = false;
 int virtualMouseSpeed = 1;
+int saveCompressionLevel = 1;
 int virtualMouseX = 50;
 int virtualMouseY = 270;
 bool virtualMouseMode = false;
 int frameCounter = 0;
 bool bigMode = false;
+bool nativeVideo = false;
 bool lastBigModePressed = false;
 bool gamingButtons = false;
 bool hasBios = false;
+bool canDupe = false;
+bool wantRgb565 = false;
+bool rgb565 = false;
 
 #define VIDEO_WIDTH 640
 #define VIDEO_HEIGHT 480
 #define VIDEO_BUFF_SIZE (VIDEO_WIDTH * VIDEO_HEIGHT * sizeof(uint32_t))
-#define VIDEO_PITCH (VIDEO_WIDTH * sizeof(uint32_t))
+#define VIDEO_PIXEL_SIZE (rgb565 ? sizeof(uint16_t) : sizeof(uint32_t))
+#define VIDEO_PITCH (VIDEO_WIDTH * VIDEO_PIXEL_SIZE)
 #define CALC_WIDTH 128
 #define CALC_HEIGHT 64
 
+// Parts of video_buf to restore from the skin, right and bottom exclusive
+struct DirtyRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+#define MAX_DIRTY_RECTS 16
+
+static uint32_t* skin_buf;
+bool fullRedraw = true;
+bool skinBigMode = false;
+bool screenCached = false;
+bool screenChanged = false;
+bool cursorDrawn = false;
+DirtyRect lastCursorRect;
+DirtyRect dirtyRects[MAX_DIRTY_RECTS];
+int dirtyCount = 0;
+
 HEZDIMAGE hDib;
 HEZDFONT hFont;
 char user_header[EZD_HEADER_SIZE];
@@ -87,7 +114,14 @@ char user_header[EZD_HEADER_SIZE];
 
 struct NeilButtons neilbuttons;
 struct NeilButtons lastButtons;
-unsigned char screen_converted[128 * 64 * 4];
+uint32_t lcd_palette[256];
+uint16_t lcd_palette16[256];
+unsigned char lcd_screen[128 * 64];
+unsigned char last_lcd_screen[128 * 64];
+// the color LCD has no gray levels, it is rendered in the output format
+bool lcdColor = false;
+uint32_t lcd_color[COLOR_LCD_WIDTH * COLOR_LCD_HEIGHT];
+uint32_t last_lcd_color[COLOR_LCD_WIDTH * COLOR_LCD_HEIGHT];
 bool has_ti_rom = false;
 char savetempdir[400];
 char saveprogressdir[400];
@@ -102,6 +136,7 @@ typedef struct {
 
 #include <vector>
 std::vector<NeilVirtualButton> virtualButtons;
+std::vector<bool> hoverDrawn;
 
 #include <stdarg.h>
 
@@ -235,18 +270,18 @@ void initVirtualButtons()
 }
 
 
-void convert_to_rgba(unsigned char* screen, unsigned char* converted)
+// XRGB8888 color for each gray level of the mono LCD
+void build_lcd_palette(uint32_t* palette)
 {
     int i = 0;
-    int cursor = 0;
     unsigned char byte = 0;
     unsigned char r = 0;
     unsigned char g = 0;
     unsigned char b = 0;
 
-    for (i = 0; i < 128 * 64; i++)
+    for (i = 0; i < 256; i++)
     {
-        byte = screen[i];
+        byte = i;
 
         //the lightest shade is a little too dark
         if (byte == 102)
@@ -260,15 +295,23 @@ void convert_to_rgba(unsigned char* screen, unsigned char* converted)
         if (r >= 30) r -= 30;
         if (b >= 30) b -= 30;
 
-        converted[cursor + 0] = r;
-        converted[cursor + 1] = g;
-        converted[cursor + 2] = b;
-        converted[cursor + 3] = 255;
-
-        cursor += 4;
+        palette[i] = r << 16 | g << 8 | b;
     }
 }
 
+uint16_t to_rgb565(uint32_t color)
+{
+    return (color >> 8 & 0xF800) | (color >> 5 & 0x07E0) | (color >> 3 & 0x001F);
+}
+
+// ezdib only has 32 bit buffers, so RGB565 frames are drawn through this
+int set_pixel_rgb565(void* user, int x, int y, int color, int flags)
+{
+    if (x >= 0 && x < VIDEO_WIDTH && y >= 0 && y < VIDEO_HEIGHT)
+        ((uint16_t*)video_buf)[y * VIDEO_WIDTH + x] = to_rgb565(color);
+    return 1;
+}
+
 
 void resetNeilButtons()
 {
@@ -430,12 +473,41 @@ void processInput() {
 
 }
 
-unsigned char* get_video_buffer()
+// Renders the LCD into lcd_screen, or into lcd_color for the color model.
+// Returns true when the image differs from the last call
+bool get_video_buffer()
 {
     LCDBase_t* lcd = mycalc.cpu.pio.lcd;
-    unsigned char* image = lcd->image(lcd);
+    bool changed = !screenCached;
 
-    return image;
+    lcdColor = false;
+    if (lcd->render_into(lcd, lcd_screen, LCD_WIDTH, LCD_PIXEL_GRAY8))
+    {
+        if (memcmp(lcd_screen, last_lcd_screen, sizeof(last_lcd_screen)) != 0)
+        {
+            memcpy(last_lcd_screen, lcd_screen, sizeof(last_lcd_screen));
+            changed = true;
+        }
+    }
+    else if (lcd->render_into(lcd, (uint8_t*)lcd_color, lcd->width * VIDEO_PIXEL_SIZE,
+        rgb565 ? LCD_PIXEL_RGB565 : LCD_PIXEL_XRGB8888))
+    {
+        lcdColor = true;
+        size_t size = lcd->width * lcd->height * VIDEO_PIXEL_SIZE;
+        if (memcmp(lcd_color, last_lcd_color, size) != 0)
+        {
+            memcpy(last_lcd_color, lcd_color, size);
+            changed = true;
+        }
+    }
+    else
+    {
+        log_cb(RETRO_LOG_ERROR, "LCD can not be rendered.\n");
+        return false;
+    }
+
+    screenCached = true;
+    return changed;
 }
 
 
@@ -474,13 +546,30 @@ void retro_get_system_info(struct retro_system_info* info)
     info->valid_extensions = "8xp|8xk|8xg";
 }
 
+// native output is just the LCD, without a rom there is only the message screen
+bool showNativeVideo()
+{
+    return nativeVideo && hasBios;
+}
+
+void getGeometry(struct retro_game_geometry* geometry)
+{
+    geometry->base_width = VIDEO_WIDTH;
+    geometry->base_height = VIDEO_HEIGHT;
+    if (showNativeVideo())
+    {
+        LCDBase_t* lcd = mycalc.cpu.pio.lcd;
+        geometry->base_width = lcd->display_width;
+        geometry->base_height = lcd->height;
+    }
+    geometry->max_width = VIDEO_WIDTH;
+    geometry->max_height = VIDEO_HEIGHT;
+    geometry->aspect_ratio = (float)geometry->base_width / (float)geometry->base_height;
+}
+
 void retro_get_system_av_info(struct retro_system_av_info* info)
 {
-    info->geometry.base_width = VIDEO_WIDTH;
-    info->geometry.base_height = VIDEO_HEIGHT;
-    info->geometry.max_width = VIDEO_WIDTH;
-    info->geometry.max_height = VIDEO_HEIGHT;
-    info->geometry.aspect_ratio = (float)VIDEO_WIDTH / (float)VIDEO_HEIGHT;
+    getGeometry(&info->geometry);
     info->timing.fps = 60;
     info->timing.sample_rate = 0;
 }
@@ -499,8 +588,12 @@ void retro_init(void)
         log_cb = log_null;
 
     video_buf = (uint32_t*)malloc(VIDEO_BUFF_SIZE);
+    skin_buf = (uint32_t*)malloc(VIDEO_BUFF_SIZE);
 
     initVirtualButtons();
+    build_lcd_palette(lcd_palette);
+    for (int i = 0; i < 256; i++)
+        lcd_palette16[i] = to_rgb565(lcd_palette[i]);
 
     setSaveDir();
 
@@ -550,6 +643,8 @@ void retro_set_input_state(retro_input_state_t cb) { input_state_cb = cb; }
 void retro_reset()
 {
     hasBios = false;
+    fullRedraw = true;
+    screenCached = false;
     calc_slot_free(&mycalc);
     memset(&mycalc, 0, sizeof(calc_t));
     mycalc.active = TRUE;
@@ -595,10 +690,10 @@ void retro_reset()
     }
 }
 
-static size_t serialize_size = 0;
 size_t retro_serialize_size(void)
 {
-    return 2500000;
+    // fixed for the loaded model, so rewind and run-ahead can use it
+    return GetSlotSize(&mycalc);
 }
 
 const char* getSaveDir()
@@ -638,8 +733,10 @@ void saveState(bool progress)
 {
     const char* savepath = progress ? getProgressDir() : getSaveDir();
 
-    SAVESTATE_t* savestate = SaveSlot(&mycalc, "calc", "savestate comment");
-    WriteSave(savepath, savestate, 0);
+    // only the flash pages that differ from the BIOS are stored, unless an
+    // old full save was loaded over it
+    SAVESTATE_t* savestate = SaveSlotDelta(&mycalc, "calc", "savestate comment");
+    WriteSave(savepath, savestate, saveCompressionLevel ? LZ_CMP : NO_CMP, saveCompressionLevel);
     FreeSave(savestate);
 }
 
@@ -652,33 +749,31 @@ void loadState(bool progress)
 
 bool retro_serialize(void* data, size_t size)
 {
-    saveState(false);
+    SAVESTATE_t* savestate = SaveSlotDelta(&mycalc, "calc", "savestate comment");
+    if (savestate == NULL)
+        return false;
 
-    const char* savepath = getSaveDir();
-    RFILE* ofile = filestream_open(savepath,
-        RETRO_VFS_FILE_ACCESS_READ,
-        RETRO_VFS_FILE_ACCESS_HINT_NONE);
-    filestream_seek(ofile, 0, SEEK_END);
-    int fsize = filestream_tell(ofile);
-    filestream_seek(ofile, 0, SEEK_SET);
-    filestream_read(ofile, data, fsize);
-    filestream_close(ofile);
-    
+    int written = WriteSaveBuffer((unsigned char*)data, (int)size, savestate);
+    FreeSave(savestate);
+    if (written == 0)
+        return false;
+
+    // keep the whole buffer deterministic for rewind diffs
+    memset((unsigned char*)data + written, 0, size - written);
     return true;
 }
 
 bool retro_unserialize(const void* data, size_t size)
 {
-    const char* savepath = getSaveDir();
-    RFILE* ofile = filestream_open(savepath,
-        RETRO_VFS_FILE_ACCESS_WRITE,
-        RETRO_VFS_FILE_ACCESS_HINT_NONE);
-    filestream_write(ofile, data, size);
-    filestream_close(ofile);
+    SAVESTATE_t* savestate = ReadSaveBuffer((const unsigned char*)data, (int)size);
+    if (savestate == NULL)
+        return false;
 
-    loadState(false);
+    // states come from this session, so the calc is already set up for the model
+    bool success = savestate->model == mycalc.model && LoadSlot(savestate, &mycalc);
+    FreeSave(savestate);
 
-    return true;
+    return success;
 }
 
 //this is where we check if stuff changed
@@ -690,6 +785,26 @@ static void check_variables(void)
     {
         virtualMouseSpeed = atoi(var.value);
     }
+
+    var.key = "savestate_compression";
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        // "disabled" reads as level 0
+        saveCompressionLevel = atoi(var.value);
+    }
+
+    var.key = "video_output";
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        nativeVideo = strcmp(var.value, "native") == 0;
+    }
+
+    // only read by retro_load_game, the format is fixed once a game runs
+    var.key = "pixel_format";
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+    {
+        wantRgb565 = strcmp(var.value, "rgb565") == 0;
+    }
 }
 
 #define RETRO_DEVICE_JOYPAD_ALT  RETRO_DEVICE_SUBCLASS(RETRO_DEVICE_JOYPAD, 0)
@@ -764,14 +879,30 @@ bool retro_load_game(const struct retro_game_info* info)
 
     environ_cb(RETRO_ENVIRONMENT_SET_CONTROLLER_INFO, (void*)ports);
     
-    enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
-    if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+    check_variables();
+
+    // fall back to XRGB8888 if the frontend turns RGB565 down
+    rgb565 = false;
+    if (wantRgb565)
     {
-        log_cb(RETRO_LOG_ERROR, "XRGB8888 is not supported.\n");
-        return false;
+        enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_RGB565;
+        rgb565 = environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt);
+    }
+
+    if (!rgb565)
+    {
+        enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+        if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt))
+        {
+            log_cb(RETRO_LOG_ERROR, "XRGB8888 is not supported.\n");
+            return false;
+        }
     }
-    
-    check_variables();
+
+    ezd_set_pixel_callback(hDib, rgb565 ? set_pixel_rgb565 : NULL, NULL);
+    fullRedraw = true;
+
+    environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &canDupe);
 
     bool no = false;
     environ_cb(RETRO_ENVIRONMENT_SET_SUPPORT_ACHIEVEMENTS, &no);
@@ -886,124 +1017,238 @@ void drawVirtualMouse()
         , virtualMouseY + 5, 0xFFFFFF);
 }
 
-void drawScreen()
+// Copies the dirty rects back from the skin layer
+void restoreDirtyRects()
 {
+    for (int i = 0; i < dirtyCount; i++)
+    {
+        DirtyRect* rect = &dirtyRects[i];
+        for (int y = rect->top; y < rect->bottom; y++)
+        {
+            size_t offset = (y * VIDEO_WIDTH + rect->left) * VIDEO_PIXEL_SIZE;
+            memcpy((uint8_t*)video_buf + offset, (uint8_t*)skin_buf + offset, (rect->right - rect->left) * VIDEO_PIXEL_SIZE);
+        }
+    }
+}
 
-    // Fill in the background
+void addDirtyRect(DirtyRect rect)
+{
+    rect.left = std::max(rect.left, 0);
+    rect.top = std::max(rect.top, 0);
+    rect.right = std::min(rect.right, VIDEO_WIDTH);
+    rect.bottom = std::min(rect.bottom, VIDEO_HEIGHT);
+    if (rect.left >= rect.right || rect.top >= rect.bottom)
+        return;
+
+    // out of slots, grow the last one over this one too
+    if (dirtyCount == MAX_DIRTY_RECTS)
+    {
+        DirtyRect* last = &dirtyRects[dirtyCount - 1];
+        last->left = std::min(last->left, rect.left);
+        last->top = std::min(last->top, rect.top);
+        last->right = std::max(last->right, rect.right);
+        last->bottom = std::max(last->bottom, rect.bottom);
+        return;
+    }
+
+    dirtyRects[dirtyCount++] = rect;
+}
+
+bool isDirty(DirtyRect rect)
+{
+    for (int i = 0; i < dirtyCount; i++)
+    {
+        if (rect.left < dirtyRects[i].right && dirtyRects[i].left < rect.right &&
+            rect.top < dirtyRects[i].bottom && dirtyRects[i].top < rect.bottom)
+            return true;
+    }
+    return false;
+}
+
+DirtyRect makeRect(int left, int top, int right, int bottom)
+{
+    DirtyRect rect = { left, top, right, bottom };
+    return rect;
+}
+
+bool sameRect(DirtyRect a, DirtyRect b)
+{
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+// ezd_rect and the cursor lines include their end points
+DirtyRect buttonRect(struct NeilVirtualButton* button)
+{
+    return makeRect(button->x, button->y, button->x + button->width + 1, button->y + button->height + 1);
+}
+
+DirtyRect cursorRect()
+{
+    return makeRect(virtualMouseX, virtualMouseY, virtualMouseX + 11, virtualMouseY + 11);
+}
+
+float lcdScaleFactor()
+{
+    if (bigMode)
+        return (float)VIDEO_WIDTH / (float)96;
+    return 3.0f;
+}
+
+// Source column and row offset for each pixel of the scaled LCD
+int scaleColumns[VIDEO_WIDTH];
+int scaleRows[VIDEO_HEIGHT];
+int scaleWidth = 0;
+int scaleHeight = 0;
+int scaleTablesMode = -1;
+
+// The color LCD is fit to the height of the mono one, keeping its aspect
+void buildColorScaleTables()
+{
+    LCDBase_t* lcd = mycalc.cpu.pio.lcd;
+    float scaleFactor = lcdScaleFactor();
+    int scaledHeight = std::min((int)((float)CALC_HEIGHT * scaleFactor), VIDEO_HEIGHT);
+    int scaledWidth = std::min(scaledHeight * lcd->width / lcd->height, VIDEO_WIDTH);
+
+    for (int x = 0; x < scaledWidth; x++)
+        scaleColumns[x] = x * lcd->width / scaledWidth;
+    for (int y = 0; y < scaledHeight; y++)
+        scaleRows[y] = (y * lcd->height / scaledHeight) * lcd->width;
+
+    scaleWidth = scaledWidth;
+    scaleHeight = scaledHeight;
+}
+
+// Returns true when the tables were rebuilt
+bool updateScaleTables()
+{
+    int mode = (int)bigMode | (int)lcdColor << 1;
+    if (scaleTablesMode == mode)
+        return false;
+    scaleTablesMode = mode;
+
+    if (lcdColor)
+    {
+        buildColorScaleTables();
+        return true;
+    }
+
+    float scaleFactor = lcdScaleFactor();
+    int scaledWidth = (int)((float)CALC_WIDTH * scaleFactor);
+    int scaledHeight = (int)((float)CALC_HEIGHT * scaleFactor);
+
+    // only the 96 visible columns are drawn
+    int x = 0;
+    for (x = 0; x < scaledWidth && x < 96 * scaleFactor && x < VIDEO_WIDTH; x++)
+        scaleColumns[x] = (int)(((float)x) * ((float)CALC_WIDTH / float(scaledWidth)));
+    scaleWidth = x;
+
+    int y = 0;
+    for (y = 0; y < scaledHeight && y < VIDEO_HEIGHT; y++)
+        scaleRows[y] = (int)(((float)y) * ((float)CALC_HEIGHT / float(scaledHeight))) * CALC_WIDTH;
+    scaleHeight = y;
+    return true;
+}
+
+DirtyRect lcdRect()
+{
+    return makeRect(0, 0, scaleWidth, scaleHeight);
+}
+
+// The gray background and, outside big mode, the calculator skin
+void buildSkin()
+{
+    // ezdib only draws into video_buf, so compose there and keep a copy
     ezd_fill(hDib, 0x444444);
 
-    if (hasBios)
+    if (!bigMode)
     {
-        //draw calculator buttons
         int cursor = 0;
-        if (!bigMode)
+        for (int y = 0; y < pngHeight; y++)
         {
-            for (int y = 0; y < pngHeight; y++)
+            for (int x = 0; x < pngWidth; x++)
             {
-                for (int x = 0; x < pngWidth; x++)
-                {
-                    video_buf[y * VIDEO_WIDTH + x + (640 - pngWidth)] = pngBuffer[cursor] << 16 | pngBuffer[cursor + 1] << 8 | pngBuffer[cursor + 2];
-                    cursor += 4;
-                }
+                uint32_t color = pngBuffer[cursor] << 16 | pngBuffer[cursor + 1] << 8 | pngBuffer[cursor + 2];
+                int offset = y * VIDEO_WIDTH + x + (640 - pngWidth);
+                if (rgb565)
+                    ((uint16_t*)video_buf)[offset] = to_rgb565(color);
+                else
+                    video_buf[offset] = color;
+                cursor += 4;
             }
         }
+    }
 
+    memcpy(skin_buf, video_buf, VIDEO_HEIGHT * VIDEO_PITCH);
+    skinBigMode = bigMode;
+}
 
-        //draw calculator screen
-        int sourceX = 0;
-        int sourceY = 0;
-        float scaleFactor = 3.0f;
-        if (bigMode)
+template <typename Pixel>
+void scaleColorLcd(Pixel* dst, const Pixel* image)
+{
+    for (int y = 0; y < scaleHeight; y++)
+    {
+        if (y > 0 && scaleRows[y] == scaleRows[y - 1])
         {
-            scaleFactor = ((float)VIDEO_WIDTH / (float)96);
+            memcpy(dst, dst - VIDEO_WIDTH, scaleWidth * sizeof(Pixel));
         }
-        int scaledWidth = (int)((float)CALC_WIDTH * scaleFactor);
-        int scaledHeight = (int)((float)CALC_HEIGHT * scaleFactor); ;
-        for (int y = 0; y < scaledHeight; y++)
+        else
         {
-            for (int x = 0; x < scaledWidth; x++)
-            {
-                if (x < 96 * scaleFactor)
-                {
-                    sourceX = (int)(((float)x) * ((float)CALC_WIDTH / float(scaledWidth)));
-                    sourceY = (int)(((float)y) * ((float)CALC_HEIGHT / float(scaledHeight)));
-                    cursor = ((sourceY * CALC_WIDTH) + sourceX) * 4;
-                    video_buf[y * VIDEO_WIDTH + x] = screen_converted[cursor] << 16 | screen_converted[cursor + 1] << 8 | screen_converted[cursor + 2];
-                }
-            }
+            const Pixel* src = image + scaleRows[y];
+            for (int x = 0; x < scaleWidth; x++)
+                dst[x] = src[scaleColumns[x]];
         }
+        dst += VIDEO_WIDTH;
+    }
+}
 
-        if (!bigMode)
+template <typename Pixel>
+void scaleLcd(Pixel* dst, const Pixel* palette)
+{
+    for (int y = 0; y < scaleHeight; y++)
+    {
+        // rows scaled from the same source row are copies of the one above
+        if (y > 0 && scaleRows[y] == scaleRows[y - 1])
         {
-            //draw button hovers
-            int arrSize = virtualButtons.size();
-            for (int i = 0; i < arrSize; i++)
-            {
-                drawButtonHover(&virtualButtons[i]);
-            }
+            memcpy(dst, dst - VIDEO_WIDTH, scaleWidth * sizeof(Pixel));
         }
-
-
-        if (!bigMode)
+        else
         {
-            int16_t mouseX = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_X);
-            int16_t mouseY = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_Y);
-            int16_t mousePressed = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_LEFT);
-            
-            int16_t mousePointerX = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_X);
-            int16_t mousePointerY = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_Y);
-            int16_t mousePointerPressed = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_PRESSED);
-            
-            int16_t gamepadX = input_state_cb(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_X);
-            int16_t gamepadY = input_state_cb(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_Y);
-
-            if (!gamingButtons)
-            {
-                bool leftPressed = false;
-                bool rightPressed = false;
-                bool upPressed = false;
-                bool downPressed = false;
-
-                if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT)) leftPressed = true;
-                if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT)) rightPressed = true;
-                if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP)) upPressed = true;
-                if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN)) downPressed = true;
-
-                if (leftPressed) gamepadX = -15000;
-                if (rightPressed) gamepadX = 15000;
-                if (upPressed) gamepadY = -15000;
-                if (downPressed) gamepadY = 15000;
-            }
-
-#ifdef DEBUG2
-            sprintf(textBuffer, "MouseX: %d MouseY: %d Pressed: %d", mouseX, mouseY, mousePressed);
-            ezd_text(hDib, hFont, textBuffer, -1, 10, 310, 0xffffff);
-
-            sprintf(textBuffer, "PointerX: %d PointerY: %d Pressed: %d", mousePointerX, mousePointerY, mousePointerPressed);
-            ezd_text(hDib, hFont, textBuffer, -1, 10, 340, 0xffffff);
-
-            sprintf(textBuffer, "GamepadX: %d GamepadY: %d", gamepadX, gamepadY);
-            ezd_text(hDib, hFont, textBuffer, -1, 10, 370, 0xffffff);
-#endif
-
-            //deadzone
-            if (gamepadX > 4000 || gamepadX < -4000)
-                virtualMouseX += ((int)(gamepadX / 6000.0f)) * virtualMouseSpeed;
-            if (gamepadY > 4000 || gamepadY < -4000)
-                virtualMouseY += ((int)(gamepadY / 6000.0f)) * virtualMouseSpeed;
-
-            //bounds
-            if (virtualMouseX < 0) virtualMouseX = 0;
-            if (virtualMouseY < 0) virtualMouseY = 0;
-            if (virtualMouseX > 640) virtualMouseX = 640;
-            if (virtualMouseY > 480) virtualMouseY = 480;
-
-            drawVirtualMouse();
+            unsigned char* src = lcd_screen + scaleRows[y];
+            for (int x = 0; x < scaleWidth; x++)
+                dst[x] = palette[src[scaleColumns[x]]];
         }
+        dst += VIDEO_WIDTH;
+    }
+}
 
+void drawLcd()
+{
+    if (lcdColor)
+    {
+        if (rgb565)
+            scaleColorLcd((uint16_t*)video_buf, (uint16_t*)lcd_color);
+        else
+            scaleColorLcd(video_buf, lcd_color);
+        return;
     }
+
+    if (rgb565)
+        scaleLcd((uint16_t*)video_buf, lcd_palette16);
     else
+        scaleLcd(video_buf, lcd_palette);
+}
+
+// Returns false when video_buf still holds the last frame
+bool drawScreen()
+{
+    if (!hasBios)
     {
+        if (!fullRedraw)
+            return false;
+        fullRedraw = false;
+
+        ezd_fill(hDib, 0x444444);
+
         int xAdjust = 40;
         ezd_fill_rect(hDib, 90 + xAdjust, 140, 470 + xAdjust, 230, 0x222222);
 
@@ -1019,8 +1264,152 @@ void drawScreen()
         sprintf(textBuffer, "ti83.rom");
         ezd_text(hDib, hFont, textBuffer, -1, 120 + xAdjust, 210, 0xffffff);
 
+        return true;
     }
-    
+
+#ifdef DEBUG2
+    fullRedraw = true;
+#endif
+
+    // a different LCD area may leave parts of the old one behind
+    bool scaleChanged = updateScaleTables();
+    bool rebuilt = fullRedraw || scaleChanged || skinBigMode != bigMode;
+    if (rebuilt)
+    {
+        buildSkin();
+        fullRedraw = false;
+        hoverDrawn.assign(virtualButtons.size(), false);
+        cursorDrawn = false;
+    }
+
+    if (!bigMode)
+    {
+        int16_t mouseX = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_X);
+        int16_t mouseY = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_Y);
+        int16_t mousePressed = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_LEFT);
+        
+        int16_t mousePointerX = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_X);
+        int16_t mousePointerY = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_Y);
+        int16_t mousePointerPressed = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_PRESSED);
+        
+        int16_t gamepadX = input_state_cb(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_X);
+        int16_t gamepadY = input_state_cb(0, RETRO_DEVICE_ANALOG, RETRO_DEVICE_INDEX_ANALOG_LEFT, RETRO_DEVICE_ID_ANALOG_Y);
+
+        if (!gamingButtons)
+        {
+            bool leftPressed = false;
+            bool rightPressed = false;
+            bool upPressed = false;
+            bool downPressed = false;
+
+            if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_LEFT)) leftPressed = true;
+            if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_RIGHT)) rightPressed = true;
+            if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_UP)) upPressed = true;
+            if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_DOWN)) downPressed = true;
+
+            if (leftPressed) gamepadX = -15000;
+            if (rightPressed) gamepadX = 15000;
+            if (upPressed) gamepadY = -15000;
+            if (downPressed) gamepadY = 15000;
+        }
+
+#ifdef DEBUG2
+        sprintf(textBuffer, "MouseX: %d MouseY: %d Pressed: %d", mouseX, mouseY, mousePressed);
+        ezd_text(hDib, hFont, textBuffer, -1, 10, 310, 0xffffff);
+
+        sprintf(textBuffer, "PointerX: %d PointerY: %d Pressed: %d", mousePointerX, mousePointerY, mousePointerPressed);
+        ezd_text(hDib, hFont, textBuffer, -1, 10, 340, 0xffffff);
+
+        sprintf(textBuffer, "GamepadX: %d GamepadY: %d", gamepadX, gamepadY);
+        ezd_text(hDib, hFont, textBuffer, -1, 10, 370, 0xffffff);
+#endif
+
+        //deadzone
+        if (gamepadX > 4000 || gamepadX < -4000)
+            virtualMouseX += ((int)(gamepadX / 6000.0f)) * virtualMouseSpeed;
+        if (gamepadY > 4000 || gamepadY < -4000)
+            virtualMouseY += ((int)(gamepadY / 6000.0f)) * virtualMouseSpeed;
+
+        //bounds
+        if (virtualMouseX < 0) virtualMouseX = 0;
+        if (virtualMouseY < 0) virtualMouseY = 0;
+        if (virtualMouseX > 640) virtualMouseX = 640;
+        if (virtualMouseY > 480) virtualMouseY = 480;
+    }
+
+    dirtyCount = 0;
+
+    if (screenChanged || rebuilt)
+        addDirtyRect(lcdRect());
+
+    int arrSize = virtualButtons.size();
+    for (int i = 0; i < arrSize; i++)
+    {
+        bool hover = !bigMode && virtualButtons[i].hover;
+        if (hover != hoverDrawn[i])
+            addDirtyRect(buttonRect(&virtualButtons[i]));
+    }
+
+    bool showCursor = !bigMode;
+    DirtyRect cursor = cursorRect();
+    if (cursorDrawn && (!showCursor || !sameRect(cursor, lastCursorRect)))
+        addDirtyRect(lastCursorRect);
+    if (showCursor && (!cursorDrawn || !sameRect(cursor, lastCursorRect)))
+        addDirtyRect(cursor);
+
+    if (dirtyCount == 0)
+        return rebuilt;
+
+    restoreDirtyRects();
+
+    //draw calculator screen
+    if (isDirty(lcdRect()))
+        drawLcd();
+
+    //draw button hovers
+    for (int i = 0; i < arrSize; i++)
+    {
+        bool hover = !bigMode && virtualButtons[i].hover;
+        if (hover && isDirty(buttonRect(&virtualButtons[i])))
+            drawButtonHover(&virtualButtons[i]);
+        hoverDrawn[i] = hover;
+    }
+
+    if (showCursor && isDirty(cursor))
+        drawVirtualMouse();
+    cursorDrawn = showCursor;
+    lastCursorRect = cursor;
+
+    return true;
+}
+
+template <typename Pixel>
+void copyLcd(Pixel* dst, const Pixel* palette, int width, int height)
+{
+    for (int y = 0; y < height; y++)
+    {
+        unsigned char* src = lcd_screen + y * CALC_WIDTH;
+        for (int x = 0; x < width; x++)
+            *dst++ = palette[src[x]];
+    }
+}
+
+// the LCD alone at its own size, packed at the top of video_buf
+void drawNativeScreen()
+{
+    LCDBase_t* lcd = mycalc.cpu.pio.lcd;
+
+    // already rendered at the output format by get_video_buffer
+    if (lcdColor)
+    {
+        memcpy(video_buf, lcd_color, lcd->width * lcd->height * VIDEO_PIXEL_SIZE);
+        return;
+    }
+
+    if (rgb565)
+        copyLcd((uint16_t*)video_buf, lcd_palette16, lcd->display_width, lcd->height);
+    else
+        copyLcd(video_buf, lcd_palette, lcd->display_width, lcd->height);
 }
 
 int printCounter = 0;
@@ -1048,80 +1437,101 @@ void toast_message(char* message)
     environ_cb(RETRO_ENVIRONMENT_SET_MESSAGE, &msg);
 }
 
-void retro_run()
+// presses the skin button under the mouse, pointer or virtual mouse
+void pressVirtualButtons()
 {
-    resetNeilButtons();
+    determineVirtualOrRegularMouseMode();
 
-    if (hasBios)
+    int mouseX = 0;
+    int mouseY = 0;
+    int mousePressed = 0;
+    if (virtualMouseMode)
     {
-        progressSave();
+        mouseX = virtualMouseX;
+        mouseY = virtualMouseY;
+        if (!gamingButtons)
+        {
+            if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A))
+            {
+                mousePressed = 1;
+            }
+        }
+    }
+    else
+    {
+        int16_t mousePointerX = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_X);
+        int16_t mousePointerY = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_Y);
+        mouseX = (int)((mousePointerX + 0x7fff) / (float)(0x7fff * 2) * VIDEO_WIDTH);
+        mouseY = (int)((mousePointerY + 0x7fff) / (float)(0x7fff * 2) * VIDEO_HEIGHT);
+
+        int16_t mouseDevicePressed = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_LEFT);
+        int16_t mousePointerPressed = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_PRESSED);
+        mousePressed = mouseDevicePressed | mousePointerPressed;
     }
 
+    if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R2))
+    {
+        mousePressed = true;
+    }
 
-    bool updated = false;
-    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
-        check_variables();
-
-    input_poll_cb();
 
-    if (hasBios)
+    int i = 0;
+    int arrSize = virtualButtons.size();
+    for (i = 0; i < arrSize; i++)
     {
-        determineVirtualOrRegularMouseMode();
+        virtualButtons[i].hover = false;
+        virtualButtons[i].pressed = false;
 
-        int mouseX = 0;
-        int mouseY = 0;
-        int mousePressed = 0;
-        if (virtualMouseMode)
+        if (mouseX >= virtualButtons[i].x && mouseX <= virtualButtons[i].x + virtualButtons[i].width &&
+            mouseY >= virtualButtons[i].y && mouseY <= virtualButtons[i].y + virtualButtons[i].height)
         {
-            mouseX = virtualMouseX;
-            mouseY = virtualMouseY;
-            if (!gamingButtons)
+            virtualButtons[i].hover = true;
+            if (mousePressed)
             {
-                if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_A))
-                {
-                    mousePressed = 1;
-                }
+                printCounter++;
+                virtualButtons[i].pressed = true;
+                *(virtualButtons[i].key) = true;
             }
         }
-        else
-        {
-            int16_t mousePointerX = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_X);
-            int16_t mousePointerY = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_Y);
-            mouseX = (int)((mousePointerX + 0x7fff) / (float)(0x7fff * 2) * VIDEO_WIDTH);
-            mouseY = (int)((mousePointerY + 0x7fff) / (float)(0x7fff * 2) * VIDEO_HEIGHT);
-
-            int16_t mouseDevicePressed = input_state_cb(0, RETRO_DEVICE_MOUSE, 0, RETRO_DEVICE_ID_MOUSE_LEFT);
-            int16_t mousePointerPressed = input_state_cb(0, RETRO_DEVICE_POINTER, 0, RETRO_DEVICE_ID_POINTER_PRESSED);
-            mousePressed = mouseDevicePressed | mousePointerPressed;
-        }
 
-        if (input_state_cb(0, RETRO_DEVICE_JOYPAD, 0, RETRO_DEVICE_ID_JOYPAD_R2))
-        {
-            mousePressed = true;
-        }
+        virtualButtons[i].lastPressed = virtualButtons[i].pressed;
 
+    }
+}
 
-        int i = 0;
-        int arrSize = virtualButtons.size();
-        for (i = 0; i < arrSize; i++)
-        {
-            virtualButtons[i].hover = false;
-            virtualButtons[i].pressed = false;
+void retro_run()
+{
+    resetNeilButtons();
 
-            if (mouseX >= virtualButtons[i].x && mouseX <= virtualButtons[i].x + virtualButtons[i].width &&
-                mouseY >= virtualButtons[i].y && mouseY <= virtualButtons[i].y + virtualButtons[i].height)
-            {
-                virtualButtons[i].hover = true;
-                if (mousePressed)
-                {
-                    printCounter++;
-                    virtualButtons[i].pressed = true;
-                    *(virtualButtons[i].key) = true;
-                }
-            }
+    if (hasBios)
+    {
+        progressSave();
+    }
 
-            virtualButtons[i].lastPressed = virtualButtons[i].pressed;
 
+    bool updated = false;
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE_UPDATE, &updated) && updated)
+    {
+        bool wasNative = showNativeVideo();
+        check_variables();
+        if (showNativeVideo() != wasNative)
+        {
+            fullRedraw = true;
+            struct retro_game_geometry geometry;
+            getGeometry(&geometry);
+            environ_cb(RETRO_ENVIRONMENT_SET_GEOMETRY, &geometry);
+        }
+    }
+
+    input_poll_cb();
+
+    if (hasBios)
+    {
+        // the native picture has no skin to point at, only the joypad
+        // mapping below presses keys there
+        if (!showNativeVideo())
+        {
+            pressVirtualButtons();
         }
 
 
@@ -1170,15 +1580,20 @@ void retro_run()
         int time = (&mycalc)->cpu.timer_c->freq / 50;
         calc_run_tstates(&mycalc, time);
 
-        unsigned char* screen = get_video_buffer();
-        convert_to_rgba(screen, screen_converted);
+        screenChanged = get_video_buffer();
     }
 
-    
-
-    drawScreen();
+    if (showNativeVideo())
+    {
+        LCDBase_t* lcd = mycalc.cpu.pio.lcd;
+        drawNativeScreen();
+        video_cb(video_buf, lcd->display_width, lcd->height, lcd->display_width * VIDEO_PIXEL_SIZE);
+        return;
+    }
 
-    video_cb(video_buf, VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_PITCH);
+    // a NULL frame tells the frontend to show the last one again
+    bool changed = drawScreen();
+    video_cb(changed || !canDupe ? video_buf : NULL, VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_PITCH);
 
 }
 
@@ -1201,6 +1616,7 @@ void retro_deinit(void)
 #else
     free(video_buf);
 #endif
+    free(skin_buf);
 
     ezd_destroy(hDib);
     ezd_destroy_font(hFont);
@@ -1209,6 +1625,7 @@ void retro_deinit(void)
     virtualButtons.clear();
 
     video_buf = NULL;
+    skin_buf = NULL;
 }
 
 void cartridge_set_rumble(unsigned active){}
@@ -9,6 +9,7 @@
 #include "83psehw.h"
 #include "86hw.h"
 #include "device.h"
+#include "jit.h"
 #include "var.h"
 #include "gif.h"
 #include "link.h"
@@ -302,6 +303,16 @@ BOOL rom_load(LPCALC lpCalc, LPCTSTR FileName) {
 		return FALSE;
 	}
 
+	int rom_size;
+	if (tifile->type == SAV_TYPE && GetRomOnly(tifile->save, &rom_size) == NULL) {
+		// a delta save only holds the flash pages that changed, so it goes
+		// on top of the ROM this calc was booted from
+		BOOL success = lpCalc->active && lpCalc->model == tifile->model &&
+			LoadSlot(tifile->save, lpCalc);
+		FreeTiFile(tifile);
+		return success;
+	}
+
 	lpCalc->speed = 100;
 	if (lpCalc->active) {
 		calc_slot_free(lpCalc);
@@ -406,6 +417,11 @@ BOOL rom_load(LPCALC lpCalc, LPCTSTR FileName) {
 
 	if (lpCalc != NULL) {
 		lpCalc->cpu.pio.model = lpCalc->model;
+		// the flash of a save is no ROM that can be booted again, so a calc
+		// loaded from one has no base and its delta saves hold the full ROM
+		if (tifile->type == ROM_TYPE) {
+			set_flash_base(&lpCalc->mem_c);
+		}
 
 		if (tifile->save == NULL) {
 			calc_reset(lpCalc);
@@ -441,16 +457,20 @@ void calc_slot_free(LPCALC lpCalc) {
 	lpCalc->mem_c.flash = NULL;
 	free(lpCalc->mem_c.ram);
 	lpCalc->mem_c.ram = NULL;
-	free(lpCalc->mem_c.flash_break);
-	lpCalc->mem_c.flash_break = NULL;
-	free(lpCalc->mem_c.ram_break);
-	lpCalc->mem_c.ram_break = NULL;
+	free(lpCalc->mem_c.flash_base);
+	lpCalc->mem_c.flash_base = NULL;
+	free(lpCalc->mem_c.flash_dirty);
+	lpCalc->mem_c.flash_dirty = NULL;
+	free_breaks(&lpCalc->mem_c);
 
 	if (link_connected_hub(lpCalc->slot)) {
 		link_hub_list[lpCalc->slot] = NULL;
 	}
 	free(lpCalc->cpu.pio.link);
 	lpCalc->cpu.pio.link = NULL;
+#ifdef WITH_JIT
+	jit_free(&lpCalc->cpu);
+#endif
 
 	free(lpCalc->cpu.pio.keypad);
 	lpCalc->cpu.pio.keypad = NULL;
@@ -477,15 +497,15 @@ static void calc_debug_callback(LPCALC lpCalc)
 }
 
 int calc_run_frame(LPCALC lpCalc) {
-	double cpu_sync = lpCalc->timer_c.elapsed;
+	uint64_t cpu_sync = tc_clock(&lpCalc->timer_c);
 
 	while(lpCalc->running) {
 		CPU_step(&lpCalc->cpu);
 
 		/* sync CPU */
-		if (lpCalc->timer_c.elapsed - cpu_sync > (1.0f / FPS)) {
+		if (tc_clock(&lpCalc->timer_c) - cpu_sync > CLOCK_HZ(FPS)) {
 			if (lpCalc->speed == MAX_SPEED) return 0;
-			if (lpCalc->timer_c.elapsed - cpu_sync > (lpCalc->speed / FPS)) return 0;
+			if (tc_clock(&lpCalc->timer_c) - cpu_sync > (uint64_t) (lpCalc->speed / FPS) * TIMER_CLOCK_RATE) return 0;
 		}
 	}
 
@@ -496,19 +516,26 @@ int calc_run_tstates(LPCALC lpCalc, time_t tstates) {
 	uint64_t time_end = lpCalc->timer_c.tstates + tstates - lpCalc->time_error;
 
 	while (lpCalc->running) {
-		if (check_break(&lpCalc->mem_c, addr16_to_waddr(&lpCalc->mem_c, lpCalc->cpu.pc))) {
+		// stop at the next avi frame too, so it is sent after the same instruction as before
+		uint64_t run_end = time_end;
+		if (lpCalc->cpu.pio.lcd != NULL) {
+			uint64_t avi_tstates = clock_to_tstates(&lpCalc->cpu, lpCalc->cpu.pio.lcd->lastaviframe + CLOCK_HZ(AVI_FPS));
+			if (avi_tstates < run_end) {
+				run_end = avi_tstates;
+			}
+		}
+
+		if (CPU_run(&lpCalc->cpu, run_end, &lpCalc->running, lpCalc->mem_c.break_count != 0)) {
 			calc_set_running(lpCalc, FALSE);
 			lpCalc->breakpoint_callback(lpCalc);
 			return 0;
 		}
 
-		CPU_step(&lpCalc->cpu);
-
 		if (lpCalc->cpu.pio.lcd != NULL && 
-			(lpCalc->timer_c.elapsed - lpCalc->cpu.pio.lcd->lastaviframe) >= (1.0 / AVI_FPS))
+			(tc_clock(&lpCalc->timer_c) - lpCalc->cpu.pio.lcd->lastaviframe) >= CLOCK_HZ(AVI_FPS))
 		{
 			notify_event(lpCalc, AVI_VIDEO_FRAME_EVENT);
-			lpCalc->cpu.pio.lcd->lastaviframe += 1.0 / AVI_FPS;
+			lpCalc->cpu.pio.lcd->lastaviframe += CLOCK_HZ(AVI_FPS);
 		}
 
 		if (lpCalc->timer_c.tstates >= time_end) {
@@ -657,9 +684,9 @@ int calc_run_all(void) {
 
 		//this code handles screenshotting if were actually taking screenshots right now
 		if (active_calc >= 0 && !calc_waiting_link && calcs[active_calc].cpu.timer_c != NULL && calcs[active_calc].cpu.pio.lcd != NULL) {
-			if ((calcs[active_calc].cpu.timer_c->elapsed - calcs[active_calc].cpu.pio.lcd->lastgifframe) >= 0.01) {
+			if ((tc_clock(calcs[active_calc].cpu.timer_c) - calcs[active_calc].cpu.pio.lcd->lastgifframe) >= CLOCK_MS(10)) {
 				notify_event(&calcs[active_calc], GIF_FRAME_EVENT);
-				calcs[active_calc].cpu.pio.lcd->lastgifframe += 0.01;
+				calcs[active_calc].cpu.pio.lcd->lastgifframe += CLOCK_MS(10);
 			}
 		}
 	}
@@ -14,10 +14,10 @@
 
 int neg(CPU_t *cpu) {
 	int result = -cpu->a;
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + hcsubchk(0,cpu->a,0) + 
 		 x3chk(result)+ vchksub(0,cpu->a,result) + 
-		 SUB_INSTR +  carrychk(result);
+		 SUB_INSTR +  carrychk(result));
 	cpu->a = result;
 
 	return 8;
@@ -41,11 +41,11 @@ int adc_hl_reg16(CPU_t *cpu) {
 			reg = cpu->sp;
 			break;
 	}
-	result = cpu->hl+reg+ (cpu->f&CARRY_MASK);
-	cpu->f = signchk16(result) + zerochk16(result) + 
-		 x5chk16(result) + hcaddchk16(cpu->hl,reg,cpu->f&CARRY_MASK) + 
+	result = cpu->hl+reg+ (get_f(cpu)&CARRY_MASK);
+	set_f(cpu, signchk16(result) + zerochk16(result) + 
+		 x5chk16(result) + hcaddchk16(cpu->hl,reg,get_f(cpu)&CARRY_MASK) + 
 		 x3chk16(result)+ vchkadd16(cpu->hl,reg,result) + 
-		 ADD_INSTR +  carrychk16(result);
+		 ADD_INSTR +  carrychk16(result));
 	cpu->hl = result;
 
 	return 15;
@@ -69,12 +69,12 @@ int sbc_hl_reg16(CPU_t *cpu) {
 			reg = cpu->sp;
 			break;
 	}
-	result = cpu->hl - reg - (cpu->f&CARRY_MASK);
+	result = cpu->hl - reg - (get_f(cpu)&CARRY_MASK);
 
-	cpu->f = signchk16(result) + zerochk16(result) + 
-		 x5chk16(result) + hcsubchk16(cpu->hl,reg,cpu->f&CARRY_MASK) + 
+	set_f(cpu, signchk16(result) + zerochk16(result) + 
+		 x5chk16(result) + hcsubchk16(cpu->hl,reg,get_f(cpu)&CARRY_MASK) + 
 		 x3chk16(result)+ vchksub16(cpu->hl, reg, result) +                //DOUBLE CHECK!!!!
-		 SUB_INSTR +  carrychk16(result);
+		 SUB_INSTR +  carrychk16(result));
 	cpu->hl = result;
 
 	return 15;
@@ -90,10 +90,10 @@ int cpd(CPU_t *cpu) {
 	result = cpu->a - reg;
 	cpu->bc--;
 	cpu->hl--;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg-((cpu->f&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg-((cpu->f&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
-		 SUB_INSTR +  unaffect(CARRY_MASK);
+	set_f(cpu, signchk(result) + zerochk(result) +
+		 x5chk(reg-((get_f(cpu)&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
+		 x3chk(reg-((get_f(cpu)&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
+		 SUB_INSTR +  unaffect(CARRY_MASK));
 
 	return 16;
 }
@@ -102,20 +102,22 @@ int cpdr(CPU_t *cpu) {
 	int result;
 	int reg;
 
-	reg = CPU_mem_read(cpu,cpu->hl);
-	result = cpu->a - reg;
-	cpu->bc--;
-	cpu->hl--;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg-((cpu->f&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg-((cpu->f&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
-		 SUB_INSTR +  unaffect(CARRY_MASK);
-	if ((cpu->f&PV_MASK)!=0 && (cpu->f&ZERO_MASK)==0 ) {
-		cpu->pc-=2;
-		return 21;
-	}
-	
-	return 16;
+	do {
+		reg = CPU_mem_read(cpu,cpu->hl);
+		result = cpu->a - reg;
+		cpu->bc--;
+		cpu->hl--;
+		set_f(cpu, signchk(result) + zerochk(result) +
+			 x5chk(reg-((get_f(cpu)&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
+			 x3chk(reg-((get_f(cpu)&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
+			 SUB_INSTR +  unaffect(CARRY_MASK));
+		if ((get_f(cpu)&PV_MASK)==0 || (get_f(cpu)&ZERO_MASK)!=0 ) {
+			return 16;
+		}
+	} while (CPU_block_repeat(cpu, -1));
+
+	cpu->pc-=2;
+	return 21;
 }
 
 int cpi(CPU_t *cpu) {
@@ -125,29 +127,33 @@ int cpi(CPU_t *cpu) {
 	result = cpu->a - reg;
 	cpu->bc--;
 	cpu->hl++;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg-((cpu->f&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg-((cpu->f&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
-		 SUB_INSTR +  unaffect(CARRY_MASK);
+	set_f(cpu, signchk(result) + zerochk(result) +
+		 x5chk(reg-((get_f(cpu)&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
+		 x3chk(reg-((get_f(cpu)&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
+		 SUB_INSTR +  unaffect(CARRY_MASK));
 	return 16;
 }
 
 int cpir(CPU_t *cpu) {
 	int result;
-	int reg = CPU_mem_read(cpu,cpu->hl);
-	result = cpu->a - reg;
-	cpu->bc--;
-	cpu->hl++;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg-((cpu->f&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg-((cpu->f&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
-		 SUB_INSTR +  unaffect(CARRY_MASK);
-	if ((cpu->f&PV_MASK)!=0 && (cpu->f&ZERO_MASK)==0 ) {
-		cpu->pc-=2;
-		return 21;
-	}
+	int reg;
 
-	return 16;
+	do {
+		reg = CPU_mem_read(cpu,cpu->hl);
+		result = cpu->a - reg;
+		cpu->bc--;
+		cpu->hl++;
+		set_f(cpu, signchk(result) + zerochk(result) +
+			 x5chk(reg-((get_f(cpu)&HC_MASK)>>4)) + hcsubchk(cpu->a,reg,0) + 
+			 x3chk(reg-((get_f(cpu)&HC_MASK)>>4))+ doparity(cpu->bc!=0) + 
+			 SUB_INSTR +  unaffect(CARRY_MASK));
+		if ((get_f(cpu)&PV_MASK)==0 || (get_f(cpu)&ZERO_MASK)!=0 ) {
+			return 16;
+		}
+	} while (CPU_block_repeat(cpu, -1));
+
+	cpu->pc-=2;
+	return 21;
 }
 
 
@@ -155,9 +161,9 @@ int rld(CPU_t *cpu) {
 	int result = (CPU_mem_read(cpu,cpu->hl)<<4)+(cpu->a&0x0f);
 	CPU_mem_write(cpu,cpu->hl,result&0xff);
 	cpu->a = (cpu->a&0xF0)+((result>>8)&0x0F);
-	cpu->f = signchk(cpu->a) + zerochk(cpu->a) +
+	set_f(cpu, signchk(cpu->a) + zerochk(cpu->a) +
 		 x5chk(cpu->a) + x3chk(cpu->a)+ 
-		 parity(cpu->a) + unaffect(CARRY_MASK);
+		 parity(cpu->a) + unaffect(CARRY_MASK));
 
 	return 18;
 }
@@ -168,9 +174,9 @@ int rrd(CPU_t *cpu) {
 	tmp = cpu->bus;
 	CPU_mem_write(cpu,cpu->hl,result&0xff);
 	cpu->a = (cpu->a&0xF0)+(tmp&0x0F);
-	cpu->f = signchk(cpu->a) + zerochk(cpu->a) +
+	set_f(cpu, signchk(cpu->a) + zerochk(cpu->a) +
 		 x5chk(cpu->a) + x3chk(cpu->a)+ 
-		 parity(cpu->a) + unaffect(CARRY_MASK);
+		 parity(cpu->a) + unaffect(CARRY_MASK));
 
 	return 18;
 }
@@ -220,9 +226,9 @@ int bit(CPU_t *cpu) {
 	if ( (dbus&0x07)!=0x06 ) xchk = result;
 	else xchk = cpu->h;
 		xchk = result;
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(xchk) + HC_MASK + 
-		 x3chk(xchk)+ parity(result) + unaffect(CARRY_MASK);
+		 x3chk(xchk)+ parity(result) + unaffect(CARRY_MASK));
 
 	return time;
 }
@@ -310,43 +316,43 @@ int rl_reg(CPU_t *cpu) {
 	switch ((cpu->bus)&0x07) {
 		case 0x00:
 			carry = (cpu->b>>7)&0x01;
-			result = cpu->b = ((cpu->b<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->b = ((cpu->b<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x01:
 			carry = (cpu->c>>7)&0x01;
-			result = cpu->c = ((cpu->c<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->c = ((cpu->c<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x02:
 			carry = (cpu->d>>7)&0x01;
-			result = cpu->d = ((cpu->d<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->d = ((cpu->d<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x03:
 			carry = (cpu->e>>7)&0x01;
-			result = cpu->e = ((cpu->e<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->e = ((cpu->e<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x04:
 			carry = (cpu->h>>7)&0x01;
-			result = cpu->h = ((cpu->h<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->h = ((cpu->h<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x05:
 			carry = (cpu->l>>7)&0x01;
-			result = cpu->l = ((cpu->l<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->l = ((cpu->l<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 		case 0x06:
 			result = CPU_mem_read(cpu,cpu->hl);
 			carry = (result>>7)&0x01;
-			result = ((result<<1)+(cpu->f&0x01))&0xFF;
+			result = ((result<<1)+(get_f(cpu)&0x01))&0xFF;
 			time += 7;
 			CPU_mem_write(cpu,cpu->hl,result);
 			break;
 		case 0x07:
 			carry = (cpu->a>>7)&0x01;
-			result = cpu->a = ((cpu->a<<1)+(cpu->f&0x01))&0xFF;
+			result = cpu->a = ((cpu->a<<1)+(get_f(cpu)&0x01))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 
 	return time;
 }
@@ -392,9 +398,9 @@ int rlc_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a<<1)+carry)&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 	return time;
 }
 
@@ -405,43 +411,43 @@ int rr_reg(CPU_t *cpu) {
 	switch ((cpu->bus)&7) {
 		case 0x00:
 			carry = cpu->b&1;
-			result = cpu->b = ((cpu->b>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->b = ((cpu->b>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x01:
 			carry = cpu->c&1;
-			result = cpu->c = ((cpu->c>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->c = ((cpu->c>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x02:
 			carry = cpu->d&1;
-			result = cpu->d = ((cpu->d>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->d = ((cpu->d>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x03:
 			carry = cpu->e&1;
-			result = cpu->e = ((cpu->e>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->e = ((cpu->e>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x04:
 			carry = cpu->h&1;
-			result = cpu->h = ((cpu->h>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->h = ((cpu->h>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x05:
 			carry = cpu->l&1;
-			result = cpu->l = ((cpu->l>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->l = ((cpu->l>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 		case 0x06:
 			result = CPU_mem_read(cpu,cpu->hl);
 			carry = result&1;
-			result = ((result>>1)+((cpu->f&1)<<7))&0xFF;
+			result = ((result>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			time += 7;
 			CPU_mem_write(cpu,cpu->hl,result);
 			break;
 		case 0x07:
 			carry = cpu->a&1;
-			result = cpu->a = ((cpu->a>>1)+((cpu->f&1)<<7))&0xFF;
+			result = cpu->a = ((cpu->a>>1)+((get_f(cpu)&1)<<7))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 	return time;
 }
 int rrc_reg(CPU_t *cpu) {
@@ -485,9 +491,9 @@ int rrc_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a>>1)+(carry<<7))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 	return time;
 }
 
@@ -532,9 +538,9 @@ int sll_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a<<1)+1)&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 	return time;
 }
 int sla_reg(CPU_t *cpu) {
@@ -578,9 +584,9 @@ int sla_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a<<1))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 
 	return time;
 }
@@ -626,9 +632,9 @@ int sra_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a>>1)+(cpu->a&128))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 
 	return time;
 }
@@ -673,9 +679,9 @@ int srl_reg(CPU_t *cpu) {
 			result = cpu->a = ((cpu->a>>1))&0xFF;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+ 
-		 parity(result) + carry;
+		 parity(result) + carry);
 	return time;
 }
 // END CB OPCODES
@@ -717,12 +723,12 @@ int and_reg8(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -736,9 +742,7 @@ int and_reg8(CPU_t *cpu) {
 			break;
 	}
 	result = cpu->a & reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + HC_MASK + 
-		 x3chk(result)+ parity(result);
+	flags_and(result);
 	cpu->a = result;
 	return time;
 }
@@ -753,9 +757,7 @@ int and_num8(CPU_t *cpu) {
 	
 	reg = CPU_mem_read(cpu,cpu->pc++);
 	result = cpu->a&reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + HC_MASK + 
-		 x3chk(result)+ parity(result);
+	flags_and(result);
 	cpu->a = result;
 	return 7;
 }
@@ -796,12 +798,12 @@ int or_reg8(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -814,9 +816,7 @@ int or_reg8(CPU_t *cpu) {
 			break;
 	}
 	result = cpu->a | reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + 
-		 x3chk(result)+ parity(result);
+	flags_or(result);
 	cpu->a = result;
 	return time;
 }
@@ -829,9 +829,7 @@ int or_num8(CPU_t *cpu) {
 	
 	reg = CPU_mem_read(cpu,cpu->pc++);
 	result = cpu->a|reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + 
-		 x3chk(result)+ parity(result);
+	flags_or(result);
 	cpu->a = result;
 
 	return 7;
@@ -871,12 +869,12 @@ int xor_reg8(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -889,9 +887,7 @@ int xor_reg8(CPU_t *cpu) {
 			break;
 	}
 	result = cpu->a^reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + 
-		 x3chk(result)+ parity(result);
+	flags_or(result);
 	cpu->a = result;
 	return time;
 }
@@ -905,9 +901,7 @@ int xor_num8(CPU_t *cpu) {
 
 	reg = CPU_mem_read(cpu,cpu->pc++);
 	result = cpu->a^reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + 
-		 x3chk(result)+ parity(result);
+	flags_or(result);
 	cpu->a = result;
 	return 7;
 }
@@ -944,12 +938,12 @@ int cp_reg8(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -962,10 +956,7 @@ int cp_reg8(CPU_t *cpu) {
 			break;
 	}
 	result = cpu->a - reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg)+ vchksub(cpu->a,reg,result) + 
-		 SUB_INSTR +  carrychk(result);
+	flags_cp(cpu->a, reg, result);
 	return time;
 }
 
@@ -975,18 +966,15 @@ int cp_num8(CPU_t *cpu) {
 
 	reg = CPU_mem_read(cpu,cpu->pc++);
 	result = cpu->a - reg;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(reg) + hcsubchk(cpu->a,reg,0) + 
-		 x3chk(reg)+ vchksub(cpu->a,reg,result) + 
-		 SUB_INSTR +  carrychk(result);
+	flags_cp(cpu->a, reg, result);
 
 	return 7;
 }
 
 int cpl(CPU_t *cpu) {
 	int result = (~cpu->a)&255;
-	cpu->f =unaffect( SIGN_MASK+ZERO_MASK+PV_MASK+CARRY_MASK) +
-		 x5chk(result) + HC_MASK + x3chk(result)+ N_MASK;
+	set_f(cpu, unaffect( SIGN_MASK+ZERO_MASK+PV_MASK+CARRY_MASK) +
+		 x5chk(result) + HC_MASK + x3chk(result)+ N_MASK);
 	cpu->a = result;
 
 	return 4;
@@ -995,17 +983,17 @@ int cpl(CPU_t *cpu) {
 int daa(CPU_t *cpu) {
 	int result = cpu->a;
 	
-	if ( (cpu->f&N_MASK)!=0 ) {
-		if ( (cpu->f&HC_MASK)!=0 || (cpu->a&0x0f)>9 ) result -= 0x06;
-		if ( (cpu->f&CARRY_MASK)!=0 || (cpu->a > 0x99) ) result -= 0x60;
+	if ( (get_f(cpu)&N_MASK)!=0 ) {
+		if ( (get_f(cpu)&HC_MASK)!=0 || (cpu->a&0x0f)>9 ) result -= 0x06;
+		if ( (get_f(cpu)&CARRY_MASK)!=0 || (cpu->a > 0x99) ) result -= 0x60;
 	} else {
-		if ( (cpu->f&HC_MASK)!=0 || (cpu->a&0x0f)>9 ) result += 0x06;
-		if ( (cpu->f&CARRY_MASK)!=0 || (cpu->a > 0x99) ) result += 0x60;
+		if ( (get_f(cpu)&HC_MASK)!=0 || (cpu->a&0x0f)>9 ) result += 0x06;
+		if ( (get_f(cpu)&CARRY_MASK)!=0 || (cpu->a > 0x99) ) result += 0x60;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + (cpu->a&0x10 ^ result&0x10) + 
 		 x3chk(result)+ parity(result) + 
-		 unaffect( N_MASK ) + ((cpu->f & CARRY_MASK) | ((cpu->a>0x99)?CARRY_MASK:0));
+		 unaffect( N_MASK ) + ((get_f(cpu) & CARRY_MASK) | ((cpu->a>0x99)?CARRY_MASK:0)));
 	cpu->a = result;
 	return 4;
 }
@@ -1039,11 +1027,11 @@ int dec_reg8(CPU_t *cpu) {
 			result = cpu->e;
 			break;
 		case 0x04:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->h;
 				cpu->h--;
 				result = cpu->h;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ixh;
 				cpu->ixh--;
 				result = cpu->ixh;
@@ -1056,11 +1044,11 @@ int dec_reg8(CPU_t *cpu) {
 			}
 			break;
 		case 0x05:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->l;
 				cpu->l--;
 				result = cpu->l;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ixl;
 				cpu->ixl--;
 				result = cpu->ixl;
@@ -1073,7 +1061,7 @@ int dec_reg8(CPU_t *cpu) {
 			}
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				result = reg;
 				result--;
@@ -1081,7 +1069,7 @@ int dec_reg8(CPU_t *cpu) {
 				time += 7;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu,cpu->ix+offset);
 					result = reg;
 					result--;
@@ -1102,10 +1090,7 @@ int dec_reg8(CPU_t *cpu) {
 			result = cpu->a;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcsubchk(reg,1,0) + 
-		 x3chk(result)+ vchksub(reg,1,result) + 
-		 SUB_INSTR +  unaffect(CARRY_MASK);
+	flags_dec(reg, result);
 
 	return time;
 }
@@ -1137,11 +1122,11 @@ int inc_reg8(CPU_t *cpu) {
 			result = cpu->e;
 			break;
 		case 0x04:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->h;
 				cpu->h++;
 				result = cpu->h;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ixh;
 				cpu->ixh++;
 				result = cpu->ixh;
@@ -1154,11 +1139,11 @@ int inc_reg8(CPU_t *cpu) {
 			}
 			break;
 		case 0x05:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->l;
 				cpu->l++;
 				result = cpu->l;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ixl;
 				cpu->ixl++;
 				result = cpu->ixl;
@@ -1171,7 +1156,7 @@ int inc_reg8(CPU_t *cpu) {
 			}
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				result = reg;
 				result++;
@@ -1179,7 +1164,7 @@ int inc_reg8(CPU_t *cpu) {
 				time += 7;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu,cpu->ix+offset);
 					result = reg;
 					result++;
@@ -1200,10 +1185,7 @@ int inc_reg8(CPU_t *cpu) {
 			result = cpu->a;
 			break;
 	}
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcaddchk(reg,1,0) + 
-		 x3chk(result)+vchkadd(reg,1,result) + 
-		 ADD_INSTR +  unaffect(CARRY_MASK);
+	flags_inc(reg, result);
 	return time;
 }
 //-----------------
@@ -1243,12 +1225,12 @@ int add_a_reg(CPU_t *cpu, int carry) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -1261,15 +1243,12 @@ int add_a_reg(CPU_t *cpu, int carry) {
 			break;
 	}
 	result = cpu->a+reg+carry;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcaddchk(cpu->a,reg,carry) + 
-		 x3chk(result)+ vchkadd(cpu->a,reg,result) + 
-		 ADD_INSTR +  carrychk(result);
+	flags_add(cpu->a, reg, carry, result);
 	cpu->a = result;
 	return time;
 }
 int adc_a_reg8(CPU_t *cpu) {
-	return add_a_reg(cpu, cpu->f & 1);
+	return add_a_reg(cpu, get_f(cpu) & 1);
 }
 int add_a_reg8(CPU_t *cpu) {
 	return add_a_reg(cpu, 0);
@@ -1284,15 +1263,12 @@ int add_a_num(CPU_t *cpu, int carry) {
 	int reg;
 	reg = CPU_mem_read(cpu,cpu->pc++);	//THIS IS NOT AN OPCODE READ
 	result = cpu->a + reg + carry;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcaddchk(cpu->a,reg,carry) + 
-		 x3chk(result)+ vchkadd(cpu->a,reg,result) + 
-		 ADD_INSTR +  carrychk(result);
+	flags_add(cpu->a, reg, carry, result);
 	cpu->a = result;
 	return 7;
 }
 int adc_a_num8(CPU_t *cpu) {
-	return add_a_num(cpu, cpu->f & 1);
+	return add_a_num(cpu, get_f(cpu) & 1);
 }
 int add_a_num8(CPU_t *cpu) {
 	return add_a_num(cpu,0);
@@ -1336,12 +1312,12 @@ int sub_a_reg(CPU_t *cpu, int carry) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -1355,15 +1331,12 @@ int sub_a_reg(CPU_t *cpu, int carry) {
 			break;
 	}
 	result = cpu->a - reg - carry;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcsubchk(cpu->a,reg,carry) + 
-		 x3chk(result)+ vchksub(cpu->a,reg,result) + 
-		 SUB_INSTR +  carrychk(result);
+	flags_sub(cpu->a, reg, carry, result);
 	cpu->a = result;
 	return time;
 }
 int sbc_a_reg8(CPU_t *cpu) {
-	return sub_a_reg(cpu,(cpu->f)&1);
+	return sub_a_reg(cpu,get_f(cpu)&1);
 }
 int sub_a_reg8(CPU_t *cpu) {
 	return sub_a_reg(cpu,0);
@@ -1378,16 +1351,13 @@ int sub_a_num(CPU_t *cpu,int carry) {
 	
 	reg = CPU_mem_read(cpu,cpu->pc++);
 	result = cpu->a - reg - carry;
-	cpu->f = signchk(result) + zerochk(result) +
-		 x5chk(result) + hcsubchk(cpu->a,reg,carry) + 
-		 x3chk(result)+ vchksub(cpu->a,reg,result) + 
-		 SUB_INSTR +  carrychk(result);
+	flags_sub(cpu->a, reg, carry, result);
 	cpu->a = result;
 
 	return 7;
 }
 int sbc_a_num8(CPU_t *cpu) {
-	return sub_a_num(cpu, cpu->f & 1);
+	return sub_a_num(cpu, get_f(cpu) & 1);
 }
 int sub_a_num8(CPU_t *cpu) {
 	return sub_a_num(cpu, 0);
@@ -1454,9 +1424,9 @@ int add_hl_reg16(CPU_t *cpu) {
 			reg = cpu->de;
 			break;
 		case 0x02:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->hl;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ix;
 				time+=4;
 			} else {
@@ -1469,10 +1439,10 @@ int add_hl_reg16(CPU_t *cpu) {
 			break;
 	}
 
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		base = cpu->hl;
 		cpu->hl = result = base + reg;
-	} else if (cpu->prefix == 0xDD) {
+	} else if (INDEX_PREFIX == 0xDD) {
 		base = cpu->ix;
 		cpu->ix = result = base + reg;
 	} else {
@@ -1480,18 +1450,18 @@ int add_hl_reg16(CPU_t *cpu) {
 		cpu->iy = result = base + reg;
 	}
 
-	cpu->f = unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
+	set_f(cpu, unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
 		 x5chk16(result) + hcaddchk16(base, reg, 0) + 
 		 x3chk16(result)+ 
-		 ADD_INSTR +  carrychk16( base + reg);
+		 ADD_INSTR +  carrychk16( base + reg));
 	return time;
 }
 
 
 int rla(CPU_t *cpu) {
-	int result = ((cpu->a<<1)+(cpu->f&1))&255;
-	cpu->f = unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
-		 x5chk(result) + x3chk(result)+ (((cpu->a)>>7)&1);
+	int result = ((cpu->a<<1)+(get_f(cpu)&1))&255;
+	set_f(cpu, unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
+		 x5chk(result) + x3chk(result)+ (((cpu->a)>>7)&1));
 	cpu->a =result;
 
 	return 4;
@@ -1499,16 +1469,16 @@ int rla(CPU_t *cpu) {
 }
 int rlca(CPU_t *cpu) {
 	int result = ((cpu->a<<1)+(((cpu->a)>>7)&1))&255;
-	cpu->f = unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
-		 x5chk(result) + x3chk(result)+ (((cpu->a)>>7)&1);
+	set_f(cpu, unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
+		 x5chk(result) + x3chk(result)+ (((cpu->a)>>7)&1));
 	cpu->a =result;
 
 	return 4;
 }
 int rra(CPU_t *cpu) {
-	int result = ((cpu->a>>1)+((cpu->f&1)<<7))&255;
-	cpu->f = unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
-		 x5chk(result) + x3chk(result)+ ((cpu->a)&1);
+	int result = ((cpu->a>>1)+((get_f(cpu)&1)<<7))&255;
+	set_f(cpu, unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
+		 x5chk(result) + x3chk(result)+ ((cpu->a)&1));
 	cpu->a =result;
 
 	return 4;
@@ -1516,8 +1486,8 @@ int rra(CPU_t *cpu) {
 }
 int rrca(CPU_t *cpu) {
 	int result = ((cpu->a>>1)+(((cpu->a)<<7)&128))&255;
-	cpu->f = unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
-		 x5chk(result) + x3chk(result)+ ((cpu->a)&1);
+	set_f(cpu, unaffect(SIGN_MASK +ZERO_MASK+PV_MASK) + 
+		 x5chk(result) + x3chk(result)+ ((cpu->a)&1));
 	cpu->a =result;
 
 	return 4;
@@ -10,7 +10,7 @@
 #define N_MASK 0x02
 #define CARRY_MASK 0x01
 
-#define unaffect( mask )	((cpu->f)&(mask))
+#define unaffect( mask )	(get_f(cpu)&(mask))
 
 #define dosign( tval )		(( tval )?SIGN_MASK:0)
 #define dozero( tval )		(( tval )?ZERO_MASK:0)
@@ -31,7 +31,8 @@
 #define x3chk( tval )		((tval)&0x08)
 #define vchkadd(opr1,opr2,res) ( ((((opr1) & 0x80) == ((opr2) & 0x80) ) & (((opr1) & 0x80) != ((res) & 0x80))) << 2)
 #define vchksub(opr1,opr2,res) ( ((((opr1) & 0x80) != ((opr2) & 0x80) ) & (((opr1) & 0x80) != ((res) & 0x80))) << 2)
-#define parity( opr1 )          ((((((opr1)>>0)^((opr1)>>1)^((opr1)>>2)^((opr1)>>3)^((opr1)>>4)^((opr1)>>5)^((opr1)>>6)^((opr1)>>7))&1)^1)*PV_MASK) 
+// fold the byte into a nibble, 0x9669 has a bit set for every even parity nibble
+#define parity( opr1 )          (((0x9669 >> (((opr1) ^ ((opr1) >> 4)) & 0x0F)) & 1) * PV_MASK)
 //add or sub
 #define carrychk(tval)		(((tval) & 0x100) >> 8)
 
@@ -47,6 +48,57 @@
 //add sub
 #define carrychk16(tval)		(((tval) & 0x10000) >> 16)
 
+#ifdef WITH_LAZY_FLAGS
+// inc and dec keep the carry of the op before them in lazy_opr2
+#define lazy_carry()	(cpu->lazy_op >= LAZY_INC ? cpu->lazy_opr2 : \
+						 cpu->lazy_op >= LAZY_AND ? 0 : \
+						 cpu->lazy_op != LAZY_NONE ? carrychk(cpu->lazy_res) : cpu->f & CARRY_MASK)
+#define lazy_record(op, opr1, opr2, res) \
+	(cpu->lazy_opr1 = (opr1), cpu->lazy_opr2 = (opr2), cpu->lazy_res = (res), cpu->lazy_op = (op))
+
+#define flags_add(opr1, opr2, carry, res)	lazy_record(LAZY_ADD, opr1, opr2, res)
+#define flags_sub(opr1, opr2, carry, res)	lazy_record(LAZY_SUB, opr1, opr2, res)
+#define flags_cp(opr1, opr2, res)			lazy_record(LAZY_CP, opr1, opr2, res)
+#define flags_and(res)						lazy_record(LAZY_AND, 0, 0, res)
+#define flags_or(res)						lazy_record(LAZY_OR, 0, 0, res)
+#define flags_inc(opr1, res)				lazy_record(LAZY_INC, opr1, lazy_carry(), res)
+#define flags_dec(opr1, res)				lazy_record(LAZY_DEC, opr1, lazy_carry(), res)
+#else
+#define flags_add(opr1, opr2, carry, res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + hcaddchk(opr1,opr2,carry) + \
+		 x3chk(res)+ vchkadd(opr1,opr2,res) + \
+		 ADD_INSTR +  carrychk(res))
+#define flags_sub(opr1, opr2, carry, res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + hcsubchk(opr1,opr2,carry) + \
+		 x3chk(res)+ vchksub(opr1,opr2,res) + \
+		 SUB_INSTR +  carrychk(res))
+#define flags_cp(opr1, opr2, res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(opr2) + hcsubchk(opr1,opr2,0) + \
+		 x3chk(opr2)+ vchksub(opr1,opr2,res) + \
+		 SUB_INSTR +  carrychk(res))
+#define flags_and(res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + HC_MASK + \
+		 x3chk(res)+ parity(res))
+#define flags_or(res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + \
+		 x3chk(res)+ parity(res))
+#define flags_inc(opr1, res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + hcaddchk(opr1,1,0) + \
+		 x3chk(res)+vchkadd(opr1,1,res) + \
+		 ADD_INSTR +  unaffect(CARRY_MASK))
+#define flags_dec(opr1, res) \
+	set_f(cpu, signchk(res) + zerochk(res) + \
+		 x5chk(res) + hcsubchk(opr1,1,0) + \
+		 x3chk(res)+ vchksub(opr1,1,res) + \
+		 SUB_INSTR +  unaffect(CARRY_MASK))
+#endif
+
 int add_a_num8(CPU_t*);
 int adc_a_num8(CPU_t*);
 int sub_a_num8(CPU_t*);
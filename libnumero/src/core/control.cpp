@@ -28,9 +28,9 @@ int ldd(CPU_t *cpu) {
 	cpu->bc--;
 	cpu->hl--;
 	cpu->de--;
-	cpu->f = dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
+	set_f(cpu, dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
 		 doparity(cpu->bc!=0) + 
-		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK);
+		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK));
 
 	return 16;
 }
@@ -38,22 +38,26 @@ int ldd(CPU_t *cpu) {
 int lddr(CPU_t *cpu) {
 	int tmp;
 	int reg;
+	int written;
 	
-	reg = CPU_mem_read(cpu,cpu->hl);
-	CPU_mem_write(cpu,cpu->de,reg);
-	tmp = cpu->a + reg;
-	cpu->bc--;
-	cpu->hl--;
-	cpu->de--;
-	cpu->f = dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
-		 doparity(cpu->bc!=0) + 
-		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK);
-	if (cpu->bc!=0) {
-		cpu->pc -=2;
-		return 21;
-	}
+	do {
+		reg = CPU_mem_read(cpu,cpu->hl);
+		written = cpu->de;
+		CPU_mem_write(cpu,cpu->de,reg);
+		tmp = cpu->a + reg;
+		cpu->bc--;
+		cpu->hl--;
+		cpu->de--;
+		set_f(cpu, dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
+			 doparity(cpu->bc!=0) + 
+			 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK));
+		if (cpu->bc==0) {
+			return 16;
+		}
+	} while (CPU_block_repeat(cpu, written));
 
-	return 16;
+	cpu->pc -=2;
+	return 21;
 }
 int ldi(CPU_t *cpu) {
 	int tmp;
@@ -65,31 +69,35 @@ int ldi(CPU_t *cpu) {
 	cpu->bc--;
 	cpu->hl++;
 	cpu->de++;
-	cpu->f = dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
+	set_f(cpu, dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
 		 doparity(cpu->bc!=0) + 
-		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK);
+		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK));
 	return 16;
 }
 
 int ldir(CPU_t *cpu) {
 	int tmp;
 	int reg;
+	int written;
 	
-	reg = CPU_mem_read(cpu,cpu->hl);
-	CPU_mem_write(cpu,cpu->de,reg);
-	tmp = cpu->a + reg;
-	cpu->bc--;
-	cpu->hl++;
-	cpu->de++;
-	cpu->f = dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
-		 doparity(cpu->bc!=0) + 
-		 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK);
-	if (cpu->bc!=0) {
-		cpu->pc -=2;
-		return 21;
-	}
+	do {
+		reg = CPU_mem_read(cpu,cpu->hl);
+		written = cpu->de;
+		CPU_mem_write(cpu,cpu->de,reg);
+		tmp = cpu->a + reg;
+		cpu->bc--;
+		cpu->hl++;
+		cpu->de++;
+		set_f(cpu, dox5((tmp&2)!=0) + dox3((tmp&8)!=0) + 
+			 doparity(cpu->bc!=0) + 
+			 unaffect(SIGN_MASK + ZERO_MASK + CARRY_MASK));
+		if (cpu->bc==0) {
+			return 16;
+		}
+	} while (CPU_block_repeat(cpu, written));
 
-	return 16;
+	cpu->pc -=2;
+	return 21;
 }
 
 int ld_mem16_reg16(CPU_t *cpu) {
@@ -183,9 +191,9 @@ int in_reg_c(CPU_t *cpu) {
 			cpu->a=cpu->bus;
 			break;
 	}
-	cpu->f = signchk(cpu->bus) + zerochk(cpu->bus) +
+	set_f(cpu, signchk(cpu->bus) + zerochk(cpu->bus) +
 		 x5chk(cpu->bus) + x3chk(cpu->bus) + 
-		 parity(cpu->bus) + unaffect(CARRY_MASK);
+		 parity(cpu->bus) + unaffect(CARRY_MASK));
 	return 12;
 }
 
@@ -198,11 +206,11 @@ int ind(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl--;
 	tmp = result+ ((cpu->c-1) & 255);
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&7)^cpu->b) + 
 		 (((result&128)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	return 16;
 }
 
@@ -214,11 +222,11 @@ int indr(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl--;
 	tmp = result+ ((cpu->c-1) & 255);
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&7)^cpu->b) + 
 		 (((result&128)!=0)? N_MASK:0) +
-		 carry( tmp>255 );
+		 carry( tmp>255 ));
 	if (cpu->b!=0) {
 		cpu->pc -=2;
 		return 21;
@@ -235,11 +243,11 @@ int ini(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl++;
 	tmp = result+ ((cpu->c+1) & 255);
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&7)^cpu->b) + 
 		 (((result&128)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	return 16;
 }
 
@@ -252,11 +260,11 @@ int inir(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl++;
 	tmp = result+ ((cpu->c+1) & 255);
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&7)^cpu->b) + 
 		 (((result&128)!=0)? N_MASK:0) +
-		 carry( tmp>255 );
+		 carry( tmp>255 ));
 	if (cpu->b!=0) {
 		cpu->pc -=2;
 		return 21;
@@ -275,16 +283,16 @@ int ld_r_a(CPU_t *cpu) {
 }
 int ld_a_i(CPU_t *cpu) {
 	cpu->a = cpu->i;
-	cpu->f = signchk(cpu->a) + zerochk(cpu->a) +
+	set_f(cpu, signchk(cpu->a) + zerochk(cpu->a) +
 		 x5chk(cpu->a) + x3chk(cpu->a) + 
-		 doparity(cpu->iff2!=0) + unaffect(CARRY_MASK);
+		 doparity(cpu->iff2!=0) + unaffect(CARRY_MASK));
 	return 9;
 }
 int ld_a_r(CPU_t *cpu) {
 	cpu->a = cpu->r;
-	cpu->f = signchk(cpu->a) + zerochk(cpu->a) +
+	set_f(cpu, signchk(cpu->a) + zerochk(cpu->a) +
 		 x5chk(cpu->a) + x3chk(cpu->a) + 
-		 doparity(cpu->iff2!=0) + unaffect(CARRY_MASK);
+		 doparity(cpu->iff2!=0) + unaffect(CARRY_MASK));
 	return 9;
 }
 
@@ -331,11 +339,11 @@ int outd(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl--;
 	tmp = result+ cpu->l;
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&0x07)^cpu->b) + 
 		 (((result&0x80)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	return 16;
 }
 
@@ -346,12 +354,15 @@ int otdr(CPU_t *cpu) {
 	device_output(cpu, cpu->c);
 	cpu->b--;
 	cpu->hl--;
+	if (cpu->b != 0 && CPU_block_output(cpu, -1)) {
+		result = cpu->bus;
+	}
 	tmp = result+ cpu->l;
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&0x07)^cpu->b) + 
 		 (((result&0x80)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	if (cpu->b!=0) {
 		cpu->pc -=2;
 		return 21;
@@ -367,11 +378,11 @@ int outi(CPU_t *cpu) {
 	cpu->b--;
 	cpu->hl++;
 	tmp = result+ cpu->l;
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&0x07)^cpu->b) + 
 		 (((result&0x80)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	return 16;
 }
 
@@ -382,12 +393,15 @@ int otir(CPU_t *cpu) {
 	device_output(cpu, cpu->c);
 	cpu->b--;
 	cpu->hl++;
+	if (cpu->b != 0 && CPU_block_output(cpu, 1)) {
+		result = cpu->bus;
+	}
 	tmp = result+ cpu->l;
-	cpu->f = signchk(cpu->b) + zerochk(cpu->b) +
+	set_f(cpu, signchk(cpu->b) + zerochk(cpu->b) +
 		 x5chk(cpu->b) + dohc( tmp>255 ) + 
 		 x3chk(cpu->b) +  parity((tmp&0x07)^cpu->b) + 
 		 (((result&0x80)!=0)? N_MASK:0) +
-		 carry( tmp>255 ); 
+		 carry( tmp>255 )); 
 	if (cpu->b!=0) {
 		cpu->pc -=2;
 		return 21;
@@ -416,16 +430,16 @@ int retn(CPU_t *cpu) {
 //-----------------
 // SCF
 int scf(CPU_t *cpu) {
-	cpu->f = unaffect( SIGN_MASK+ZERO_MASK+PV_MASK) +
-		 x5chk(cpu->a) + x3chk(cpu->a) + CARRY_MASK;
+	set_f(cpu, unaffect( SIGN_MASK+ZERO_MASK+PV_MASK) +
+		 x5chk(cpu->a) + x3chk(cpu->a) + CARRY_MASK);
 	return 4;
 }
 //-----------------
 // CCF
 int ccf(CPU_t *cpu) {
-	cpu->f = unaffect( SIGN_MASK+ZERO_MASK+PV_MASK) +
-		 x5chk(cpu->a|cpu->f) + dohc( (cpu->f&CARRY_MASK)!=0 ) + 
-		 x3chk(cpu->a|cpu->f) + ((cpu->f&CARRY_MASK)^CARRY_MASK);
+	set_f(cpu, unaffect( SIGN_MASK+ZERO_MASK+PV_MASK) +
+		 x5chk(cpu->a|get_f(cpu)) + dohc( (get_f(cpu)&CARRY_MASK)!=0 ) + 
+		 x3chk(cpu->a|get_f(cpu)) + ((get_f(cpu)&CARRY_MASK)^CARRY_MASK));
 	return 4;
 }
 int rst(CPU_t *cpu) {
@@ -457,21 +471,21 @@ int ret(CPU_t *cpu) {
 int ret_condition(CPU_t *cpu) {
 	int succeed = FALSE;
 	switch ((cpu->bus >> 3) & 0x07) {
-		case 0:	if (!(cpu->f & ZERO_MASK)) succeed = TRUE;
+		case 0:	if (!(get_f(cpu) & ZERO_MASK)) succeed = TRUE;
 				break;
-		case 1:	if ((cpu->f & ZERO_MASK)) succeed = TRUE;
+		case 1:	if ((get_f(cpu) & ZERO_MASK)) succeed = TRUE;
 				break;
-		case 2:	if (!(cpu->f & CARRY_MASK)) succeed = TRUE;
+		case 2:	if (!(get_f(cpu) & CARRY_MASK)) succeed = TRUE;
 				break;
-		case 3:	if ((cpu->f & CARRY_MASK)) succeed = TRUE;
+		case 3:	if ((get_f(cpu) & CARRY_MASK)) succeed = TRUE;
 				break;
-		case 4:	if (!(cpu->f & PV_MASK)) succeed = TRUE;
+		case 4:	if (!(get_f(cpu) & PV_MASK)) succeed = TRUE;
 				break;
-		case 5:	if ((cpu->f & PV_MASK)) succeed = TRUE;
+		case 5:	if ((get_f(cpu) & PV_MASK)) succeed = TRUE;
 				break;
-		case 6:	if (!(cpu->f & SIGN_MASK)) succeed = TRUE;
+		case 6:	if (!(get_f(cpu) & SIGN_MASK)) succeed = TRUE;
 				break;
-		case 7:	if ((cpu->f & SIGN_MASK)) succeed = TRUE;
+		case 7:	if ((get_f(cpu) & SIGN_MASK)) succeed = TRUE;
 				break;
 	}
 	if (succeed == TRUE) {
@@ -499,21 +513,21 @@ int call_condition(CPU_t *cpu) {
 	address |= CPU_mem_read(cpu, cpu->pc++) << 8;
 	
 	switch (condition) {
-		case 0:	if (!(cpu->f & ZERO_MASK)) succeed = TRUE;
+		case 0:	if (!(get_f(cpu) & ZERO_MASK)) succeed = TRUE;
 				break;
-		case 1:	if ((cpu->f & ZERO_MASK)) succeed = TRUE;
+		case 1:	if ((get_f(cpu) & ZERO_MASK)) succeed = TRUE;
 				break;
-		case 2:	if (!(cpu->f & CARRY_MASK)) succeed = TRUE;
+		case 2:	if (!(get_f(cpu) & CARRY_MASK)) succeed = TRUE;
 				break;
-		case 3:	if ((cpu->f & CARRY_MASK)) succeed = TRUE;
+		case 3:	if ((get_f(cpu) & CARRY_MASK)) succeed = TRUE;
 				break;
-		case 4:	if (!(cpu->f & PV_MASK)) succeed = TRUE;
+		case 4:	if (!(get_f(cpu) & PV_MASK)) succeed = TRUE;
 				break;
-		case 5:	if ((cpu->f & PV_MASK)) succeed = TRUE;
+		case 5:	if ((get_f(cpu) & PV_MASK)) succeed = TRUE;
 				break;
-		case 6:	if (!(cpu->f & SIGN_MASK)) succeed = TRUE;
+		case 6:	if (!(get_f(cpu) & SIGN_MASK)) succeed = TRUE;
 				break;
-		case 7:	if ((cpu->f & SIGN_MASK)) succeed = TRUE;
+		case 7:	if ((get_f(cpu) & SIGN_MASK)) succeed = TRUE;
 				break;
 	}
 
@@ -539,9 +553,9 @@ int push_reg16(CPU_t *cpu) {
 			reg = cpu->de;
 			break;
 		case 2:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = cpu->hl;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				reg = cpu->ix;
 				time +=4;
 			} else {
@@ -550,7 +564,7 @@ int push_reg16(CPU_t *cpu) {
 			}
 			break;
 		case 3:
-			reg = cpu->af;
+			reg = (cpu->a << 8) + get_f(cpu);
 			break;
 	}
 	CPU_mem_write(cpu, --cpu->sp, reg >> 8);
@@ -574,9 +588,9 @@ int pop_reg16(CPU_t *cpu) {
 			cpu->de = reg;
 			break;
 		case 2:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				cpu->hl = reg;
-			} else if (cpu->prefix == 0xDD) {
+			} else if (INDEX_PREFIX == 0xDD) {
 				cpu->ix = reg;
 				time +=4;
 			} else {
@@ -585,17 +599,18 @@ int pop_reg16(CPU_t *cpu) {
 			}
 			break;
 		case 3:
-			cpu->af = reg;
+			cpu->a = reg >> 8;
+			set_f(cpu, reg & 0xFF);
 			break;
 	}
 	return time;
 }
 
 int ld_sp_hl(CPU_t *cpu) {
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		cpu->sp = cpu->hl;
 		return 6;
-	} else if (cpu->prefix == 0xDD) {
+	} else if (INDEX_PREFIX == 0xDD) {
 		cpu->sp = cpu->ix;
 		return 10;
 	} else {
@@ -607,11 +622,11 @@ int ld_mem16_hlf(CPU_t *cpu) {
 	unsigned short reg = CPU_mem_read(cpu, cpu->pc++);
 	reg |= CPU_mem_read(cpu, cpu->pc++) << 8;
 
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		CPU_mem_write(cpu, reg++, cpu->l);
 		CPU_mem_write(cpu, reg, cpu->h);
 		return 16;
-	} else if (cpu->prefix == 0xDD) {
+	} else if (INDEX_PREFIX == 0xDD) {
 		CPU_mem_write(cpu, reg++, cpu->ixl);
 		CPU_mem_write(cpu, reg, cpu->ixh);
 		return 20;
@@ -627,10 +642,10 @@ int ld_hlf_mem16(CPU_t *cpu) {
 	mem |= CPU_mem_read(cpu, cpu->pc++) << 8;
 	unsigned short reg = CPU_mem_read(cpu, mem);
 	reg |= CPU_mem_read(cpu, mem + 1) << 8;
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		cpu->hl = reg;
 		return 16;
-	} else if (cpu->prefix == 0xDD) {
+	} else if (INDEX_PREFIX == 0xDD) {
 		cpu->ix = reg;
 		return 20;
 	} else {
@@ -643,10 +658,10 @@ int ld_hl_num16(CPU_t *cpu) {
 	unsigned short reg = CPU_mem_read(cpu, cpu->pc++);
 	reg |= CPU_mem_read(cpu, cpu->pc++) << 8;
 
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		cpu->hl = reg;
 		return 10;
-	} else if (cpu->prefix == 0xDD) {
+	} else if (INDEX_PREFIX == 0xDD) {
 		cpu->ix = reg;
 		return 14;
 	} else {
@@ -732,13 +747,13 @@ int ld_r_num8(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				CPU_mem_write(cpu,cpu->hl,reg);
 				time += 3;
 			} else {
 				char offset = reg;
 				reg = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					CPU_mem_write(cpu, cpu->ix + offset, reg);
 				} else {
 					CPU_mem_write(cpu, cpu->iy + offset, reg);
@@ -775,7 +790,7 @@ int ld_r_r(CPU_t *cpu) {
 			reg=cpu->e;
 			break;
 		case 0x04:
-			if (cpu->prefix && test == 6) {
+			if (INDEX_PREFIX && test == 6) {
 				reg = cpu->h;
 			} else {
 				index_ext (
@@ -786,7 +801,7 @@ int ld_r_r(CPU_t *cpu) {
 			}
 			break;
 		case 0x05:
-			if (cpu->prefix && test == 6) {
+			if (INDEX_PREFIX && test == 6) {
 				reg = cpu->l;
 				break;
 			}
@@ -797,12 +812,12 @@ int ld_r_r(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				reg = CPU_mem_read(cpu,cpu->hl);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					reg = CPU_mem_read(cpu, cpu->ix + offset);
 				} else {
 					reg = CPU_mem_read(cpu, cpu->iy + offset);
@@ -830,7 +845,7 @@ int ld_r_r(CPU_t *cpu) {
 			cpu->e=reg;
 			break;
 		case 0x04:
-			if (cpu->prefix && test2 == 6) {
+			if (INDEX_PREFIX && test2 == 6) {
 				cpu->h = reg;
 				break;
 			}
@@ -841,7 +856,7 @@ int ld_r_r(CPU_t *cpu) {
 			)
 			break;
 		case 0x05:
-			if (cpu->prefix && test2 == 6) {
+			if (INDEX_PREFIX && test2 == 6) {
 				cpu->l = reg;
 				break;
 			}
@@ -852,12 +867,12 @@ int ld_r_r(CPU_t *cpu) {
 			)
 			break;
 		case 0x06:
-			if (!cpu->prefix) {
+			if (!INDEX_PREFIX) {
 				CPU_mem_write(cpu,cpu->hl,reg);
 				time += 3;
 			} else {
 				char offset = CPU_mem_read(cpu, cpu->pc++);
-				if (cpu->prefix == 0xDD) {
+				if (INDEX_PREFIX == 0xDD) {
 					CPU_mem_write(cpu, cpu->ix + offset, reg);
 				} else {
 					CPU_mem_write(cpu, cpu->iy + offset, reg);
@@ -888,13 +903,13 @@ int ex_sp_hl(CPU_t *cpu) {
 	unsigned short reg = CPU_mem_read(cpu, cpu->sp);
 	reg |= CPU_mem_read(cpu, cpu->sp + 1) << 8;
 	
-	if (!cpu->prefix) {
+	if (!INDEX_PREFIX) {
 		CPU_mem_write(cpu,cpu->sp + 1, cpu->h);
 		CPU_mem_write(cpu,cpu->sp, cpu->l);
 		cpu->hl = reg;
 		return 19;
 	} else {
-		if (cpu->prefix == 0xDD) {
+		if (INDEX_PREFIX == 0xDD) {
 			CPU_mem_write(cpu,cpu->sp + 1, cpu->ixh);
 			CPU_mem_write(cpu,cpu->sp, cpu->ixl);
 			cpu->ix = reg;
@@ -935,6 +950,7 @@ int exx(CPU_t *cpu) {
 
 int ex_af_afp(CPU_t *cpu) {
 	unsigned short reg;
+	set_f(cpu, get_f(cpu));
 	swappair(cpu->af,cpu->afp);
 	return 4;
 }	
@@ -975,28 +991,28 @@ int jp_condition(CPU_t *cpu) {
 
 	switch (condition) {
 		case 0:
-			if ((ZERO_MASK&cpu->f)==0) cpu->pc = address;
+			if ((ZERO_MASK&get_f(cpu))==0) cpu->pc = address;
 			break;
 		case 1:
-			if ((ZERO_MASK&cpu->f)!=0) cpu->pc = address;
+			if ((ZERO_MASK&get_f(cpu))!=0) cpu->pc = address;
 			break;
 		case 2:
-			if ((CARRY_MASK&cpu->f)==0) cpu->pc = address;
+			if ((CARRY_MASK&get_f(cpu))==0) cpu->pc = address;
 			break;
 		case 3:
-			if ((CARRY_MASK&cpu->f)!=0) cpu->pc = address;
+			if ((CARRY_MASK&get_f(cpu))!=0) cpu->pc = address;
 			break;
 		case 4:
-			if ((PV_MASK&cpu->f)==0) cpu->pc = address;
+			if ((PV_MASK&get_f(cpu))==0) cpu->pc = address;
 			break;
 		case 5:
-			if ((PV_MASK&cpu->f)!=0) cpu->pc = address;
+			if ((PV_MASK&get_f(cpu))!=0) cpu->pc = address;
 			break;
 		case 6:
-			if ((SIGN_MASK&cpu->f)==0) cpu->pc = address;
+			if ((SIGN_MASK&get_f(cpu))==0) cpu->pc = address;
 			break;
 		case 7:
-			if ((SIGN_MASK&cpu->f)!=0) cpu->pc = address;
+			if ((SIGN_MASK&get_f(cpu))!=0) cpu->pc = address;
 			break;
 	}
 
@@ -1009,25 +1025,25 @@ int jr_condition(CPU_t *cpu) {
 	int time = 7;
 	switch (condition) {
 		case 0:
-			if ((ZERO_MASK&cpu->f)==0) {
+			if ((ZERO_MASK&get_f(cpu))==0) {
 				cpu->pc = addschar(cpu->pc,reg);
 				time += 5;
 			}
 			break;
 		case 1:
-			if ((ZERO_MASK&cpu->f)!=0) {
+			if ((ZERO_MASK&get_f(cpu))!=0) {
 				cpu->pc = addschar(cpu->pc,reg);
 				time += 5;
 			}
 			break;
 		case 2:
-			if ((CARRY_MASK&cpu->f)==0) {
+			if ((CARRY_MASK&get_f(cpu))==0) {
 				cpu->pc = addschar(cpu->pc,reg);
 				time += 5;
 			}
 			break;
 		case 3:
-			if ((CARRY_MASK&cpu->f)!=0) {
+			if ((CARRY_MASK&get_f(cpu))!=0) {
 				cpu->pc = addschar(cpu->pc,reg);
 				time += 5;
 			}
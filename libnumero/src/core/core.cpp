@@ -5,7 +5,15 @@
 #include "alu.h"
 #include "indexcb.h"
 #include "control.h"
+#ifndef WITH_REVERSE
+// only the CB and ED entries run the generic tables, the rest goes to hl::opcode
+#define OPTABLE_NO_OPCODE
+#endif
 #include "optable.h"
+#include "jit.h"
+#ifndef WITH_REVERSE
+#include "optable_index.h"
+#endif
 #ifdef WITH_REVERSE
 #include "alu_reverse.h"
 #include "indexcb_reverse.h"
@@ -23,6 +31,10 @@
 #define FLASH_BYTE_FASTMODE_PROG 0xA0
 
 unsigned char mem_read(memc *mem, unsigned short addr) {
+	const unsigned char *page = mem->page_table[mc_bank(addr)];
+	if (page != NULL) {
+		return page[mc_base(addr)];
+	}
 	if ((mem->port27_remap_count > 0) && !mem->boot_mapped && (mc_bank(addr) == 3) && (addr >= (0x10000 - 64 * mem->port27_remap_count)) && addr >= 0xFB64) {
 		return mem->ram[0 * PAGE_SIZE + mc_base(addr)];
 	}
@@ -59,10 +71,64 @@ uint8_t wmem_write(memc *mem, waddr_t waddr, uint8_t data) {
 	if (waddr.is_ram) {
 		return mem->ram[waddr.page * PAGE_SIZE + waddr.addr] = data;
 	} else {
+		set_flash_dirty(mem, waddr.page * PAGE_SIZE + waddr.addr, 1);
 		return mem->flash[waddr.page * PAGE_SIZE + waddr.addr] = data;
 	}
 }
 
+/*
+ * Keeps a copy of the current flash as the base that delta saves are
+ * taken against, identified by a hash of its contents
+ */
+void set_flash_base(memc *mem) {
+	free(mem->flash_base);
+	free(mem->flash_dirty);
+	mem->flash_base = (unsigned char *) malloc(mem->flash_size);
+	mem->flash_dirty = (unsigned char *) calloc(mem->flash_pages, 1);
+	if (mem->flash_base == NULL || mem->flash_dirty == NULL) {
+		free(mem->flash_base);
+		free(mem->flash_dirty);
+		mem->flash_base = NULL;
+		mem->flash_dirty = NULL;
+		return;
+	}
+
+	memcpy(mem->flash_base, mem->flash, mem->flash_size);
+	set_flash_changed(mem, 0, mem->flash_size);
+	// FNV-1a
+	uint64_t hash = 14695981039346656037ULL;
+	for (int i = 0; i < mem->flash_size; i++) {
+		hash = (hash ^ mem->flash[i]) * 1099511628211ULL;
+	}
+	mem->flash_base_hash = hash;
+}
+
+/* Drops the translated code of the flash pages covering [addr, addr + length) */
+void set_flash_changed(memc *mem, int addr, int length) {
+	if (length <= 0) {
+		return;
+	}
+
+	int last_page = (addr + length - 1) / PAGE_SIZE;
+	for (int page = addr / PAGE_SIZE; page <= last_page && page < mem->flash_pages &&
+		page < (int) ARRAYSIZE(mem->flash_page_gen); page++) {
+		mem->flash_page_gen[page]++;
+	}
+}
+
+/* Marks the flash pages covering [addr, addr + length) as written */
+void set_flash_dirty(memc *mem, int addr, int length) {
+	set_flash_changed(mem, addr, length);
+	if (mem->flash_dirty == NULL || length <= 0) {
+		return;
+	}
+
+	int last_page = (addr + length - 1) / PAGE_SIZE;
+	for (int page = addr / PAGE_SIZE; page <= last_page && page < mem->flash_pages; page++) {
+		mem->flash_dirty[page] = TRUE;
+	}
+}
+
 /*
  * Convert a Z80 address to a waddr
  */
@@ -91,8 +157,115 @@ waddr_t addr32_to_waddr(unsigned int addr, BOOL is_ram) {
 }
 
 
+#define MIN_BREAK_TABLE 64
+
+static inline uint32_t break_key(waddr_t waddr) {
+	return ((uint32_t) (waddr.is_ram & 1) << 22) | ((uint32_t) waddr.page << 14) | mc_base(waddr.addr);
+}
+
+static inline int break_slot(uint32_t key, int size) {
+	return (int) ((key * 2654435761u) >> 12) & (size - 1);
+}
+
+static break_entry_t *find_break(const memc *mem, waddr_t waddr) {
+	const uint32_t key = break_key(waddr);
+	const int mask = mem->break_table_size - 1;
+	for (int i = break_slot(key, mem->break_table_size); ; i = (i + 1) & mask) {
+		if (mem->break_table[i].key == key)
+			return &mem->break_table[i];
+		if (mem->break_table[i].key == BREAK_EMPTY)
+			return NULL;
+	}
+}
+
+static BOOL grow_breaks(memc *mem) {
+	const int size = mem->break_table_size ? mem->break_table_size * 2 : MIN_BREAK_TABLE;
+	break_entry_t *table = (break_entry_t *) malloc(size * sizeof(break_entry_t));
+	if (table == NULL)
+		return FALSE;
+	for (int i = 0; i < size; i++)
+		table[i].key = BREAK_EMPTY;
+	for (int i = 0; i < mem->break_table_size; i++) {
+		const uint32_t key = mem->break_table[i].key;
+		if (key == BREAK_EMPTY)
+			continue;
+		int j = break_slot(key, size);
+		while (table[j].key != BREAK_EMPTY)
+			j = (j + 1) & (size - 1);
+		table[j] = mem->break_table[i];
+	}
+	free(mem->break_table);
+	mem->break_table = table;
+	mem->break_table_size = size;
+	return TRUE;
+}
+
+static void add_break_type(memc *mem, waddr_t waddr, BREAK_TYPE type) {
+	break_entry_t *entry = mem->break_table_size ? find_break(mem, waddr) : NULL;
+	if (entry != NULL) {
+		entry->type |= type;
+		return;
+	}
+	if ((mem->break_count + 1) * 4 > mem->break_table_size * 3 && !grow_breaks(mem))
+		return;
+	const uint32_t key = break_key(waddr);
+	int i = break_slot(key, mem->break_table_size);
+	while (mem->break_table[i].key != BREAK_EMPTY)
+		i = (i + 1) & (mem->break_table_size - 1);
+	mem->break_table[i].key = key;
+	mem->break_table[i].type = (unsigned char) type;
+	mem->break_count++;
+	mem->break_page_count[waddr.is_ram & 1][waddr.page]++;
+}
+
+static void remove_break_type(memc *mem, waddr_t waddr, BREAK_TYPE type) {
+	if (mem->break_page_count[waddr.is_ram & 1][waddr.page] == 0)
+		return;
+	break_entry_t *entry = find_break(mem, waddr);
+	if (entry == NULL)
+		return;
+	entry->type &= ~type;
+	if (entry->type)
+		return;
+
+	// backward shift delete, so lookups never need tombstones
+	const int mask = mem->break_table_size - 1;
+	int i = (int) (entry - mem->break_table);
+	for (int j = (i + 1) & mask; mem->break_table[j].key != BREAK_EMPTY; j = (j + 1) & mask) {
+		const int home = break_slot(mem->break_table[j].key, mem->break_table_size);
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			mem->break_table[i] = mem->break_table[j];
+			i = j;
+		}
+	}
+	mem->break_table[i].key = BREAK_EMPTY;
+	mem->break_count--;
+	mem->break_page_count[waddr.is_ram & 1][waddr.page]--;
+}
+
+void free_breaks(memc *mem) {
+	free(mem->break_table);
+	mem->break_table = NULL;
+	mem->break_table_size = 0;
+	mem->break_count = 0;
+	memset(mem->break_page_count, 0, sizeof(mem->break_page_count));
+}
+
+/* Whether the page mapped at addr carries any breakpoint */
+static inline BOOL bank_has_breaks(const memc *mem, uint16_t addr) {
+	const bank_t *bank = &mem->banks[mc_bank(addr)];
+	return mem->break_page_count[bank->ram & 1][bank->page & 0xFF] != 0;
+}
+
+static inline BOOL has_break(const memc *mem, waddr_t waddr, BREAK_TYPE type) {
+	if (mem->break_page_count[waddr.is_ram & 1][waddr.page] == 0)
+		return FALSE;
+	const break_entry_t *entry = find_break(mem, waddr);
+	return entry != NULL && (entry->type & type);
+}
+
 BOOL check_break(memc *mem, waddr_t waddr) {
-	if (!(mem->breaks[waddr.is_ram][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] & NORMAL_BREAK))
+	if (!has_break(mem, waddr, NORMAL_BREAK))
 		return FALSE;
 	if (mem->breakpoint_manager_callback) {
 		return mem->breakpoint_manager_callback(mem, NORMAL_BREAK, waddr);
@@ -100,7 +273,7 @@ BOOL check_break(memc *mem, waddr_t waddr) {
 	return TRUE;
 }
 BOOL check_mem_write_break(memc *mem, waddr_t waddr) {
-	if (!(mem->breaks[waddr.is_ram][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] & MEM_WRITE_BREAK))
+	if (!has_break(mem, waddr, MEM_WRITE_BREAK))
 		return FALSE;
 	if (mem->breakpoint_manager_callback) {
 		return mem->breakpoint_manager_callback(mem, MEM_WRITE_BREAK, waddr);
@@ -108,7 +281,7 @@ BOOL check_mem_write_break(memc *mem, waddr_t waddr) {
 	return TRUE;
 }
 BOOL check_mem_read_break(memc *mem, waddr_t waddr) {
-	if (!(mem->breaks[waddr.is_ram][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] & MEM_READ_BREAK))
+	if (!has_break(mem, waddr, MEM_READ_BREAK))
 		return FALSE;
 	if (mem->breakpoint_manager_callback) {
 		return mem->breakpoint_manager_callback(mem, MEM_READ_BREAK, waddr);
@@ -120,32 +293,36 @@ extern void add_breakpoint(memc *mem, BREAK_TYPE type, waddr_t waddr);
 extern void rem_breakpoint(memc *mem, BREAK_TYPE type, waddr_t waddr);
 
 void set_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] |= NORMAL_BREAK;
+	add_break_type(mem, waddr, NORMAL_BREAK);
 	//add_breakpoint(mem, NORMAL_BREAK, waddr);
 }
 void set_mem_write_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] |= MEM_WRITE_BREAK;
+	add_break_type(mem, waddr, MEM_WRITE_BREAK);
 	//add_breakpoint(mem, MEM_WRITE_BREAK, waddr);
 }
 void set_mem_read_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] |= MEM_READ_BREAK;
+	add_break_type(mem, waddr, MEM_READ_BREAK);
 	//add_breakpoint(mem, MEM_READ_BREAK, waddr);
 }
 
 void clear_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] &= CLEAR_NORMAL_BREAK;
+	remove_break_type(mem, waddr, NORMAL_BREAK);
 	//rem_breakpoint(mem, NORMAL_BREAK, waddr);
 }
 void clear_mem_write_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] &= CLEAR_MEM_WRITE_BREAK;
+	remove_break_type(mem, waddr, MEM_WRITE_BREAK);
 	//rem_breakpoint(mem, MEM_WRITE_BREAK, waddr);
 }
 void clear_mem_read_break(memc *mem, waddr_t waddr) {
-	mem->breaks[waddr.is_ram % 2][PAGE_SIZE * waddr.page + mc_base(waddr.addr)] &= CLEAR_MEM_READ_BREAK;
+	remove_break_type(mem, waddr, MEM_READ_BREAK);
 	//rem_breakpoint(mem, MEM_READ_BREAK, waddr);
 }
 
 unsigned char mem_write(memc *mem, unsigned short addr, char data) {
+	unsigned char *page = mem->page_table[mc_bank(addr)];
+	if (page != NULL) {
+		return page[mc_base(addr)] = data;
+	}
 	if ((mem->port27_remap_count > 0) && !mem->boot_mapped && (mc_bank(addr) == 3) && (addr >= (0x10000 - 64 * mem->port27_remap_count)) && addr >= 0xFB64) {
 		return mem->ram[0 * PAGE_SIZE + mc_base(addr)] = data;
 	}
@@ -172,11 +349,21 @@ unsigned short mem_read16(memc *mem, unsigned short addr) {
 /* Initialize a timer context */
 int tc_init(timerc *tc, int timer_freq) {
 	tc->tstates = 0;
-	tc->elapsed = 0;
+	tc->clock_base = 0;
+	tc->tstates_base = 0;
 	tc->freq = timer_freq;
+	tc->clock_scale = (uint32_t) (TIMER_CLOCK_RATE / timer_freq);
 	return 0;
 }
 
+/* Change the cpu speed without moving the hardware clock */
+void tc_set_freq(timerc *tc, uint32_t timer_freq) {
+	tc->clock_base = tc_clock(tc);
+	tc->tstates_base = tc->tstates;
+	tc->freq = timer_freq;
+	tc->clock_scale = (uint32_t) (TIMER_CLOCK_RATE / timer_freq);
+}
+
 int CPU_init(CPU_t *cpu, memc *mem_c, timerc *timer_c) {
 	memset(cpu, 0, sizeof(CPU_t));
 	cpu->mem_c = mem_c;
@@ -280,6 +467,7 @@ int CPU_reset(CPU_t *cpu) {
 		break;
 	}
 	}
+	update_page_table(cpu->mem_c);
 	return 0;
 }
 
@@ -299,8 +487,8 @@ BOOL is_priveleged_page(CPU_t *cpu) {
 	return ((page >= maxPages - 4 && page != maxPages - 2) || (((cpu->pio.model >= TI_84P) && page == maxPages - 0x11)));
 }
 
-static BOOL is_allowed_exec(CPU_t *cpu) {
-	bank_state_t  *bank = &cpu->mem_c->banks[mc_bank(cpu->pc)];
+static BOOL is_allowed_exec(CPU_t *cpu, unsigned short pc) {
+	bank_state_t  *bank = &cpu->mem_c->banks[mc_bank(pc)];
 	if (cpu->pio.model <= TI_83P) {
 		int protected_val;
 		if (bank->ram) {
@@ -329,17 +517,54 @@ static BOOL is_allowed_exec(CPU_t *cpu) {
 			return TRUE;		//we know were in ram so lets check if the page is allowed in the mem protected mode
 		//execution is allowed on 2^(mode+1)
 		//finally we check ports 25/26 to see if its ok to execute on this page
-		int global_addr = bank->page * PAGE_SIZE + (cpu->pc & 0x3FFF);
-		if ((mem->port27_remap_count > 0) && !mem->boot_mapped && (mc_bank(cpu->pc) == 3) && (cpu->pc >= (0x10000 - 64 * mem->port27_remap_count)) && cpu->pc >= 0xFB64)
-			global_addr = 0 * PAGE_SIZE + mc_base(cpu->pc);
-		else if ((mem->port28_remap_count > 0) && !mem->boot_mapped && (mc_bank(cpu->pc) == 2) && (mc_base(cpu->pc) < 64 * mem->port28_remap_count))
-			global_addr = 1 * PAGE_SIZE + mc_base(cpu->pc);
+		int global_addr = bank->page * PAGE_SIZE + (pc & 0x3FFF);
+		if ((mem->port27_remap_count > 0) && !mem->boot_mapped && (mc_bank(pc) == 3) && (pc >= (0x10000 - 64 * mem->port27_remap_count)) && pc >= 0xFB64)
+			global_addr = 0 * PAGE_SIZE + mc_base(pc);
+		else if ((mem->port28_remap_count > 0) && !mem->boot_mapped && (mc_bank(pc) == 2) && (mc_base(pc) < 64 * mem->port28_remap_count))
+			global_addr = 1 * PAGE_SIZE + mc_base(pc);
 		if (global_addr < cpu->mem_c->ram_lower || global_addr > cpu->mem_c->ram_upper)
 			return FALSE;
 		return TRUE;
 	}
 }
 
+#define EXEC_ALLOWED		1
+#define EXEC_DENIED			2
+#define EXEC_PER_ADDRESS	3
+
+static int bank_exec_verdict(CPU_t *cpu, int bank_num) {
+	memc *mem = cpu->mem_c;
+	bank_state_t *bank = &mem->banks[bank_num];
+	if (cpu->pio.model > TI_83P && bank->ram && !(bank->page & (2 >> (mem->prot_mode + 1)))) {
+		// only the ram limits depend on where in the page pc is
+		int lower = bank->page * PAGE_SIZE;
+		int upper = lower + PAGE_SIZE - 1;
+		if (mem->page_table[bank_num] == NULL) {
+			return EXEC_PER_ADDRESS;
+		}
+		if (lower >= mem->ram_lower && upper <= mem->ram_upper) {
+			return EXEC_ALLOWED;
+		}
+		if (upper < mem->ram_lower || lower > mem->ram_upper) {
+			return EXEC_DENIED;
+		}
+		return EXEC_PER_ADDRESS;
+	}
+	return is_allowed_exec(cpu, (unsigned short) (bank_num << 14)) ? EXEC_ALLOWED : EXEC_DENIED;
+}
+
+static inline BOOL cached_allowed_exec(CPU_t *cpu, unsigned short pc) {
+	memc *mem = cpu->mem_c;
+	int bank_num = mc_bank(pc);
+	if (mem->exec_cache[bank_num] == 0) {
+		mem->exec_cache[bank_num] = (unsigned char) bank_exec_verdict(cpu, bank_num);
+	}
+	if (mem->exec_cache[bank_num] == EXEC_PER_ADDRESS) {
+		return is_allowed_exec(cpu, pc);
+	}
+	return mem->exec_cache[bank_num] == EXEC_ALLOWED;
+}
+
 void change_page(memc *mem, int bank, unsigned char page, BOOL ram) {
 	mem->normal_banks[bank].ram = ram;
 	if (ram) {
@@ -355,6 +580,7 @@ void change_page(memc *mem, int bank, unsigned char page, BOOL ram) {
 		mem->normal_banks[bank].no_exec = FALSE;
 	}
 	update_bootmap_pages(mem);
+	update_page_table(mem);
 }
 
 void update_bootmap_pages(memc *mem_c) {
@@ -379,6 +605,25 @@ void update_bootmap_pages(memc *mem_c) {
 	mem_c->bootmap_banks[3].ram = mem_c->normal_banks[2].ram;
 }
 
+/*
+ * Rebuilds the page table mem_read and mem_write use to skip the remap and
+ * missing ram page checks, and drops the cached execute permissions. Anything
+ * that changes banks, boot_mapped, the port 27/28 remaps or the protection
+ * registers and limits has to call this.
+ */
+void update_page_table(memc *mem) {
+	for (int i = 0; i < 4; i++) {
+		bank_state_t *bank = &mem->banks[i];
+		BOOL special = mem->ram_version == 2 && bank->ram && bank->page > 2;
+		if (!mem->boot_mapped) {
+			special |= i == 3 && mem->port27_remap_count > 0;
+			special |= i == 2 && mem->port28_remap_count > 0;
+		}
+		mem->page_table[i] = special ? NULL : bank->addr;
+	}
+	memset(mem->exec_cache, 0, sizeof(mem->exec_cache));
+}
+
 static void endflash(memc *mem_c) {
 	if (mem_c->step != FLASH_ERROR) {
 		mem_c->step = FLASH_READ;
@@ -403,7 +648,7 @@ static int CPU_opcode_fetch(CPU_t *cpu) {
 		change_page(cpu->mem_c, 0, 0, FALSE);
 		cpu->mem_c->hasChangedPage0 = TRUE;
 	}
-	if (!is_allowed_exec(cpu)) {
+	if (!cached_allowed_exec(cpu, cpu->pc)) {
 		if (cpu->exe_violation_callback) {
 			cpu->exe_violation_callback(cpu);
 		} else {
@@ -499,6 +744,7 @@ static void flash_write_byte(memc *mem_c, unsigned short addr, unsigned char dat
 	int bankNum = mc_bank(addr);
 	bank_t bank = mem_c->banks[bankNum];
 	BYTE *write_location = bank.addr + mc_base(addr);
+	set_flash_dirty(mem_c, (int) (write_location - mem_c->flash), 1);
 	(*write_location) &= data;  //AND LOGIC!!
 	mem_c->flash_write_byte = data;
 	if ((*write_location) != data) {
@@ -590,6 +836,7 @@ static void flash_write(CPU_t *cpu, unsigned short addr, unsigned char data) {
 			// Erase entire chip...I'm not sure if 
 			// boot page is included, so I'll leave it off.
 			// DrDnar 7/8/11: boot sector is included
+			set_flash_dirty(cpu->mem_c, 0, cpu->mem_c->flash_size);
 			for (int i = 0; i < cpu->mem_c->flash_size; i++) {
 				cpu->mem_c->flash[i] = 0xFF;
 
@@ -630,6 +877,7 @@ static void flash_write(CPU_t *cpu, unsigned short addr, unsigned char data) {
 				break;
 			}
 
+			set_flash_dirty(mem_c, startaddr, endaddr - startaddr);
 			for (int i = startaddr; i < endaddr; i++) {
 				mem_c->flash[i] = 0xFF;
 
@@ -707,6 +955,160 @@ void CPU_mem_write(CPU_t *cpu, unsigned short addr, unsigned char data) {
 	cpu->bus = data;
 }
 
+#ifdef WITH_LAZY_FLAGS
+/*
+ * Builds F from the op recorded by the flags_ macros in alu.h. The half
+ * carry of an add or sub is bit 4 of opr1^opr2^result, so the carry in of
+ * adc and sbc does not have to be kept.
+ */
+unsigned char CPU_lazy_flags(CPU_t *cpu) {
+	int opr1 = cpu->lazy_opr1;
+	int opr2 = cpu->lazy_opr2;
+	int result = cpu->lazy_res;
+
+	switch (cpu->lazy_op) {
+		case LAZY_ADD:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) + ((opr1^opr2^result)&HC_MASK) +
+				 x3chk(result)+ vchkadd(opr1,opr2,result) +
+				 ADD_INSTR +  carrychk(result);
+			break;
+		case LAZY_SUB:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) + ((opr1^opr2^result)&HC_MASK) +
+				 x3chk(result)+ vchksub(opr1,opr2,result) +
+				 SUB_INSTR +  carrychk(result);
+			break;
+		case LAZY_CP:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(opr2) + ((opr1^opr2^result)&HC_MASK) +
+				 x3chk(opr2)+ vchksub(opr1,opr2,result) +
+				 SUB_INSTR +  carrychk(result);
+			break;
+		case LAZY_AND:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) + HC_MASK +
+				 x3chk(result)+ parity(result);
+			break;
+		case LAZY_OR:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) +
+				 x3chk(result)+ parity(result);
+			break;
+		case LAZY_INC:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) + hcaddchk(opr1,1,0) +
+				 x3chk(result)+vchkadd(opr1,1,result) +
+				 ADD_INSTR +  opr2;
+			break;
+		case LAZY_DEC:
+			cpu->f = signchk(result) + zerochk(result) +
+				 x5chk(result) + hcsubchk(opr1,1,0) +
+				 x3chk(result)+ vchksub(opr1,1,result) +
+				 SUB_INSTR +  opr2;
+			break;
+	}
+	cpu->lazy_op = LAZY_NONE;
+	return cpu->f;
+}
+#endif
+
+/*
+ * Called by LDIR, LDDR, CPIR and CPDR when they are about to repeat, with pc
+ * still past the opcode and written the address the iteration stored to, or
+ * -1. If nothing could happen before the instruction runs again (no
+ * breakpoints, device deadline, end of the run, flash command or rewrite of
+ * the opcode) this charges the repeat and the refetch of the opcode like
+ * CPU_step would and returns TRUE, and the handler does the next iteration
+ * itself.
+ */
+BOOL CPU_block_repeat(CPU_t *cpu, int written) {
+#ifdef WITH_REVERSE
+	return FALSE;
+#else
+	memc *mem = cpu->mem_c;
+	timerc *timer = cpu->timer_c;
+	unsigned short pc = cpu->pc - 2;
+	uint64_t end = cpu->pio.next_event < cpu->halt_end ? cpu->pio.next_event : cpu->halt_end;
+
+	if (timer->tstates + 21 >= end || mem->break_count != 0 || mem->step != FLASH_READ) {
+		return FALSE;
+	}
+	if (written >= 0 && (!mem->banks[mc_bank(written)].ram ||
+		written == pc || written == (unsigned short) (pc + 1))) {
+		return FALSE;
+	}
+	if (!cached_allowed_exec(cpu, pc) || !cached_allowed_exec(cpu, pc + 1)) {
+		return FALSE;
+	}
+
+	tc_add(timer, 21);
+	SEtc_add(timer, mem->banks[mc_bank(pc)].ram ? mem->read_OP_ram_tstates : mem->read_OP_flash_tstates);
+	pc++;
+	SEtc_add(timer, mem->banks[mc_bank(pc)].ram ? mem->read_OP_ram_tstates : mem->read_OP_flash_tstates);
+	cpu->r = (cpu->r & 0x80) + ((cpu->r + 2) & 0x7F);
+	return TRUE;
+#endif
+}
+
+/*
+ * Called by OTIR and OTDR when they are about to repeat, dir is the step of
+ * hl. If the port takes spans and CPU_block_repeat would let them run, the
+ * iterations that fit before the next deadline and stay in hl's bank are
+ * handed to the port in one call and charged like CPU_step would. Returns
+ * how many went out, b, hl and r are advanced past them.
+ */
+int CPU_block_output(CPU_t *cpu, int dir) {
+#ifdef WITH_REVERSE
+	return 0;
+#else
+	memc *mem = cpu->mem_c;
+	timerc *timer = cpu->timer_c;
+	unsigned short pc = cpu->pc - 2;
+	unsigned short hl = cpu->hl;
+	uint64_t end = cpu->pio.next_event < cpu->halt_end ? cpu->pio.next_event : cpu->halt_end;
+
+	if (cpu->pio.devices[cpu->c].span == NULL) {
+		return 0;
+	}
+	if (timer->tstates + 21 >= end || mem->break_count != 0 || mem->step != FLASH_READ || mem->flash_error) {
+		return 0;
+	}
+	if (!cached_allowed_exec(cpu, pc) || !cached_allowed_exec(cpu, pc + 1)) {
+		return 0;
+	}
+
+	// the refetch and the read of (hl) cost the same every iteration
+	int spacing = 21;
+	if (cpu->pio.model >= TI_83PSE) {
+		spacing += mem->banks[mc_bank(pc)].ram ? mem->read_OP_ram_tstates : mem->read_OP_flash_tstates;
+		pc++;
+		spacing += mem->banks[mc_bank(pc)].ram ? mem->read_OP_ram_tstates : mem->read_OP_flash_tstates;
+		spacing += mem->banks[mc_bank(hl)].ram ? mem->read_NOP_ram_tstates : mem->read_NOP_flash_tstates;
+	}
+
+	uint64_t fit = (end - timer->tstates - 22) / spacing + 1;
+	int len = dir > 0 ? PAGE_SIZE - mc_base(hl) : mc_base(hl) + 1;
+	if (len > cpu->b) {
+		len = cpu->b;
+	}
+	if (fit < (uint64_t) len) {
+		len = (int) fit;
+	}
+
+	unsigned char span[256];
+	for (int i = 0; i < len; i++) {
+		span[i] = mem_read(mem, (unsigned short) (hl + i * dir));
+	}
+
+	int written = device_output_span(cpu, cpu->c, span, len, spacing);
+	cpu->b -= written;
+	cpu->hl += written * dir;
+	cpu->r = (cpu->r & 0x80) + ((cpu->r + 2 * written) & 0x7F);
+	return written;
+#endif
+}
+
 #ifdef WITH_REVERSE
 static int CPU_opcode_fetch_reverse(CPU_t *cpu) {
 	cpu->r = cpu->prev_instruction->r;
@@ -821,8 +1223,10 @@ static void CPU_opcode_run(CPU_t *cpu) {
 	if (opcode_reverse_info[cpu->bus]) {
 		opcode_reverse_info[cpu->bus](cpu);
 	}
-#endif
 	const int time = opcode[cpu->bus](cpu);
+#else
+	const int time = hl::opcode[cpu->bus](cpu);
+#endif
 	if (time != 0) {
 		tc_add(cpu->timer_c, time);
 	}
@@ -849,11 +1253,164 @@ static int CPU_ED_opcode_run(CPU_t *cpu) {
 static int CPU_IXY_opcode_run(CPU_t * cpu) {
 	cpu->prefix = cpu->bus;
 	CPU_opcode_fetch(cpu);
+#ifdef WITH_REVERSE
 	CPU_opcode_run(cpu);
+#else
+	const int time = cpu->prefix == IX_PREFIX ? ix::opcode[cpu->bus](cpu) : iy::opcode[cpu->bus](cpu);
+	if (time != 0) {
+		tc_add(cpu->timer_c, time);
+	}
+#endif
 	cpu->prefix = 0;
 	return 0;
 }
 
+#ifndef WITH_REVERSE
+/*
+ * Decodes every opcode byte of the instruction at pc straight from the mapped
+ * page and runs the final handler, rather than fetching one byte at a time and
+ * bouncing through the CB/ED/IX/IY prefix handlers. Operands are still read by
+ * the handlers themselves. Returns FALSE without touching the cpu whenever
+ * CPU_opcode_fetch has something to do besides reading memory: remapped or
+ * missing ram, flash in the middle of a command, page 0 about to be swapped,
+ * an opcode running into the next bank or a protected address.
+ */
+static BOOL CPU_opcode_run_decoded(CPU_t *cpu) {
+	memc *mem = cpu->mem_c;
+	unsigned short pc = cpu->pc;
+	int bank_num = mc_bank(pc);
+	bank_state_t *bank = &mem->banks[bank_num];
+	int base = mc_base(pc);
+
+	if (mem->page_table[bank_num] == NULL) {
+		return FALSE;
+	}
+	if (!bank->ram && (mem->step != FLASH_READ ||
+		(!mem->hasChangedPage0 && (bank_num == 1 || (mem->boot_mapped && bank_num == 2))))) {
+		return FALSE;
+	}
+	if (base > PAGE_SIZE - 4) {
+		return FALSE;
+	}
+
+	const unsigned char *code = bank->addr + base;
+	// offset of the last opcode byte, which the handler finds on the bus
+	int last;
+	switch (code[0]) {
+	case 0xCB:
+	case 0xED:
+		last = 1;
+		break;
+	case 0xDD:
+	case 0xFD:
+		switch (code[1]) {
+		case 0xDD:
+		case 0xED:
+		case 0xFD:
+			return FALSE;
+		case 0xCB:
+			last = 3;
+			break;
+		default:
+			last = 1;
+			break;
+		}
+		break;
+	default:
+		last = 0;
+		break;
+	}
+
+	if (!cached_allowed_exec(cpu, pc) || (last && !cached_allowed_exec(cpu, pc + last))) {
+		return FALSE;
+	}
+
+	int op_tstates = bank->ram ? mem->read_OP_ram_tstates : mem->read_OP_flash_tstates;
+	int time;
+	if (last == 0) {
+		cpu->bus = code[0];
+		SEtc_add(cpu->timer_c, op_tstates);
+		cpu->pc++;
+		cpu->r = (cpu->r & 0x80) + ((cpu->r + 1) & 0x7F);
+		time = hl::opcode[cpu->bus](cpu);
+	} else {
+		SEtc_add(cpu->timer_c, op_tstates * 2);
+		cpu->pc += 2;
+		cpu->r = (cpu->r & 0x80) + ((cpu->r + 2) & 0x7F);
+		if (code[0] == 0xCB) {
+			cpu->bus = code[1];
+			time = hl::CBtab[cpu->bus](cpu);
+		} else if (code[0] == 0xED) {
+			cpu->bus = code[1];
+			time = hl::EDtab[cpu->bus](cpu);
+		} else if (last == 1) {
+			cpu->prefix = code[0];
+			cpu->bus = code[1];
+			time = code[0] == IX_PREFIX ? ix::opcode[cpu->bus](cpu) : iy::opcode[cpu->bus](cpu);
+			cpu->prefix = 0;
+		} else {
+			cpu->prefix = code[0];
+			CPU_mem_read(cpu, cpu->pc++);
+			char offset = cpu->bus;
+			cpu->bus = code[3];
+			SEtc_add(cpu->timer_c, op_tstates);
+			cpu->pc++;
+			time = code[0] == IX_PREFIX ? ix::ICB_opcode[cpu->bus](cpu, offset) : iy::ICB_opcode[cpu->bus](cpu, offset);
+			cpu->prefix = 0;
+		}
+	}
+
+	if (time != 0) {
+		tc_add(cpu->timer_c, time);
+	}
+	return TRUE;
+}
+#endif
+
+#ifdef WITH_JIT
+/* The handler CPU_opcode_run_decoded would run for the opcode bytes at code */
+BOOL CPU_decode_opcode(const unsigned char *code, jit_op_t *op) {
+	op->prefix = 0;
+	op->length = 2;
+	op->handler = NULL;
+	op->index_handler = NULL;
+	switch (code[0]) {
+	case 0xCB:
+		op->bus = code[1];
+		op->handler = hl::CBtab[code[1]];
+		break;
+	case 0xED:
+		op->bus = code[1];
+		op->handler = hl::EDtab[code[1]];
+		break;
+	case 0xDD:
+	case 0xFD:
+		op->prefix = code[0];
+		switch (code[1]) {
+		case 0xDD:
+		case 0xED:
+		case 0xFD:
+			return FALSE;
+		case 0xCB:
+			op->bus = code[3];
+			op->index_handler = code[0] == IX_PREFIX ? ix::ICB_opcode[code[3]] : iy::ICB_opcode[code[3]];
+			break;
+		default:
+			op->bus = code[1];
+			op->handler = code[0] == IX_PREFIX ? ix::opcode[code[1]] : iy::opcode[code[1]];
+			break;
+		}
+		break;
+	default:
+		op->length = 1;
+		op->bus = code[0];
+		op->handler = hl::opcode[code[0]];
+		break;
+	}
+	return TRUE;
+}
+#endif
+
 static void handle_interrupt(CPU_t *cpu) {
 	if (cpu->iff1) {
 		cpu->iff1 = FALSE;
@@ -916,7 +1473,9 @@ int CPU_connected_step(CPU_t *cpu) {
 		cpu->r = (cpu->r & 0x80) + ((cpu->r + 1 * HALT_SCALE) & 0x7F);
 	}
 
-	handle_pio(cpu);
+	if (cpu->timer_c->tstates >= cpu->pio.next_event) {
+		handle_pio(cpu);
+	}
 
 	if (cpu->interrupt && !cpu->ei_block) {
 		handle_interrupt(cpu);
@@ -942,7 +1501,29 @@ void handle_profiling(CPU_t *cpu, uint64_t oldTStates, uint16_t oldPC) {
 	}
 }
 
-int CPU_step(CPU_t* cpu) {
+/* Device polling and the interrupt that follow every instruction */
+static inline void CPU_step_end(CPU_t *cpu) {
+	if (cpu->timer_c->tstates >= cpu->pio.next_event) {
+		handle_pio(cpu);
+	}
+
+	if (cpu->interrupt && !cpu->ei_block) {
+		//if an interrupt is generated during a ld a, r or ld a, i
+		//then the PV flag should be reset
+		unsigned char edprefix = mem_read(cpu->mem_c, cpu->pc - 2);
+		unsigned char instruction = mem_read(cpu->mem_c, cpu->pc - 1);
+		if (edprefix == 0xED && (instruction == 0x57 || instruction == 0x5F)) {
+			set_f(cpu, get_f(cpu) & ~PV_MASK);
+		}
+		handle_interrupt(cpu);
+	}
+}
+
+/*
+ * One instruction, halt skip or interrupt. CPU_step and CPU_run pass a
+ * constant for profiler so each copy only carries the code it needs.
+ */
+static inline void CPU_step_run(CPU_t *cpu, const BOOL profiler) {
 	cpu->interrupt = 0;
 	cpu->ei_block = FALSE;
 	unsigned short old_pc = cpu->old_pc = cpu->pc;
@@ -952,36 +1533,126 @@ int CPU_step(CPU_t* cpu) {
 	CPU_add_prev_instr(cpu);
 #endif
 	if (cpu->halt == FALSE) {
-		CPU_opcode_fetch(cpu);
-		CPU_opcode_run(cpu);
+#ifndef WITH_REVERSE
+		if (!CPU_opcode_run_decoded(cpu))
+#endif
+		{
+			CPU_opcode_fetch(cpu);
+			CPU_opcode_run(cpu);
+		}
 	} else {
-		/* If the CPU is in halt */
-		tc_add(cpu->timer_c, 4 * HALT_SCALE);
-		cpu->r = (cpu->r & 0x80) + ((cpu->r + 1 * HALT_SCALE) & 0x7F);
+		/* If the CPU is in halt, nothing happens until the next device
+		 * deadline or halt_end, so run every halt cycle up to there at once */
+		uint64_t end = cpu->pio.next_event < cpu->halt_end ? cpu->pio.next_event : cpu->halt_end;
+		uint64_t cycles = 1;
+		if (end > old_tstates + 4 * HALT_SCALE) {
+			cycles = (end - old_tstates + 4 * HALT_SCALE - 1) / (4 * HALT_SCALE);
+		}
+		tc_add(cpu->timer_c, 4 * HALT_SCALE * cycles);
+		cpu->r = (cpu->r & 0x80) + ((cpu->r + HALT_SCALE * cycles) & 0x7F);
 	}
 
-	handle_pio(cpu);
+	CPU_step_end(cpu);
 
-	if (cpu->interrupt && !cpu->ei_block) {
-		//if an interrupt is generated during a ld a, r or ld a, i
-		//then the PV flag should be reset
-		unsigned char edprefix = mem_read(cpu->mem_c, cpu->pc - 2);
-		unsigned char instruction = mem_read(cpu->mem_c, cpu->pc - 1);
-		if (edprefix == 0xED && (instruction == 0x57 || instruction == 0x5F)) {
-			cpu->f &= ~PV_MASK;
-		}
-		handle_interrupt(cpu);
+	if (profiler) {
+		handle_profiling(cpu, old_tstates, old_pc);
 	}
+}
 
-	if (cpu->profiler.running) {
-		handle_profiling(cpu, old_tstates, old_pc);
+#ifdef WITH_JIT
+/*
+ * Runs the translated block for pc and ends the step after its last
+ * instruction like CPU_step_run. Only flash code qualifies, under the same
+ * conditions CPU_opcode_run_decoded reads opcodes straight from the page.
+ * Returns FALSE without touching the cpu if there is no block for pc yet.
+ */
+static BOOL CPU_jit_step(CPU_t *cpu, const BOOL *running) {
+	memc *mem = cpu->mem_c;
+	int bank_num = mc_bank(cpu->pc);
+	bank_state_t *bank = &mem->banks[bank_num];
+
+	if (cpu->halt || bank->ram || mem->page_table[bank_num] == NULL || mem->step != FLASH_READ ||
+		(!mem->hasChangedPage0 && (bank_num == 1 || (mem->boot_mapped && bank_num == 2))) ||
+		!cached_allowed_exec(cpu, cpu->pc)) {
+		return FALSE;
 	}
+	jit_block_fn block = jit_lookup(cpu, bank->page, bank->addr);
+	if (block == NULL) {
+		return FALSE;
+	}
+
+	cpu->interrupt = 0;
+	cpu->ei_block = FALSE;
+	block(cpu, running);
+	CPU_step_end(cpu);
+	return TRUE;
+}
+#endif
 
+int CPU_step(CPU_t* cpu) {
+	if (cpu->profiler.running) {
+		CPU_step_run(cpu, TRUE);
+	} else {
+		CPU_step_run(cpu, FALSE);
+	}
 	return 0;
 }
 
+static inline BOOL CPU_run_loop(CPU_t *cpu, uint64_t tstates_end, const BOOL *running,
+	const BOOL breakpoints, const BOOL profiler)
+{
+	memc *mem_c = cpu->mem_c;
+	timerc *timer_c = cpu->timer_c;
+	BOOL hit_break = FALSE;
+
+	cpu->halt_end = tstates_end;
+	while (*running) {
+		if (breakpoints && bank_has_breaks(mem_c, cpu->pc) &&
+			check_break(mem_c, addr16_to_waddr(mem_c, cpu->pc))) {
+			hit_break = TRUE;
+			break;
+		}
+
+#ifdef WITH_JIT
+		if (breakpoints || profiler || !CPU_jit_step(cpu, running))
+#endif
+		{
+			CPU_step_run(cpu, profiler);
+		}
+
+		if (timer_c->tstates >= tstates_end) {
+			break;
+		}
+	}
+	cpu->halt_end = 0;
+	return hit_break;
+}
+
+/*
+ * Steps until tstates reaches tstates_end or *running is cleared, at least
+ * one instruction unless it is already clear. With breakpoints set the
+ * run stops before any instruction that has one and returns TRUE. Only
+ * pages that carry breakpoints are looked up, and with mem_c->break_count
+ * at 0 there is nothing to find, so callers can pass FALSE.
+ */
+BOOL CPU_run(CPU_t *cpu, uint64_t tstates_end, const BOOL *running, BOOL breakpoints) {
+	if (breakpoints) {
+		if (cpu->profiler.running) {
+			return CPU_run_loop(cpu, tstates_end, running, TRUE, TRUE);
+		}
+		return CPU_run_loop(cpu, tstates_end, running, TRUE, FALSE);
+	}
+	if (cpu->profiler.running) {
+		return CPU_run_loop(cpu, tstates_end, running, FALSE, TRUE);
+	}
+	return CPU_run_loop(cpu, tstates_end, running, FALSE, FALSE);
+}
+
 CPU_t* CPU_clone(CPU_t *cpu) {
 	CPU_t *new_cpu = (CPU_t *)malloc(sizeof(CPU_t));
 	memcpy(new_cpu, cpu, sizeof(CPU_t));
+#ifdef WITH_JIT
+	new_cpu->jit = NULL;
+#endif
 	return new_cpu;
 }
@@ -26,6 +26,16 @@
 #define PAGE_SIZE 16384
 #endif
 
+#ifdef WITH_JIT
+#ifdef WITH_REVERSE
+#error WITH_JIT can not be combined with WITH_REVERSE
+#endif
+// the JIT only has an x86-64 backend, everything else keeps the interpreter
+#if !defined(__x86_64__) && !defined(_M_X64)
+#undef WITH_JIT
+#endif
+#endif
+
 #ifndef BIT
 #define BIT(bit) (1 << (bit))
 #endif
@@ -85,16 +95,29 @@ union { \
 }
 #endif
 
+/*	Hardware time is kept on a single clock running at TIMER_CLOCK_RATE.
+ *	The rate is a multiple of every cpu speed so a tstate is always a whole
+ *	number of clock ticks */
+#define TIMER_CLOCK_RATE 600000000ULL
+// clock ticks in one period of a hz signal
+#define CLOCK_HZ(hz) (TIMER_CLOCK_RATE / (hz))
+#define CLOCK_SECONDS(sec) ((uint64_t) ((sec) * TIMER_CLOCK_RATE))
+#define CLOCK_MS(ms) ((uint64_t) (ms) * (TIMER_CLOCK_RATE / 1000))
+
 /* 	Determines frequency provided
  *	to the CPU */
 typedef struct timer_context {
 	uint64_t tstates;
 	uint32_t freq;
-	double elapsed;		//this isn't used if using long long only (see next line)
-	double lasttime;	//<--this isn't used anymore (except for sound and interrupts)
+	uint64_t clock_base;	//clock at tstates_base, moved whenever freq changes
+	uint64_t tstates_base;
+	uint32_t clock_scale;	//clock ticks per tstate
 	int timer_version;
 } timer_context_t, timerc;
 
+#define tc_clock(timer_z) \
+	((timer_z)->clock_base + ((timer_z)->tstates - (timer_z)->tstates_base) * (timer_z)->clock_scale)
+
 /* Bank unit for a partition */
 typedef struct bank_state {
 	unsigned char *addr;		//Pointer to offset of memory.(already paged)
@@ -137,6 +160,15 @@ typedef enum {
 	CLEAR_MEM_READ_BREAK = ~MEM_READ_BREAK,
 } BREAK_TYPE;
 
+#define BREAK_EMPTY 0xFFFFFFFF
+#define break_key_is_ram(key) ((BOOL) ((key) >> 22))
+#define break_key_offset(key) (((key) >> 14 & 0xFF) * PAGE_SIZE + ((key) & (PAGE_SIZE - 1)))
+
+typedef struct break_entry {
+	uint32_t key;					// is_ram << 22 | page << 14 | addr, BREAK_EMPTY if unused
+	unsigned char type;
+} break_entry_t;
+
 typedef enum {
 	FLASH_READ,
 	FLASH_AA,
@@ -156,13 +188,14 @@ typedef struct memory_context {
 	/* to be defined */
 	unsigned char *flash;
 	unsigned char *ram;
-	union {
-		struct {
-			unsigned char *flash_break;
-			unsigned char *ram_break;
-		};
-		unsigned char *breaks[2];
-	};
+	unsigned char *flash_base;		// flash as it was booted, delta saves only store pages that differ
+	unsigned char *flash_dirty;		// per flash page, TRUE if it may no longer match flash_base
+	uint64_t flash_base_hash;
+	unsigned int flash_page_gen[256];	// bumped whenever a page changes, drops its translated code
+	break_entry_t *break_table;		// open addressed set of the addresses with breakpoints
+	int break_table_size;			// power of two, 0 until the first breakpoint is set
+	int break_count;
+	uint16_t break_page_count[2][256];	// entries on each flash/ram page, 0 skips the lookup
 
 	BOOL (*breakpoint_manager_callback)(struct memory_context *, BREAK_TYPE, waddr_t);
 
@@ -178,6 +211,8 @@ typedef struct memory_context {
 	BOOL flash_error;				// whether there was an error programming the byte
 	unsigned char flash_toggles;	// flash toggles
 	bank_state_t *banks;			//pointer to the correct bank state currently
+	unsigned char *page_table[4];	// banks[].addr, NULL when a remap or missing page needs mem_read's checks
+	unsigned char exec_cache[4];	// is_allowed_exec verdict per bank, 0 until worked out again
 	bank_state_t normal_banks[NUM_BANKS];	//Current state of each bank
 									// structure 5 is used to preserve the 4th in boot map
 	bank_state_t bootmap_banks[NUM_BANKS];	//used to hold a backup of the banks when this is boot mapped
@@ -218,6 +253,7 @@ typedef struct memory_context {
 
 /* Input/Output device mapping */
 typedef void (*devp)(void *, void *);
+typedef int (*devspan)(void *, void *, const unsigned char *, int, int);
 typedef struct device {
 	BOOL active;
 	memory_context_t *mem_c;
@@ -225,6 +261,11 @@ typedef struct device {
 	devp code;
 	BOOL breakpoint;
 	BOOL protected_port;
+	BOOL mem_map;				// writes only remap memory, interrupt devices are unaffected
+	BOOL remaps_memory;			// writes remap memory besides their other effects
+	BOOL own_schedule;			// writes only move this device's own next_event
+	devspan span;				// writes a byte span in one call, NULL if unsupported
+	uint64_t next_event;		// tstates before which polling this device has no effect
 } device_t;
 
 typedef struct interrupt {
@@ -246,6 +287,7 @@ typedef struct pio_context {
 	device_t devices[MAX_DEVICES];
 	interrupt_t interrupt[MAX_DEVICES];
 	int num_interrupt;
+	uint64_t next_event;		// earliest next_event of all interrupt devices
 	devp breakpoint_callback;
 } pio_context_t, pioc;
 
@@ -309,14 +351,49 @@ typedef struct CPU {
 
 	profiler_t profiler;
 	unsigned short old_pc;
+	uint64_t halt_end;		// a halted CPU_step or block repeat may run up to here, 0 runs one cycle
+#ifdef WITH_LAZY_FLAGS
+	int lazy_op;			// last flag setting ALU op, LAZY_NONE when f is current
+	int lazy_opr1, lazy_opr2, lazy_res;
+#endif
 
 	void(*exe_violation_callback)(struct CPU *);
 	void(*invalid_flash_callback)(struct CPU *);
 	void(*mem_read_break_callback)(struct CPU *);
 	void(*mem_write_break_callback)(struct CPU *);
 	void(*lcd_enqueue_callback)(struct CPU *);
+#ifdef WITH_JIT
+	struct jit *jit;				// translated flash blocks, allocated on first use
+#endif
 } CPU_t;
 
+#ifdef WITH_LAZY_FLAGS
+#ifdef WITH_REVERSE
+#error WITH_LAZY_FLAGS can not be combined with WITH_REVERSE
+#endif
+/*
+ * The 8 bit add, sub, cp, logic and inc/dec handlers only record their
+ * operands and result, F is built from that record the first time it is
+ * read. Every read of F goes through get_f and every write through set_f.
+ */
+enum {
+	LAZY_NONE,
+	LAZY_ADD,
+	LAZY_SUB,
+	LAZY_CP,
+	LAZY_AND,
+	LAZY_OR,
+	LAZY_INC,
+	LAZY_DEC
+};
+unsigned char CPU_lazy_flags(CPU_t *);
+#define get_f(cpu)			((cpu)->lazy_op != LAZY_NONE ? CPU_lazy_flags(cpu) : (cpu)->f)
+#define set_f(cpu, val)		((cpu)->f = (val), (cpu)->lazy_op = LAZY_NONE)
+#else
+#define get_f(cpu)			((cpu)->f)
+#define set_f(cpu, val)		((cpu)->f = (val))
+#endif
+
 typedef int (*opcodep)(CPU_t*);
 typedef int (*index_opcodep)(CPU_t*, char);
 
@@ -326,9 +403,13 @@ uint16_t wmem_read16(memc *mem, waddr_t waddr);
 unsigned short mem_read16(memc*, unsigned short);
 unsigned char mem_write(memc*, unsigned short, char);
 uint8_t wmem_write(memc *mem, waddr_t waddr, uint8_t data);
+void set_flash_base(memc *);
+void set_flash_dirty(memc *, int addr, int length);
+void set_flash_changed(memc *, int addr, int length);
 waddr_t addr16_to_waddr(memc*, uint16_t);
 waddr_t addr32_to_waddr(unsigned int addr, BOOL is_ram);
 
+void free_breaks(memc *);
 void set_break(memc *, waddr_t waddr);
 void set_mem_write_break(memc *, waddr_t waddr);
 void set_mem_read_break(memc *, waddr_t waddr);
@@ -348,14 +429,19 @@ BOOL check_mem_write_break(memc *mem, waddr_t waddr);
 BOOL is_priveleged_page(CPU_t *cpu);
 void change_page(memc *mem, int bank, unsigned char page, BOOL ram);
 void update_bootmap_pages(memc *mem_c);
+void update_page_table(memc *mem);
 
 int tc_init(timerc*, int);
+void tc_set_freq(timerc*, uint32_t);
 int CPU_init(CPU_t*, memc*, timerc*);
 int CPU_reset(CPU_t *);
 int CPU_step(CPU_t*);
+BOOL CPU_run(CPU_t *, uint64_t, const BOOL *, BOOL);
 int CPU_connected_step(CPU_t *cpu);
 unsigned char CPU_mem_read(CPU_t *cpu, unsigned short addr);
 void CPU_mem_write(CPU_t *cpu, unsigned short addr, unsigned char data);
+BOOL CPU_block_repeat(CPU_t *cpu, int written);
+int CPU_block_output(CPU_t *cpu, int dir);
 CPU_t* CPU_clone(CPU_t *cpu);
 #define HALT_SCALE	3
 
@@ -368,7 +454,6 @@ void displayreg(CPU_t *);
 #endif
 
 
-#ifdef NO_TIMER_ELAPSED
 #define tc_add( timer_z , num ) \
 	(timer_z)->tstates += (uint64_t) num;
 
@@ -384,35 +469,18 @@ void displayreg(CPU_t *);
 		timer_z->tstates -= num; \
 	}
 
-#else
-#define tc_add( timer_z , num ) \
-	(timer_z)->tstates += (uint64_t) num; \
-	(timer_z)->elapsed += ((double)(num))/((double)(timer_z)->freq);
-
-#define tc_sub( timer_z , num ) \
-	(timer_z)->tstates -= (uint64_t) num; \
-	(timer_z)->elapsed -= ((double)(num))/((double)(timer_z)->freq);
+#define addschar(address_m, offset_m) ( ( (unsigned short) address_m ) + ( (char) offset_m ) )
 
-#define SEtc_add( timer_z , num ) \
-	if (cpu->pio.model >= TI_83PSE) {\
-		timer_z->tstates += num; \
-		timer_z->elapsed += ((double)(num))/((double)(timer_z)->freq);\
-	}
-#define SEtc_sub( timer_z , num ) \
-	if (cpu->pio.model >= TI_83PSE) {\
-		timer_z->tstates -= num; \
-		timer_z->elapsed -= ((double)(num))/((double)(timer_z)->freq);\
-	}
 
+// optable_index.h fixes this for each handler set it builds
+#ifndef INDEX_PREFIX
+#define INDEX_PREFIX cpu->prefix
 #endif
 
-#define addschar(address_m, offset_m) ( ( (unsigned short) address_m ) + ( (char) offset_m ) )
-
-
 #define index_ext(hlcase,ixcase,iycase) \
-if (!cpu->prefix) { \
+if (!INDEX_PREFIX) { \
 	hlcase \
-} else if (cpu->prefix == 0xDD) { \
+} else if (INDEX_PREFIX == 0xDD) { \
 	ixcase \
 } else { \
 	iycase \
@@ -6,19 +6,38 @@ void ClearDevices(CPU_t* cpu) {
 	int i;
 	for (i = 0; i < ARRAYSIZE(cpu->pio.interrupt); i++) {
 		cpu->pio.devices[i].active = FALSE;
+		cpu->pio.devices[i].mem_map = FALSE;
+		cpu->pio.devices[i].remaps_memory = FALSE;
+		cpu->pio.devices[i].own_schedule = FALSE;
+		cpu->pio.devices[i].span = NULL;
+		cpu->pio.devices[i].next_event = 0;
 		interrupt_t *intVal = &cpu->pio.interrupt[i];
 		intVal->device = NULL;
 		intVal->skip_factor = 1;
 		intVal->skip_count = intVal->skip_factor;
 	}
 	cpu->pio.num_interrupt = 0;
+	cpu->pio.next_event = 0;
 }
 
 int device_output(CPU_t *cpu, unsigned char dev) {
 	if (cpu->pio.devices[dev].active) {
+		// a write can change state shared between devices (timer
+		// frequencies, cpu speed, interrupt masks), so every deadline
+		// has to be recomputed. Bank switches are too frequent for that
+		// and cannot move a deadline, LCD data only moves its own.
+		if (!cpu->pio.devices[dev].mem_map && !cpu->pio.devices[dev].own_schedule)
+			Reset_interrupt_schedule(cpu);
 		cpu->output = TRUE;
 		if (!cpu->pio.devices[dev].protected_port || !cpu->mem_c->flash_locked)
 			cpu->pio.devices[dev].code(cpu, &(cpu->pio.devices[dev]));
+		// port handlers swap banks, remaps and limits directly, any
+		// other write leaves the page table and exec verdicts alone
+		if (cpu->pio.devices[dev].mem_map || cpu->pio.devices[dev].remaps_memory ||
+			cpu->pio.devices[dev].protected_port)
+			update_page_table(cpu->mem_c);
+		if (cpu->pio.devices[dev].own_schedule && cpu->pio.devices[dev].next_event < cpu->pio.next_event)
+			cpu->pio.next_event = cpu->pio.devices[dev].next_event;
 		if (cpu->pio.devices[dev].breakpoint)
 			cpu->pio.breakpoint_callback(cpu, &(cpu->pio.devices[dev]));
 		if (cpu->output) {
@@ -30,8 +49,30 @@ int device_output(CPU_t *cpu, unsigned char dev) {
 	return 0;
 }
 
+/*
+ * Writes len bytes to a port that takes spans, the first one spacing
+ * tstates from now and each next one spacing tstates later. Returns how
+ * many were written, the timer is left at the last of them.
+ */
+int device_output_span(CPU_t *cpu, unsigned char dev, const unsigned char *src, int len, int spacing) {
+	device_t *device = &cpu->pio.devices[dev];
+	if (!device->active || device->span == NULL || device->breakpoint ||
+		(device->protected_port && cpu->mem_c->flash_locked)) {
+		return 0;
+	}
+
+	int written = device->span(cpu, device, src, len, spacing);
+	if (written > 0) {
+		cpu->bus = src[written - 1];
+		if (device->next_event < cpu->pio.next_event)
+			cpu->pio.next_event = device->next_event;
+	}
+	return written;
+}
+
 int device_input(CPU_t *cpu, unsigned char dev) {
 	if (cpu->pio.devices[dev].active) {
+		cpu->pio.next_event = 0;
 		cpu->input = TRUE;
 		if (cpu->pio.devices[dev].breakpoint)
 			cpu->pio.breakpoint_callback(cpu, &(cpu->pio.devices[dev]));
@@ -54,6 +95,7 @@ void Append_interrupt_device(CPU_t *cpu, unsigned char port, unsigned char skip)
 	intVal->device = &cpu->pio.devices[port];
 	intVal->skip_factor = skip;
 	cpu->pio.num_interrupt++;
+	cpu->pio.next_event = 0;
 }
 
 void Modify_interrupt_device(CPU_t *cpu, unsigned char port, unsigned char skip) {
@@ -61,23 +103,86 @@ void Modify_interrupt_device(CPU_t *cpu, unsigned char port, unsigned char skip)
 	for(int i = 0; i < cpu->pio.num_interrupt; i++) {
 		if (cpu->pio.interrupt[i].device == device) {
 			cpu->pio.interrupt[i].skip_factor = skip;
+			device->next_event = 0;
+			cpu->pio.next_event = 0;
 			break;
 		}
 	}
 }
 
+/*
+ * Called by an interrupt device while it is being polled, tells
+ * handle_pio that nothing will change for this device before tstates
+ */
+void Schedule_interrupt_device(device_t *dev, uint64_t tstates) {
+	dev->next_event = tstates;
+}
+
+/*
+ * Converts a point on the hardware clock to the first tstate at or after it
+ */
+uint64_t clock_to_tstates(CPU_t *cpu, uint64_t clock) {
+	timerc *timer_c = cpu->timer_c;
+	uint64_t now = tc_clock(timer_c);
+	if (clock <= now) {
+		return timer_c->tstates;
+	}
+	return timer_c->tstates + (clock - now + timer_c->clock_scale - 1) / timer_c->clock_scale;
+}
+
+/*
+ * Forgets every deadline, the next handle_pio will poll all devices
+ */
+void Reset_interrupt_schedule(CPU_t *cpu) {
+	pio_context_t *pio = &cpu->pio;
+	for (int i = 0; i < pio->num_interrupt; i++) {
+		if (pio->interrupt[i].device != NULL) {
+			pio->interrupt[i].device->next_event = 0;
+		}
+		pio->interrupt[i].skip_count = 1;
+	}
+	pio->next_event = 0;
+}
+
+/*
+ * Polls the interrupt devices whose deadline has passed. A device that
+ * scheduled itself is polled as soon as its deadline is reached, one
+ * that does not is polled every skip_factor calls, as before.
+ * pio->next_event is left at the earliest deadline so CPU_step can skip
+ * calling this until then.
+ */
 void handle_pio(CPU_t *cpu) {
 	interrupt_t *intVal;
 	pio_context_t *pio = &cpu->pio;
+	uint64_t tstates = cpu->timer_c->tstates;
+	uint64_t next_event = NO_DEVICE_EVENT;
 	for (int i = pio->num_interrupt - 1; i >= 0; i--) {
 		intVal = &pio->interrupt[i];
-		if (--intVal->skip_count == 0) {
-			device_t *device = intVal->device;
-			if (device != NULL && device->active) {
-				device->code(cpu, device);
+		device_t *device = intVal->device;
+		if (device == NULL || !device->active) {
+			if (--intVal->skip_count == 0) {
+				intVal->skip_count = intVal->skip_factor;
 			}
+			next_event = 0;
+			continue;
+		}
 
+		BOOL due;
+		if (device->next_event != 0) {
+			due = device->next_event <= tstates;
+		} else {
+			due = --intVal->skip_count == 0;
+		}
+
+		if (due) {
+			device->next_event = 0;
+			device->code(cpu, device);
 			intVal->skip_count = intVal->skip_factor;
 		}
+
+		if (device->next_event < next_event) {
+			next_event = device->next_event;
+		}
 	}
-}
\ No newline at end of file
+	pio->next_event = next_event;
+}
@@ -3,11 +3,16 @@
 #include "corecalc.h"
 
 #define DEV_INDEX(zdev) (zdev - cpu->pio.devices)
+#define NO_DEVICE_EVENT (~(uint64_t) 0)
 
 int device_output(CPU_t *, unsigned char);
 int device_input(CPU_t *, unsigned char);
+int device_output_span(CPU_t *, unsigned char, const unsigned char *, int, int);
 void handle_pio(CPU_t *cpu);
 void Append_interrupt_device(CPU_t *, unsigned char, unsigned char);
 void Modify_interrupt_device(CPU_t *, unsigned char, unsigned char);
+void Schedule_interrupt_device(device_t *, uint64_t);
+uint64_t clock_to_tstates(CPU_t *, uint64_t);
+void Reset_interrupt_schedule(CPU_t *);
 void ClearDevices(CPU_t*);
 #endif
@@ -18,16 +18,16 @@ int bit_ind(CPU_t *cpu, char offset) {
 	unsigned short address;
 	int test_mask = (1 << ((cpu->bus >> 3) & 0x07));
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		address = cpu->ix + offset;
 	} else {
 		address = cpu->iy + offset;
 	}
  	reg = CPU_mem_read(cpu,address);
 	result = reg & test_mask;
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk16(address) + HC_MASK +
-		 x3chk16(address)+ parity(result) + unaffect(CARRY_MASK);
+		 x3chk16(address)+ parity(result) + unaffect(CARRY_MASK));
 	return 20;
 }
 
@@ -38,7 +38,7 @@ int res_ind(CPU_t *cpu, char offset) {
 	int save = (cpu->bus & 0x07);
 	unsigned char bit = ~(1 << ((cpu->bus >> 3)& 0x07));
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		reg = CPU_mem_read(cpu, cpu->ix + offset);
 		CPU_mem_write(cpu, cpu->ix + offset, reg & bit);
 	} else {
@@ -81,7 +81,7 @@ int set_ind(CPU_t *cpu, char offset) {
 	unsigned char bit = (1 << ((cpu->bus >> 3)& 0x07));
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		reg = CPU_mem_read(cpu, cpu->ix + offset);
 		CPU_mem_write(cpu, cpu->ix + offset, reg | bit);
 	} else {
@@ -123,20 +123,20 @@ int rl_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = (result>>7)&1;
-		result = (result<<1)+(cpu->f&1);
+		result = (result<<1)+(get_f(cpu)&1);
 		CPU_mem_write(cpu, cpu->ix + offset, result);
 	} else {
         result = CPU_mem_read(cpu, cpu->iy + offset);
 		carry = (result >> 7) & 1;
-		result = (result << 1) + (cpu->f & 1);
+		result = (result << 1) + (get_f(cpu) & 1);
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 
 	switch(save) {
@@ -171,7 +171,7 @@ int rlc_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = (result>>7)&1;
 		result = (result << 1) + carry;
@@ -182,9 +182,9 @@ int rlc_ind(CPU_t *cpu, char offset) {
 		result = (result<<1) + carry;
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
@@ -218,20 +218,20 @@ int rr_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = result & 1;
-		result = (result>>1) + ((cpu->f & 1)<<7);
+		result = (result>>1) + ((get_f(cpu) & 1)<<7);
 		CPU_mem_write(cpu, cpu->ix + offset, result);
 	} else {
         result = CPU_mem_read(cpu, cpu->iy + offset);
 		carry = result & 1;
-		result = (result>>1) + ((cpu->f & 1)<<7);
+		result = (result>>1) + ((get_f(cpu) & 1)<<7);
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 
 	switch(save) {
 		case 0:
@@ -265,7 +265,7 @@ int rrc_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = result & 1;
 		result = (result>>1) + (carry << 7);
@@ -276,9 +276,9 @@ int rrc_ind(CPU_t *cpu, char offset) {
 		result = (result>>1) + (carry << 7);
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
@@ -312,7 +312,7 @@ int sll_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = (result>>7)&1;
 		result = (result<<1) + 1;
@@ -323,9 +323,9 @@ int sll_ind(CPU_t *cpu, char offset) {
 		result = (result<<1) + 1;
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
@@ -359,7 +359,7 @@ int srl_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = result & 1;
 		result = (result>>1);
@@ -370,9 +370,9 @@ int srl_ind(CPU_t *cpu, char offset) {
 		result = (result>>1);
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
@@ -406,7 +406,7 @@ int sla_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = (result>>7)&1;
 		result*=2;
@@ -417,9 +417,9 @@ int sla_ind(CPU_t *cpu, char offset) {
 		result*=2;
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
@@ -453,7 +453,7 @@ int sra_ind(CPU_t *cpu, char offset) {
 	int carry;
 	int save = (cpu->bus & 0x07);
 	
-	if (cpu->prefix == IX_PREFIX) {
+	if (INDEX_PREFIX == IX_PREFIX) {
 		result = CPU_mem_read(cpu, cpu->ix + offset);
 		carry = result & 1;
 		result = ((result>>1)+(result&0x80))&0xFF;
@@ -464,9 +464,9 @@ int sra_ind(CPU_t *cpu, char offset) {
 		result = ((result>>1)+(result&0x80))&0xFF;
 		CPU_mem_write(cpu, cpu->iy + offset, result);
 	}
-	cpu->f = signchk(result) + zerochk(result) +
+	set_f(cpu, signchk(result) + zerochk(result) +
 		 x5chk(result) + x3chk(result)+
-		 parity(result) + carry;
+		 parity(result) + carry);
 		 
 	switch(save) {
 		case 0:
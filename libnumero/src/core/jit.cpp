@@ -0,0 +1,464 @@
+#include "stdafx.h"
+
+#include "corecalc.h"
+#include "jit.h"
+
+#if defined(WITH_JIT) && (defined(__x86_64__) || defined(_M_X64))
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+/*
+ * Call threaded x86-64 translation of hot flash code. A block is the
+ * straight run of instructions from one address of a flash page. For each
+ * instruction the native code does what CPU_opcode_run_decoded would with
+ * the opcode bytes already decoded and calls the same handler, so CPU_t
+ * stays the only state. After every instruction the block goes back to
+ * CPU_run if a device deadline or the end of the run is reached, running was
+ * cleared, a flash command was started or pc is neither where the decode
+ * went on nor the start of the block, which loops. Port I/O, which covers
+ * every bank switch, halt and ei always end a block, unconditional jumps
+ * end the translation.
+ */
+
+#define JIT_CACHE_SIZE	16384
+#define JIT_CODE_SIZE	(4 * 1024 * 1024)
+#define JIT_HOT			16		// entries into an address before it is translated
+#define JIT_MAX_OPS		64
+#define JIT_BLOCK_SIZE	(JIT_MAX_OPS * 256 + 128)
+
+typedef struct jit_entry {
+	uint32_t key;				// page << 16 | pc
+	unsigned int gen;			// flash_page_gen of the page when the entry was made
+	unsigned int count;
+	jit_block_fn block;
+} jit_entry_t;
+
+typedef struct jit {
+	jit_entry_t cache[JIT_CACHE_SIZE];
+	unsigned char *code;
+	int code_used;
+} jit_t;
+
+typedef struct emitter {
+	unsigned char *p;
+} emitter_t;
+
+#define CPU_OFFSET(field)	((int) offsetof(CPU_t, field))
+
+static void emit8(emitter_t *e, int value) {
+	*e->p++ = (unsigned char) value;
+}
+
+static void emit16(emitter_t *e, int value) {
+	emit8(e, value);
+	emit8(e, value >> 8);
+}
+
+static void emit32(emitter_t *e, int value) {
+	emit16(e, value);
+	emit16(e, value >> 16);
+}
+
+static void emit64(emitter_t *e, uint64_t value) {
+	emit32(e, (int) value);
+	emit32(e, (int) (value >> 32));
+}
+
+static void emit_jcc(emitter_t *e, int cc, const unsigned char *target) {
+	emit8(e, 0x0F);
+	emit8(e, 0x80 | cc);
+	emit32(e, (int) (target - (e->p + 4)));
+}
+
+#define JAE	0x3
+#define JE	0x4
+#define JNE	0x5
+
+static void emit_jmp(emitter_t *e, const unsigned char *target) {
+	emit8(e, 0xE9);
+	emit32(e, (int) (target - (e->p + 4)));
+}
+
+/* Points the rel32 of the jump just emitted at a target that comes later */
+static void emit_fixup(emitter_t *e, unsigned char **fixups, int *num_fixups) {
+	fixups[(*num_fixups)++] = e->p - 4;
+}
+
+static void apply_fixups(unsigned char **fixups, int num_fixups, const unsigned char *target) {
+	for (int i = 0; i < num_fixups; i++) {
+		int rel = (int) (target - (fixups[i] + 4));
+		memcpy(fixups[i], &rel, 4);
+	}
+}
+
+// mov rax, imm64 / call rax
+static void emit_call(emitter_t *e, const void *function) {
+	emit8(e, 0x48); emit8(e, 0xB8); emit64(e, (uint64_t) (uintptr_t) function);
+	emit8(e, 0xFF); emit8(e, 0xD0);
+}
+
+/*
+ * rbx holds cpu, r12 cpu->timer_c, r13 cpu->mem_c, r14 the SE opcode fetch
+ * wait states and r15 running
+ */
+static void emit_prologue(emitter_t *e, BOOL se_timing) {
+	emit8(e, 0x53);								// push rbx
+	emit8(e, 0x41); emit8(e, 0x54);				// push r12
+	emit8(e, 0x41); emit8(e, 0x55);				// push r13
+	emit8(e, 0x41); emit8(e, 0x56);				// push r14
+	emit8(e, 0x41); emit8(e, 0x57);				// push r15
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xEC); emit8(e, 0x20);	// sub rsp, 32
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xCB);	// mov rbx, rcx
+	emit8(e, 0x49); emit8(e, 0x89); emit8(e, 0xD7);	// mov r15, rdx
+#else
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xFB);	// mov rbx, rdi
+	emit8(e, 0x49); emit8(e, 0x89); emit8(e, 0xF7);	// mov r15, rsi
+#endif
+	emit8(e, 0x4C); emit8(e, 0x8B); emit8(e, 0xA3); emit32(e, CPU_OFFSET(timer_c));	// mov r12, [rbx + timer_c]
+	emit8(e, 0x4C); emit8(e, 0x8B); emit8(e, 0xAB); emit32(e, CPU_OFFSET(mem_c));	// mov r13, [rbx + mem_c]
+	if (se_timing) {
+		// movsxd r14, [r13 + read_OP_flash_tstates]
+		emit8(e, 0x4D); emit8(e, 0x63); emit8(e, 0xB5); emit32(e, (int) offsetof(memc, read_OP_flash_tstates));
+	}
+}
+
+static void emit_epilogue(emitter_t *e) {
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x83); emit8(e, 0xC4); emit8(e, 0x20);	// add rsp, 32
+#endif
+	emit8(e, 0x41); emit8(e, 0x5F);				// pop r15
+	emit8(e, 0x41); emit8(e, 0x5E);				// pop r14
+	emit8(e, 0x41); emit8(e, 0x5D);				// pop r13
+	emit8(e, 0x41); emit8(e, 0x5C);				// pop r12
+	emit8(e, 0x5B);								// pop rbx
+	emit8(e, 0xC3);								// ret
+}
+
+/* DD CB d op, the displacement is read between the opcode bytes */
+static int index_cb(CPU_t *cpu, index_opcodep handler, int bus) {
+	CPU_mem_read(cpu, cpu->pc++);
+	char offset = cpu->bus;
+	cpu->bus = bus;
+	SEtc_add(cpu->timer_c, cpu->mem_c->read_OP_flash_tstates);
+	cpu->pc++;
+	return handler(cpu, offset);
+}
+
+static void emit_op(emitter_t *e, const jit_op_t *op, unsigned short pc, BOOL se_timing) {
+	// mov word [rbx + old_pc], pc
+	emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x83); emit32(e, CPU_OFFSET(old_pc)); emit16(e, pc);
+	if (se_timing) {
+		for (int i = 0; i < op->length; i++) {
+			// add [r12 + tstates], r14
+			emit8(e, 0x4D); emit8(e, 0x01); emit8(e, 0xB4); emit8(e, 0x24); emit32(e, (int) offsetof(timerc, tstates));
+		}
+	}
+	// mov word [rbx + pc], pc + length
+	emit8(e, 0x66); emit8(e, 0xC7); emit8(e, 0x83); emit32(e, CPU_OFFSET(pc)); emit16(e, pc + op->length);
+
+	// r = (r & 0x80) + ((r + length) & 0x7F)
+	emit8(e, 0x0F); emit8(e, 0xB6); emit8(e, 0x83); emit32(e, CPU_OFFSET(r));	// movzx eax, byte [rbx + r]
+	emit8(e, 0x8D); emit8(e, 0x48); emit8(e, op->length);		// lea ecx, [rax + length]
+	emit8(e, 0x83); emit8(e, 0xE1); emit8(e, 0x7F);				// and ecx, 0x7F
+	emit8(e, 0x25); emit32(e, 0x80);							// and eax, 0x80
+	emit8(e, 0x09); emit8(e, 0xC8);								// or eax, ecx
+	emit8(e, 0x88); emit8(e, 0x83); emit32(e, CPU_OFFSET(r));	// mov [rbx + r], al
+
+	if (op->prefix) {
+		// mov dword [rbx + prefix], prefix
+		emit8(e, 0xC7); emit8(e, 0x83); emit32(e, CPU_OFFSET(prefix)); emit32(e, op->prefix);
+	}
+#ifdef _WIN32
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xD9);				// mov rcx, rbx
+#else
+	emit8(e, 0x48); emit8(e, 0x89); emit8(e, 0xDF);				// mov rdi, rbx
+#endif
+	if (op->index_handler) {
+#ifdef _WIN32
+		emit8(e, 0x48); emit8(e, 0xBA); emit64(e, (uint64_t) (uintptr_t) op->index_handler);	// mov rdx, handler
+		emit8(e, 0x41); emit8(e, 0xB8); emit32(e, op->bus);		// mov r8d, bus
+#else
+		emit8(e, 0x48); emit8(e, 0xBE); emit64(e, (uint64_t) (uintptr_t) op->index_handler);	// mov rsi, handler
+		emit8(e, 0xBA); emit32(e, op->bus);						// mov edx, bus
+#endif
+		emit_call(e, (const void *) &index_cb);
+	} else {
+		// mov byte [rbx + bus], bus
+		emit8(e, 0xC6); emit8(e, 0x83); emit32(e, CPU_OFFSET(bus)); emit8(e, op->bus);
+		emit_call(e, (const void *) op->handler);
+	}
+	if (op->prefix) {
+		emit8(e, 0xC7); emit8(e, 0x83); emit32(e, CPU_OFFSET(prefix)); emit32(e, 0);
+	}
+
+	// tc_add(cpu->timer_c, time)
+	emit8(e, 0x48); emit8(e, 0x63); emit8(e, 0xC0);				// movsxd rax, eax
+	emit8(e, 0x49); emit8(e, 0x01); emit8(e, 0x84); emit8(e, 0x24); emit32(e, (int) offsetof(timerc, tstates));	// add [r12 + tstates], rax
+}
+
+/* Leaves the block unless CPU_run would go straight on to another instruction */
+static void emit_run_checks(emitter_t *e, const unsigned char *exit) {
+	// mov rax, [r12 + tstates]
+	emit8(e, 0x49); emit8(e, 0x8B); emit8(e, 0x84); emit8(e, 0x24); emit32(e, (int) offsetof(timerc, tstates));
+	// cmp rax, [rbx + pio.next_event]
+	emit8(e, 0x48); emit8(e, 0x3B); emit8(e, 0x83); emit32(e, CPU_OFFSET(pio.next_event));
+	emit_jcc(e, JAE, exit);
+	// cmp rax, [rbx + halt_end]
+	emit8(e, 0x48); emit8(e, 0x3B); emit8(e, 0x83); emit32(e, CPU_OFFSET(halt_end));
+	emit_jcc(e, JAE, exit);
+
+	// cmp [r15], 0
+	if (sizeof(BOOL) == 1) {
+		emit8(e, 0x41); emit8(e, 0x80); emit8(e, 0x3F); emit8(e, 0);
+	} else {
+		emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0x3F); emit8(e, 0);
+	}
+	emit_jcc(e, JE, exit);
+
+	// cmp dword [r13 + step], FLASH_READ
+	emit8(e, 0x41); emit8(e, 0x83); emit8(e, 0xBD); emit32(e, (int) offsetof(memc, step)); emit8(e, FLASH_READ);
+	emit_jcc(e, JNE, exit);
+}
+
+// cmp word [rbx + pc], pc
+static void emit_cmp_pc(emitter_t *e, unsigned short pc) {
+	emit8(e, 0x66); emit8(e, 0x81); emit8(e, 0xBB); emit32(e, CPU_OFFSET(pc)); emit16(e, pc);
+}
+
+static int base_length(int op) {
+	if ((op & 0xCF) == 0x01 || (op & 0xE7) == 0x22 || (op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4 ||
+		op == 0xC3 || op == 0xCD) {
+		return 3;
+	}
+	if ((op & 0xC7) == 0x06 || (op & 0xC7) == 0xC6 || (op & 0xE7) == 0x20 ||
+		op == 0x10 || op == 0x18 || op == 0xD3 || op == 0xDB) {
+		return 2;
+	}
+	return 1;
+}
+
+/* Length of the whole instruction, opcode and operand bytes */
+static int op_length(const unsigned char *code) {
+	int op = code[1];
+	switch (code[0]) {
+	case 0xCB:
+		return 2;
+	case 0xED:
+		// ld (nn),rr and ld rr,(nn)
+		return (op & 0xC7) == 0x43 ? 4 : 2;
+	case 0xDD:
+	case 0xFD:
+		if (op == 0xCB) {
+			return 4;
+		}
+		if (op == 0x34 || op == 0x35 || op == 0x36 || (op & 0xC7) == 0x86 ||
+			(op != 0x76 && ((op & 0xC7) == 0x46 || (op & 0xF8) == 0x70))) {
+			return 2 + base_length(op);
+		}
+		return 1 + base_length(op);
+	default:
+		return base_length(code[0]);
+	}
+}
+
+#define FALLS_THROUGH	0
+#define JUMPS			1		// never falls through, may still loop to the block start
+#define LEAVES			2		// port I/O, halt and ei
+
+static int op_flow(const unsigned char *code) {
+	int op = code[0];
+	if (op == 0xED) {
+		op = code[1];
+		// in r,(c), out (c),r, ini, outi, ind, outd and their repeats
+		if ((op & 0xC6) == 0x40 || (op & 0xE6) == 0xA2) {
+			return LEAVES;
+		}
+		// retn, reti
+		return (op & 0xC7) == 0x45 ? JUMPS : FALLS_THROUGH;
+	}
+	if (op == 0xDD || op == 0xFD) {
+		op = code[1];
+	}
+	switch (op) {
+	case 0x76:
+	case 0xD3:
+	case 0xDB:
+	case 0xFB:
+		return LEAVES;
+	case 0x18:
+	case 0xC3:
+	case 0xC9:
+	case 0xCD:
+	case 0xE9:
+		return JUMPS;
+	}
+	// rst
+	return (op & 0xC7) == 0xC7 ? JUMPS : FALLS_THROUGH;
+}
+
+static jit_block_fn translate(jit_t *jit, CPU_t *cpu, const unsigned char *page_code) {
+	BOOL se_timing = cpu->pio.model >= TI_83PSE;
+	emitter_t e;
+	e.p = jit->code + jit->code_used;
+
+	// the exit sits in front of the entry so every jump to it is known
+	const unsigned char *exit = e.p;
+	emit_epilogue(&e);
+	jit_block_fn block = (jit_block_fn) e.p;
+	emit_prologue(&e, se_timing);
+	const unsigned char *head = e.p;
+
+	// jumps to the loop check at the end
+	unsigned char *fixups[JIT_MAX_OPS];
+	int num_fixups = 0;
+
+	unsigned short start = cpu->pc;
+	unsigned short pc = start;
+	int ops = 0;
+	while (ops < JIT_MAX_OPS && mc_bank(pc) == mc_bank(start) && mc_base(pc) <= PAGE_SIZE - 4) {
+		const unsigned char *code = page_code + mc_base(pc);
+		jit_op_t op;
+		if (!CPU_decode_opcode(code, &op)) {
+			break;
+		}
+		unsigned short next = pc + op_length(code);
+		emit_op(&e, &op, pc, se_timing);
+		ops++;
+
+		int flow = op_flow(code);
+		if (flow == LEAVES) {
+			break;
+		}
+		if (flow == JUMPS) {
+			emit_jmp(&e, NULL);
+			emit_fixup(&e, fixups, &num_fixups);
+			break;
+		}
+		emit_cmp_pc(&e, next);
+		emit_jcc(&e, JNE, NULL);
+		emit_fixup(&e, fixups, &num_fixups);
+		emit_run_checks(&e, exit);
+		pc = next;
+	}
+	if (ops == 0) {
+		return NULL;
+	}
+	emit_jmp(&e, exit);
+
+	// a branch back to the start runs the block again without leaving it
+	apply_fixups(fixups, num_fixups, e.p);
+	emit_cmp_pc(&e, start);
+	emit_jcc(&e, JNE, exit);
+	emit_run_checks(&e, exit);
+	emit_jmp(&e, head);
+
+	jit->code_used = (int) (e.p - jit->code);
+	return block;
+}
+
+static void jit_flush(jit_t *jit) {
+	memset(jit->cache, 0, sizeof(jit->cache));
+	jit->code_used = 0;
+}
+
+static jit_t *jit_alloc() {
+	jit_t *jit = (jit_t *) calloc(1, sizeof(jit_t));
+	if (jit == NULL) {
+		return NULL;
+	}
+#ifdef _WIN32
+	jit->code = (unsigned char *) VirtualAlloc(NULL, JIT_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void *code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	jit->code = code == MAP_FAILED ? NULL : (unsigned char *) code;
+#endif
+	return jit;
+}
+
+static void jit_free_code(jit_t *jit) {
+	if (jit->code == NULL) {
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(jit->code, 0, MEM_RELEASE);
+#else
+	munmap(jit->code, JIT_CODE_SIZE);
+#endif
+	jit->code = NULL;
+}
+
+/*
+ * The code buffer is never writable and executable at once: it is made
+ * writable only while a block is emitted. If that fails everything
+ * translated is dropped and the interpreter runs from then on.
+ */
+static BOOL jit_set_writable(jit_t *jit, BOOL writable) {
+#ifdef _WIN32
+	DWORD old_protect;
+	BOOL ok = VirtualProtect(jit->code, JIT_CODE_SIZE, writable ? PAGE_READWRITE : PAGE_EXECUTE_READ, &old_protect);
+#else
+	BOOL ok = mprotect(jit->code, JIT_CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) == 0;
+#endif
+	if (!ok) {
+		jit_flush(jit);
+		jit_free_code(jit);
+	}
+	return ok;
+}
+
+/*
+ * The block for pc, which sits in flash page page_code, or NULL while the
+ * interpreter should run it. Rewriting a flash page drops the blocks of that
+ * page, running out of code space drops everything translated so far.
+ */
+jit_block_fn jit_lookup(CPU_t *cpu, int page, const unsigned char *page_code) {
+	jit_t *jit = cpu->jit;
+	if (jit == NULL) {
+		jit = cpu->jit = jit_alloc();
+		if (jit == NULL) {
+			return NULL;
+		}
+	}
+	if (page >= (int) ARRAYSIZE(cpu->mem_c->flash_page_gen)) {
+		return NULL;
+	}
+
+	uint32_t key = (page << 16) | cpu->pc;
+	unsigned int gen = cpu->mem_c->flash_page_gen[page];
+	jit_entry_t *entry = &jit->cache[(key * 2654435761u) >> 18];
+	if (entry->key != key || entry->gen != gen) {
+		entry->key = key;
+		entry->gen = gen;
+		entry->count = 0;
+		entry->block = NULL;
+	}
+	if (entry->block == NULL && ++entry->count == JIT_HOT && jit->code != NULL) {
+		if (jit->code_used > JIT_CODE_SIZE - JIT_BLOCK_SIZE) {
+			jit_flush(jit);
+			entry->key = key;
+			entry->gen = gen;
+		}
+		if (!jit_set_writable(jit, TRUE)) {
+			return NULL;
+		}
+		jit_block_fn block = translate(jit, cpu, page_code);
+		if (!jit_set_writable(jit, FALSE)) {
+			return NULL;
+		}
+		entry->block = block;
+	}
+	return entry->block;
+}
+
+void jit_free(CPU_t *cpu) {
+	jit_t *jit = cpu->jit;
+	if (jit == NULL) {
+		return;
+	}
+	jit_free_code(jit);
+	free(jit);
+	cpu->jit = NULL;
+}
+#endif
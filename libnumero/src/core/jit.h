@@ -0,0 +1,29 @@
+#ifndef JIT_H
+#define JIT_H
+#include "corecalc.h"
+
+#ifdef WITH_JIT
+/*
+ * What CPU_opcode_run_decoded would do for the opcode bytes of one
+ * instruction: charge and skip length opcode bytes, put bus on the bus and
+ * run handler with cpu->prefix set to prefix. DD CB d op instructions run
+ * index_handler after reading the displacement instead.
+ */
+typedef struct jit_op {
+	unsigned char bus;
+	unsigned char prefix;
+	unsigned char length;
+	opcodep handler;
+	index_opcodep index_handler;
+} jit_op_t;
+
+/* Runs instructions until one leaves the block, needs the interpreter or
+ * CPU_run would stop after it */
+typedef void (*jit_block_fn)(CPU_t *, const BOOL *running);
+
+BOOL CPU_decode_opcode(const unsigned char *code, jit_op_t *op);
+jit_block_fn jit_lookup(CPU_t *cpu, int page, const unsigned char *page_code);
+void jit_free(CPU_t *cpu);
+#endif
+
+#endif
@@ -4,10 +4,16 @@
 static int CPU_CB_opcode_run(CPU_t*);
 static int CPU_ED_opcode_run(CPU_t*);
 static int CPU_IXY_opcode_run(CPU_t*);
+#endif
+
+/* No guard on the tables, optable_index.h includes them again for each
+ * of its handler sets. OPTABLE_NO_OPCODE, _CB, _ICB and _ED leave out the
+ * tables an include never dispatches through, and are cleared after it */
 
 /* This will all compress quite well, through UPX */
 
 // Opcode table
+#ifndef OPTABLE_NO_OPCODE
 static opcodep opcode[256] = {
 	&nop,				//0
 	&ld_bc_num16,
@@ -297,8 +303,10 @@ static opcodep opcode[256] = {
 	&cp_num8,
 	&rst
 };
+#endif
 
 //CB opcodes
+#ifndef OPTABLE_NO_CB
 static opcodep CBtab[256] = {
 	&rlc_reg,			//00
 	&rlc_reg,
@@ -588,8 +596,10 @@ static opcodep CBtab[256] = {
 	&set,
 	&set
 };
+#endif
 
 // index register cb opcodes
+#ifndef OPTABLE_NO_ICB
 static index_opcodep ICB_opcode[256] = {
 	&rlc_ind,			//00
 	&rlc_ind,
@@ -879,6 +889,7 @@ static index_opcodep ICB_opcode[256] = {
 	&set_ind,
 	&set_ind
 };
+#endif
 
 
 
@@ -888,6 +899,7 @@ static index_opcodep ICB_opcode[256] = {
 	the majority of ED prefixed opcodes 
 	are nops...
 	*/
+#ifndef OPTABLE_NO_ED
 static opcodep EDtab[256] = {
 	&ednop,				//00
 	&ednop,
@@ -1178,5 +1190,9 @@ static opcodep EDtab[256] = {
 	&ednop,
 	&ednop
 };
+#endif
 
-#endif
\ No newline at end of file
+#undef OPTABLE_NO_OPCODE
+#undef OPTABLE_NO_CB
+#undef OPTABLE_NO_ICB
+#undef OPTABLE_NO_ED
@@ -0,0 +1,48 @@
+#ifndef OPTABLE_INDEX_H
+#define OPTABLE_INDEX_H
+
+/*
+ * The alu, control and index cb handlers built once more for HL, IX and
+ * IY, each with INDEX_PREFIX fixed so index_ext and every other prefix
+ * test fold away. cpu->prefix is still set while an IX or IY handler
+ * runs, the CB, ED and prefix entries of each opcode table are the
+ * generic ones from core.cpp. Only the tables core.cpp dispatches
+ * through are built: HL opcode, CB and ED, IX and IY opcode and index CB.
+ */
+
+#undef INDEX_PREFIX
+#define INDEX_PREFIX 0
+#define OPTABLE_NO_ICB
+namespace hl {
+#include "alu.cpp"
+#include "control.cpp"
+#include "indexcb.cpp"
+#include "optable.h"
+}
+
+#undef INDEX_PREFIX
+#define INDEX_PREFIX IX_PREFIX
+#define OPTABLE_NO_CB
+#define OPTABLE_NO_ED
+namespace ix {
+#include "alu.cpp"
+#include "control.cpp"
+#include "indexcb.cpp"
+#include "optable.h"
+}
+
+#undef INDEX_PREFIX
+#define INDEX_PREFIX IY_PREFIX
+#define OPTABLE_NO_CB
+#define OPTABLE_NO_ED
+namespace iy {
+#include "alu.cpp"
+#include "control.cpp"
+#include "indexcb.cpp"
+#include "optable.h"
+}
+
+#undef INDEX_PREFIX
+#define INDEX_PREFIX cpu->prefix
+
+#endif
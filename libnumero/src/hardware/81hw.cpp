@@ -8,7 +8,7 @@
 #pragma warning(push)
 #pragma warning( disable : 4100 )
 
-static double timer_freq81[4] = { 1.0 / 800.0, 1.0 / 400.0, 3.0 / 800.0, 1.0 / 200.0 };
+static uint64_t timer_freq81[4] = { CLOCK_HZ(800), CLOCK_HZ(400), CLOCK_HZ(800) * 3, CLOCK_HZ(200) };
 
 // 81 screen offset
 static void port0(CPU_t *cpu, device_t *dev) {
@@ -49,7 +49,7 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	
 	if (cpu->input) {
 		unsigned char result = 0;
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) result += 4;
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) result += 4;
 		if (cpu->pio.lcd->active) result += 2;
 		if (stdint->on_latch) result += 1;
 		else result += 8;
@@ -71,9 +71,9 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	}
 	
 	if (!(stdint->intactive & 0x04) && cpu->pio.lcd->active == TRUE) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 			cpu->interrupt = TRUE;
-			while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+			while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 				stdint->lastchk1 += stdint->timermax1;
 		}
 	}
@@ -95,7 +95,7 @@ static void port4(CPU_t *cpu, device_t *dev) {
 		dev->aux = (void *) (size_t) cpu->bus;
 		int freq = (cpu->bus >> 1) & 0x3;
 		cpu->pio.stdint->timermax1 = cpu->pio.stdint->freq[freq];
-		cpu->pio.stdint->lastchk1 = cpu->timer_c->elapsed;
+		cpu->pio.stdint->lastchk1 = tc_clock(cpu->timer_c);
 		int lcd_mode = (cpu->bus >> 3) & 0x3;
 		if (lcd_mode == 0) {
 			cpu->pio.lcd->width = 80;
@@ -160,7 +160,7 @@ static STDINT_t* INT81_init(CPU_t* cpu) {
 	
 	stdint->intactive = 0;
 	stdint->timermax1 = stdint->freq[3];
-	stdint->lastchk1 = cpu->timer_c->elapsed;
+	stdint->lastchk1 = tc_clock(cpu->timer_c);
 	stdint->on_backup = 0;
 	stdint->on_latch = FALSE;
 	return stdint;
@@ -176,12 +176,10 @@ int memory_init_81(memc *mc) {
 	mc->flash_version = 1;
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	memset(mc->flash, 0xFF, mc->flash_size);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *)calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 
 	if (!mc->flash || !mc->ram) {
 		_tprintf_s(_T("Couldn't allocate memory in memory_init_83p\n"));
@@ -8,7 +8,7 @@
 
 #pragma warning(push)
 #pragma warning( disable : 4100 )
-static double timer_freq83[4] = {1.0f / 600.0f, 1.0f / 257.14f, 1.0f / 163.63f, 1.0f / 120.0f};
+static uint64_t timer_freq83[4] = {CLOCK_HZ(600), CLOCK_SECONDS(1.0 / 257.14), CLOCK_SECONDS(1.0 / 163.63), CLOCK_HZ(120)};
 
 #define SWAP_BANK	0xFF
 #define ROM0_8		0xFE
@@ -214,10 +214,10 @@ void port03_83(CPU_t *cpu, device_t *dev) {
 	
 	if (cpu->input) {
 		unsigned char result = 0;
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 			result += 2;
 		}
-		if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
 			result += 4;
 		}
 		if (cpu->pio.keypad->on_pressed) {
@@ -257,10 +257,10 @@ void port03_83(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & 0x02) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 			cpu->interrupt = TRUE;
 	} else {
-		while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+		while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 			stdint->lastchk1 += stdint->timermax1;
 	}
 
@@ -270,10 +270,10 @@ void port03_83(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & 0x04) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2)
+		if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2)
 			cpu->interrupt = TRUE;
 	} else {
-		while ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2)
+		while (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2)
 			stdint->lastchk2 += stdint->timermax2;
 	}
 	
@@ -299,8 +299,8 @@ void port04_83(CPU_t *cpu, device_t *dev) {
 		/* but for practicallity its close enough for now. */
 		int freq = ((cpu->bus & 6) >> 1);
 		stdint->timermax1 = stdint->freq[freq];
-		stdint->timermax2 = stdint->freq[freq] / 2.0f;
-		stdint->lastchk2  = stdint->lastchk1 + (stdint->freq[freq] / 4.0f);
+		stdint->timermax2 = stdint->freq[freq] / 2;
+		stdint->lastchk2  = stdint->lastchk1 + (stdint->freq[freq] / 4);
 
 		if ((cpu->bus & 1) == 1) {
 			cpu->mem_c->boot_mapped = TRUE;
@@ -343,9 +343,9 @@ STDINT_t* INT83_init(timer_context_t *timer_c) {
 	
 	stdint->intactive = 0;
 	stdint->timermax1 = stdint->freq[3];
-	stdint->lastchk1 = timer_c->elapsed;
-	stdint->timermax2 = stdint->freq[3]/2.0f;
-	stdint->lastchk2 = timer_c->elapsed + stdint->freq[3] / 4.0f;
+	stdint->lastchk1 = tc_clock(timer_c);
+	stdint->timermax2 = stdint->freq[3] / 2;
+	stdint->lastchk2 = tc_clock(timer_c) + stdint->freq[3] / 4;
 	
 	
 	stdint->mem	=0;
@@ -391,6 +391,7 @@ int device_init_83(CPU_t *cpu, BOOL bad82) {
 	cpu->pio.devices[0x02].active = TRUE;
 	cpu->pio.devices[0x02].aux = stdint;
 	cpu->pio.devices[0x02].code = (devp) port02_83;
+	cpu->pio.devices[0x02].remaps_memory = TRUE;
 	
 	cpu->pio.devices[0x03].active = TRUE;
 	cpu->pio.devices[0x03].aux = stdint;
@@ -399,6 +400,7 @@ int device_init_83(CPU_t *cpu, BOOL bad82) {
 	cpu->pio.devices[0x04].active = TRUE;
 	cpu->pio.devices[0x04].aux = stdint;
 	cpu->pio.devices[0x04].code = (devp) port04_83;
+	cpu->pio.devices[0x04].remaps_memory = TRUE;
 
 	LCD_t *lcd = LCD_init(cpu, TI_83);
 	cpu->pio.devices[0x10].active = TRUE;
@@ -408,6 +410,8 @@ int device_init_83(CPU_t *cpu, BOOL bad82) {
 	cpu->pio.devices[0x11].active = TRUE;
 	cpu->pio.devices[0x11].aux = lcd;
 	cpu->pio.devices[0x11].code = (devp) lcd->base.data;
+	cpu->pio.devices[0x11].span = lcd->base.data_span;
+	cpu->pio.devices[0x11].own_schedule = TRUE;
 
 	cpu->pio.devices[0x14].active = TRUE;
 	cpu->pio.devices[0x14].code = (devp) port14_83;
@@ -436,12 +440,10 @@ int memory_init_83(memc *mc) {
 
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	memset(mc->flash, 0xFF, mc->flash_size);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 
 	if (!mc->flash || !mc->ram) {
 		_tprintf_s(_T("Couldn't allocate memory in memory_init_83\n"));
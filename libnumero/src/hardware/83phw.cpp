@@ -10,7 +10,7 @@
 #pragma warning(push)
 #pragma warning( disable : 4100 )
 
-static double timer_freq83p[4] = { 1.0f / 560.0f, 1.0f / 248.0f, 1.0f / 170.0f, 1.0f / 118.0f };
+static uint64_t timer_freq83p[4] = { CLOCK_HZ(560), CLOCK_HZ(248), CLOCK_HZ(170), CLOCK_HZ(118) };
 
 //------------------------
 // bit 0 - Tip
@@ -51,6 +51,9 @@ static void port0(CPU_t *cpu, device_t *dev) {
 
 	if (link->audio.init && link->audio.enabled) {
 		nextsample(cpu);
+	} else {
+		// only sound needs polling, wait for the next port access
+		Schedule_interrupt_device(dev, NO_DEVICE_EVENT);
 	}
 }
 
@@ -98,10 +101,10 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & 0x02) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 			cpu->interrupt = TRUE;
-	} else if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
-		while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+	} else if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
+		while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 			stdint->lastchk1 += stdint->timermax1;
 	}
 
@@ -111,10 +114,10 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & 0x04) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2)
+		if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2)
 			cpu->interrupt = TRUE;
-	} else if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
-		while ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2)
+	} else if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
+		while (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2)
 			stdint->lastchk2 += stdint->timermax2;
 	}
 
@@ -124,14 +127,31 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	stdint->on_backup = cpu->pio.keypad->on_pressed;
 	if (stdint->on_latch)
 		cpu->interrupt = TRUE;
+
+	schedule_stdint(cpu, dev, stdint);
+}
+
+/*
+	Nothing changes for the standard interrupt until one of the
+	timers expires, unless the ON latch is set or the calc is
+	powered down (see the LCD note above). ON key presses and port
+	writes reset the schedule. */
+void schedule_stdint(CPU_t *cpu, device_t *dev, STDINT_t *stdint) {
+	if (stdint->on_latch || !(stdint->intactive & 0x08)) {
+		return;
+	}
+
+	uint64_t next_chk1 = stdint->lastchk1 + stdint->timermax1;
+	uint64_t next_chk2 = stdint->lastchk2 + stdint->timermax2;
+	Schedule_interrupt_device(dev, clock_to_tstates(cpu, next_chk1 < next_chk2 ? next_chk1 : next_chk2));
 }
 
 static void port4(CPU_t *cpu, device_t *dev) {
 	STDINT_t * stdint = (STDINT_t *) dev->aux;
 	if (cpu->input) {
 		unsigned char result = 0;
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) result += 2;
-		if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) result += 4;
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) result += 2;
+		if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) result += 4;
 		
 		if (stdint->on_latch) result += 1;
 		if (!cpu->pio.keypad->on_pressed) result += 8;
@@ -144,8 +164,8 @@ static void port4(CPU_t *cpu, device_t *dev) {
 		/* but for practicality its close enough for now. */
 		int freq = ((cpu->bus & 6) >> 1);
 		stdint->timermax1 = stdint->freq[freq];
-		stdint->timermax2 = stdint->freq[freq] / 2.0f;
-		stdint->lastchk2  = stdint->lastchk1 + (stdint->freq[freq] / 4.0f);
+		stdint->timermax2 = stdint->freq[freq] / 2;
+		stdint->lastchk2  = stdint->lastchk1 + (stdint->freq[freq] / 4);
 
 		if (cpu->bus & 1) {
 			cpu->mem_c->boot_mapped = TRUE;
@@ -309,9 +329,9 @@ static STDINT_t* INT83P_init(CPU_t* cpu) {
 	
 	stdint->intactive = 0;
 	stdint->timermax1 = stdint->freq[3] ;
-	stdint->lastchk1 = cpu->timer_c->elapsed;
-	stdint->timermax2 = stdint->freq[3] / 2.0f;
-	stdint->lastchk2 = cpu->timer_c->elapsed + stdint->freq[3] / 4.0f;
+	stdint->lastchk1 = tc_clock(cpu->timer_c);
+	stdint->timermax2 = stdint->freq[3] / 2;
+	stdint->lastchk2 = tc_clock(cpu->timer_c) + stdint->freq[3] / 4;
 	stdint->on_backup = 0;
 	stdint->on_latch = FALSE;
 	return stdint;
@@ -355,6 +375,7 @@ int device_init_83p(CPU_t *cpu) {
 	cpu->pio.devices[0x04].active = TRUE;
 	cpu->pio.devices[0x04].aux = stdint;
 	cpu->pio.devices[0x04].code = (devp) port4;
+	cpu->pio.devices[0x04].remaps_memory = TRUE;
 
 	cpu->pio.devices[0x05].active = TRUE;
 	cpu->pio.devices[0x05].aux = assist;
@@ -362,9 +383,11 @@ int device_init_83p(CPU_t *cpu) {
 
 	cpu->pio.devices[0x06].active = TRUE;
 	cpu->pio.devices[0x06].code = (devp) port6;
+	cpu->pio.devices[0x06].mem_map = TRUE;
 
 	cpu->pio.devices[0x07].active = TRUE;
 	cpu->pio.devices[0x07].code = (devp) port7;
+	cpu->pio.devices[0x07].mem_map = TRUE;
 
 	LCD_t *lcd = LCD_init(cpu, TI_83P);
 	cpu->pio.devices[0x10].active = TRUE;
@@ -374,6 +397,8 @@ int device_init_83p(CPU_t *cpu) {
 	cpu->pio.devices[0x11].active = TRUE;
 	cpu->pio.devices[0x11].aux = lcd;
 	cpu->pio.devices[0x11].code = (devp)lcd->base.data;
+	cpu->pio.devices[0x11].span = lcd->base.data_span;
+	cpu->pio.devices[0x11].own_schedule = TRUE;
 
 	cpu->pio.devices[0x14].active = TRUE;
 	cpu->pio.devices[0x14].code = (devp) port14;
@@ -392,6 +417,7 @@ int device_init_83p(CPU_t *cpu) {
 	cpu->pio.devices[0x26].code = (devp) port3;
 	cpu->pio.devices[0x27].active = TRUE;
 	cpu->pio.devices[0x27].code = (devp) port7;
+	cpu->pio.devices[0x27].mem_map = TRUE;
 	
 	cpu->pio.lcd		= (LCDBase_t *) lcd;
 	cpu->pio.keypad		= keyp;
@@ -424,12 +450,10 @@ int memory_init_83p(memc *mc) {
 	mc->flash_version = 1;
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	memset(mc->flash, 0xFF, mc->flash_size);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 
 	if (!mc->flash || !mc->ram) {
 		_tprintf_s(_T("Couldn't allocate memory in memory_init_83p\n"));
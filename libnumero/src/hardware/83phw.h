@@ -8,6 +8,7 @@
 #define LinkRead (((cpu->pio.link->host & 0x03) | (cpu->pio.link->client[0] & 0x03)) ^ 3)
 #endif
 
+void schedule_stdint(CPU_t *, device_t *, STDINT_t *);
 int device_init_83p(CPU_t*);
 int memory_init_83p(memc *);
 
@@ -20,7 +20,7 @@
 
 //Interrupts on SE calculators are based on the crystal timers
 // however for now this will do.
-static double timer_freq83pse[4] = { 1.0 / 512.0, 1.0 / 227.0, 1.0 / 158.0, 1.0 / 108.0 };
+static uint64_t timer_freq83pse[4] = { CLOCK_HZ(512), CLOCK_HZ(227), CLOCK_HZ(158), CLOCK_HZ(108) };
 
 void UpdateDelays(CPU_t *cpu, DELAY_t *delay);
 
@@ -47,6 +47,9 @@ void port0_83pse(CPU_t *cpu, device_t *dev) {
 
 	if (link->audio.init && link->audio.enabled) {
 		nextsample(cpu);
+	} else {
+		// only sound needs polling, wait for the next port access
+		Schedule_interrupt_device(dev, NO_DEVICE_EVENT);
 	}
 }
 
@@ -97,13 +100,13 @@ void port2_83pse(CPU_t *cpu, device_t *dev) {
 		}
 
 		if (!(cpu->bus & BIT(1))) {
-			while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+			while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 				stdint->lastchk1 += stdint->timermax1;
 			}
 		}
 
 		if (!(cpu->bus & BIT(2))) {
-			while ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
+			while (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
 				stdint->lastchk2 += stdint->timermax2;
 			}
 		}
@@ -147,12 +150,12 @@ void port3_83pse(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & BIT(1)) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 			cpu->interrupt = TRUE;
 		}
 	}
-	else if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
-		while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+	else if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
+		while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 			stdint->lastchk1 += stdint->timermax1;
 		}
 	}
@@ -163,11 +166,11 @@ void port3_83pse(CPU_t *cpu, device_t *dev) {
 	when mask timer continues to tick but 
 	does not generate an interrupt. */
 	if (stdint->intactive & BIT(2)) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
 			cpu->interrupt = TRUE;
 		}
-	} else if ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
-		while ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2) {
+	} else if (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
+		while (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2) {
 			stdint->lastchk2 += stdint->timermax2;
 		}
 	}
@@ -181,6 +184,8 @@ void port3_83pse(CPU_t *cpu, device_t *dev) {
 	if (stdint->on_latch) {
 		cpu->interrupt = TRUE;
 	}
+
+	schedule_stdint(cpu, dev, stdint);
 }
 
 void port4_83pse(CPU_t *cpu, device_t *dev) {
@@ -192,11 +197,11 @@ void port4_83pse(CPU_t *cpu, device_t *dev) {
 			result += BIT(0);
 		}
 
-		if ((stdint->intactive & BIT(1)) && ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)) {
+		if ((stdint->intactive & BIT(1)) && (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)) {
 			result += BIT(1);
 		}
 
-		if ((stdint->intactive & BIT(2)) && ((cpu->timer_c->elapsed - stdint->lastchk2) > stdint->timermax2)) {
+		if ((stdint->intactive & BIT(2)) && (tc_clock(cpu->timer_c) > stdint->lastchk2 + stdint->timermax2)) {
 			result += BIT(2);
 		}
 
@@ -223,8 +228,8 @@ void port4_83pse(CPU_t *cpu, device_t *dev) {
 		/* but for practicality its close enough for now. */
 		int freq = ((cpu->bus & 6) >> 1);
 		stdint->timermax1 = stdint->freq[freq];
-		stdint->timermax2 = ( stdint->freq[freq] / 2.0f );
-		stdint->lastchk2  = stdint->lastchk1 + ( stdint->freq[freq] / 4.0f );
+		stdint->timermax2 = ( stdint->freq[freq] / 2 );
+		stdint->lastchk2  = stdint->lastchk1 + ( stdint->freq[freq] / 4 );
 
 		if (cpu->bus & BIT(0)) {
 			cpu->mem_c->boot_mapped = TRUE;
@@ -361,8 +366,10 @@ void port9_83pse(CPU_t *cpu, device_t *dev) {
 	link_t * link = (link_t *) cpu->pio.link;
 	
 	if (!cpu->input && !cpu->output) {
-		if (!(assist->link_enable & 0x80)) {
-
+		if (assist->link_enable & 0x80) {
+			// link assist disabled, nothing to poll until port 8 is written
+			Schedule_interrupt_device(dev, NO_DEVICE_EVENT);
+		} else {
 			if (assist->sending) {
 				assist->ready = FALSE;
 				switch ((LinkRead) & 0x03) {
@@ -519,6 +526,15 @@ void port11_83pse(CPU_t *cpu, device_t *dev) {
 	cpu->pio.lcd->data(cpu, dev);
 }
 
+int port11_span_83pse(CPU_t *cpu, device_t *dev, const unsigned char *src, int len, int spacing) {
+	DELAY_t *delay = (DELAY_t *)&cpu->pio.se_aux->delay;
+	int extra_time = delay->reg[GetCPUSpeed(cpu)] >> 2;
+	// every byte waits extra_time longer, keep inside the time the caller
+	// had for len of them
+	len = (len - 1) * spacing / (spacing + extra_time) + 1;
+	return cpu->pio.lcd->data_span(cpu, dev, src, len, spacing + extra_time);
+}
+
 void port0A_83pse(CPU_t *cpu, device_t *dev) {
 	LINKASSIST_t *assist = (LINKASSIST_t *) dev->aux;
 	if (cpu->input) {
@@ -668,16 +684,16 @@ void port20_83pse(CPU_t *cpu, device_t *dev) {
 
 		switch (val) {
 			case 1:
-				cpu->timer_c->freq = MHZ_15;
+				tc_set_freq(cpu->timer_c, MHZ_15);
 				break;
 			case 2:
-				cpu->timer_c->freq = MHZ_20;
+				tc_set_freq(cpu->timer_c, MHZ_20);
 				break;
 			case 3:
-				cpu->timer_c->freq = MHZ_25;
+				tc_set_freq(cpu->timer_c, MHZ_25);
 				break;
 			default:
-				cpu->timer_c->freq = MHZ_6;
+				tc_set_freq(cpu->timer_c, MHZ_6);
 				break;
 		}
 		UpdateDelays(cpu, &cpu->pio.se_aux->delay);
@@ -819,34 +835,34 @@ void port30_83pse(CPU_t *cpu, device_t *dev) {
 		timer->generate	= FALSE;
 		switch ((timer->clock & 0xC0) >> 6) {
 			case 0x00: {
-				timer->divsor = 0.0f;
+				timer->divsor = 0;
 				break;
 			}
 			case 0x01: {
 				switch (timer->clock & 0x07) {
 					case 0x00:
-						timer->divsor = 3.0;
+						timer->divsor = 3;
 						break;
 					case 0x01:
-						timer->divsor = 32.0;
+						timer->divsor = 32;
 						break;
 					case 0x02:
-						timer->divsor = 327.000;
+						timer->divsor = 327;
 						break;
 					case 0x03:
-						timer->divsor = 3276.00;
+						timer->divsor = 3276;
 						break;
 					case 0x04:
-						timer->divsor = 1.0;
+						timer->divsor = 1;
 						break;
 					case 0x05:
-						timer->divsor = 16.0;
+						timer->divsor = 16;
 						break;
 					case 0x06:
-						timer->divsor = 256.0;
+						timer->divsor = 256;
 						break;
 					case 0x07:
-						timer->divsor = 4096.0;
+						timer->divsor = 4096;
 						break;
 				}
 				break;
@@ -856,11 +872,11 @@ void port30_83pse(CPU_t *cpu, device_t *dev) {
 			{
 				int i;
 				int mask = 0x20;
-				timer->divsor = 64.0f;
+				timer->divsor = 64;
 				for(i = 0; i < 6; i++) {
 					if (timer->clock & mask) break;
 					mask = mask>>1;
-					timer->divsor /= 2.0f;
+					timer->divsor /= 2;
 				}
 				break;
 			}
@@ -893,8 +909,8 @@ void handlextal(CPU_t *cpu,XTAL_t* xtal) {
 	TIMER_t* timer = &xtal->timers[0];
 	
 	// overall xtal timer ticking
-	xtal->ticks = (unsigned long long)(cpu->timer_c->elapsed * 32768.0);
-	xtal->lastTime = cpu->timer_c->elapsed;
+	xtal->lastTime = tc_clock(cpu->timer_c);
+	xtal->ticks = (xtal->lastTime / TIMER_CLOCK_RATE) * 32768 + (xtal->lastTime % TIMER_CLOCK_RATE) * 32768 / TIMER_CLOCK_RATE;
 	
 	for (int i = 0; i < NumElm(xtal->timers); i++)
 	{
@@ -944,6 +960,45 @@ void handlextal(CPU_t *cpu,XTAL_t* xtal) {
 			cpu->interrupt = TRUE;
 	}
 }
+
+/*
+ * Works out when handlextal will next have a timer to count down.
+ * A pending interrupt keeps the device polled.
+ */
+static void schedule_xtal(CPU_t *cpu, device_t *dev, XTAL_t *xtal) {
+	uint64_t next_event = NO_DEVICE_EVENT;
+	for (int i = 0; i < NumElm(xtal->timers); i++) {
+		TIMER_t *timer = &xtal->timers[i];
+		uint64_t timer_event;
+		if (timer->generate) {
+			return;
+		}
+		if (!timer->active) {
+			continue;
+		}
+
+		switch (((timer->clock & 0xC0) >> 6) & 0x03) {
+			case 1:
+			{
+				// first clock at which xtal->ticks passes lastTicks + divsor
+				uint64_t ticks = timer->lastTicks + timer->divsor + 1;
+				timer_event = clock_to_tstates(cpu, (ticks / 32768) * TIMER_CLOCK_RATE + ((ticks % 32768) * TIMER_CLOCK_RATE + 32767) / 32768);
+				break;
+			}
+			case 2:
+			case 3:
+				timer_event = timer->lastTstates + (unsigned long long) timer->divsor + 1;
+				break;
+			default:
+				continue;
+		}
+
+		if (timer_event < next_event) {
+			next_event = timer_event;
+		}
+	}
+	Schedule_interrupt_device(dev, next_event);
+}
 		
 void port32_83pse(CPU_t *cpu, device_t *dev) {
 	XTAL_t* xtal = (XTAL_t *) dev->aux;
@@ -960,11 +1015,12 @@ void port32_83pse(CPU_t *cpu, device_t *dev) {
 		timer->max = cpu->bus;
 		if (timer->clock & 0xC0) timer->active = TRUE;
 		timer->lastTstates = cpu->timer_c->tstates;
-		timer->lastTicks = (double) xtal->ticks;
+		timer->lastTicks = xtal->ticks;
 		mod_timer(cpu, xtal);
 		cpu->output = FALSE;
 	}
-	
+
+	schedule_xtal(cpu, dev, xtal);
 //	handlextal(cpu,xtal);
 }
 
@@ -986,10 +1042,10 @@ void clock_enable(CPU_t *cpu, device_t *dev) {
 			clock->base = clock->set;
 		}
 		if ( (clock->enable&0x01)==0 && (cpu->bus&0x01)==1) {
-			clock->lasttime = cpu->timer_c->elapsed;
+			clock->lasttime = tc_clock(cpu->timer_c);
 		}
 		if ( (clock->enable&0x01)==1 && (cpu->bus&0x01)==0) {
-			clock->base = clock->base+((unsigned long) (cpu->timer_c->elapsed-clock->lasttime));
+			clock->base = clock->base+((unsigned long) ((tc_clock(cpu->timer_c) - clock->lasttime) / TIMER_CLOCK_RATE));
 		}
 		clock->enable= cpu->bus&0x03;
 
@@ -1006,7 +1062,7 @@ void clock_set(CPU_t *cpu, device_t *dev) {
 		clock->set = 
 			( clock->set & ~(0xFF<<((DEV_INDEX(dev)-0x41)*8)) ) | 
 			( cpu->bus<<((DEV_INDEX(dev)-0x41)*8) );
-		clock->lasttime = cpu->timer_c->elapsed;
+		clock->lasttime = tc_clock(cpu->timer_c);
 		cpu->output = FALSE;
 	}
 }	
@@ -1016,7 +1072,7 @@ void clock_read(CPU_t *cpu, device_t *dev) {
 	if (cpu->input) {
 		unsigned long time;
 		if (clock->enable & 0x01) {
-			time = clock->base + ((unsigned long)(cpu->timer_c->elapsed - clock->lasttime));
+			time = clock->base + ((unsigned long) ((tc_clock(cpu->timer_c) - clock->lasttime) / TIMER_CLOCK_RATE));
 		} else {
 			time = clock->base;
 		}
@@ -1064,9 +1120,9 @@ void port3A_83pse(CPU_t *cpu, device_t *dev) {
 						lcd->base.contrast %= MAX_BACKLIGHT_LEVEL;
 					}
 
-					lcd->backlight_off_elapsed = 0.0;
+					lcd->backlight_off_elapsed = 0;
 				} else {
-					lcd->backlight_off_elapsed = cpu->timer_c->elapsed;
+					lcd->backlight_off_elapsed = tc_clock(cpu->timer_c);
 				}
 			}
 		}
@@ -1077,8 +1133,8 @@ void port3A_83pse(CPU_t *cpu, device_t *dev) {
 	}
 
 	if (cpu->pio.model == TI_84PCSE) {
-		if (lcd->backlight_active && lcd->backlight_off_elapsed > DBL_MIN &&
-			((cpu->timer_c->elapsed - lcd->backlight_off_elapsed - BACKLIGHT_OFF_DELAY) > DBL_MIN))
+		if (lcd->backlight_active && lcd->backlight_off_elapsed != 0 &&
+			tc_clock(cpu->timer_c) > lcd->backlight_off_elapsed + BACKLIGHT_OFF_DELAY)
 		{
 			lcd->backlight_active = FALSE;
 		}
@@ -1288,9 +1344,9 @@ STDINT_t* INT83PSE_init(CPU_t* cpu, int model) {
 	
 	stdint->intactive = 0;
 	stdint->timermax1 = stdint->freq[3];
-	stdint->lastchk1 = cpu->timer_c->elapsed;
-	stdint->timermax2 = stdint->freq[3] / 2.0f;
-	stdint->lastchk2 = cpu->timer_c->elapsed + stdint->freq[3] / 4.0f;
+	stdint->lastchk1 = tc_clock(cpu->timer_c);
+	stdint->timermax2 = stdint->freq[3] / 2;
+	stdint->lastchk2 = tc_clock(cpu->timer_c) + stdint->freq[3] / 4;
 	
 	stdint->on_backup = 0;
 	stdint->on_latch = FALSE;
@@ -1355,17 +1411,21 @@ int device_init_83pse(CPU_t *cpu, int model) {
 	cpu->pio.devices[0x04].active = TRUE;
 	cpu->pio.devices[0x04].aux = stdint;
 	cpu->pio.devices[0x04].code = (devp) port4_83pse;
+	cpu->pio.devices[0x04].remaps_memory = TRUE;
 	
 	
 /* memory mapping */
 	cpu->pio.devices[0x05].active = TRUE;
 	cpu->pio.devices[0x05].code = (devp) port5_83pse;
+	cpu->pio.devices[0x05].mem_map = TRUE;
 
 	cpu->pio.devices[0x06].active = TRUE;
 	cpu->pio.devices[0x06].code = (devp) port6_83pse;
+	cpu->pio.devices[0x06].mem_map = TRUE;
 
 	cpu->pio.devices[0x07].active = TRUE;
 	cpu->pio.devices[0x07].code = (devp) port7_83pse;
+	cpu->pio.devices[0x07].mem_map = TRUE;
 	
 	
 	SE_AUX_t *se_aux = SE_AUX_init();
@@ -1390,10 +1450,12 @@ int device_init_83pse(CPU_t *cpu, int model) {
 	cpu->pio.devices[0x0E].active = TRUE;
 	cpu->pio.devices[0x0E].aux = &cpu->mem_c->port0E;
 	cpu->pio.devices[0x0E].code = (devp) port0E_83pse;
+	cpu->pio.devices[0x0E].mem_map = TRUE;
 
 	cpu->pio.devices[0x0F].active = TRUE;
 	cpu->pio.devices[0x0F].aux = &cpu->mem_c->port0F;
 	cpu->pio.devices[0x0F].code = (devp) port0F_83pse;
+	cpu->pio.devices[0x0F].mem_map = TRUE;
 	
 /* LCD */
 	LCDBase_t *lcd;
@@ -1412,6 +1474,8 @@ int device_init_83pse(CPU_t *cpu, int model) {
 	cpu->pio.devices[0x11].active = TRUE;
 	cpu->pio.devices[0x11].aux = lcd;
 	cpu->pio.devices[0x11].code = (devp)port11_83pse;
+	cpu->pio.devices[0x11].span = (devspan)port11_span_83pse;
+	cpu->pio.devices[0x11].own_schedule = TRUE;
 
 /* Flash locking */
 	cpu->pio.devices[0x14].active = TRUE;
@@ -1466,10 +1530,12 @@ int device_init_83pse(CPU_t *cpu, int model) {
 	cpu->pio.devices[0x27].active = TRUE;
 	cpu->pio.devices[0x27].aux = &cpu->mem_c->port27_remap_count;
 	cpu->pio.devices[0x27].code = (devp) &port_chunk_remap_83pse;
+	cpu->pio.devices[0x27].mem_map = TRUE;
 
 	cpu->pio.devices[0x28].active = TRUE;
 	cpu->pio.devices[0x28].aux = &cpu->mem_c->port28_remap_count;
 	cpu->pio.devices[0x28].code = (devp) &port_chunk_remap_83pse;
+	cpu->pio.devices[0x28].mem_map = TRUE;
 	
 //delay ports
 	for (int i = 0x29; i <= 0x2F; i++) {
@@ -1637,11 +1703,9 @@ int memory_init_83pse(memc *mc) {
 	
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 	mc->ram_lower = 0x00 * 0x400;
 	mc->ram_upper = 0x00 * 0x400 + 0x3FF;
 	
@@ -1685,12 +1749,10 @@ int memory_init_84p(memc *mc) {
 
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	memset(mc->flash, 0xFF, mc->flash_size);
 
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 
 	if (!mc->flash || !mc->ram ) {
 		_tprintf_s(_T("Couldn't allocate memory in memory_init_84p\n"));
@@ -1731,11 +1793,9 @@ int memory_init_84pcse(memc *mc) {
 	
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 	mc->ram_lower = 0x00 * 0x400;
 	mc->ram_upper = 0x00 * 0x400 + 0x3FF;
 	
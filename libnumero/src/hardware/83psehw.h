@@ -11,8 +11,8 @@
 typedef struct TIMER {
 	/* determines which clock if any is used for time */
 	unsigned long long lastTstates;
-	double lastTicks;
-	double divsor;
+	unsigned long long lastTicks;
+	unsigned int divsor;
 	BOOL loop;
 	BOOL interrupt;
 	BOOL underflow;
@@ -24,7 +24,7 @@ typedef struct TIMER {
 } TIMER_t;
 
 typedef struct XTAL {
-	double lastTime;			/* actual real time of last tick */
+	uint64_t lastTime;			/* clock of last tick */
 	unsigned long long ticks;	/* ticks of the xtal timer */
 	TIMER_t timers[3];
 } XTAL_t;
@@ -39,7 +39,7 @@ typedef struct LINKASSIST {
 	BOOL ready;
 	BOOL error;
 	BOOL sending;
-	double last_access;
+	uint64_t last_access;
 	int bit;
 } LINKASSIST_t;
 
@@ -79,7 +79,7 @@ typedef struct CLOCK {
 	unsigned char enable;
 	unsigned long set;
 	unsigned long base;
-	double lasttime;
+	uint64_t lasttime;
 } CLOCK_t;
 
 typedef struct USB {
@@ -118,7 +118,7 @@ typedef struct SE_AUX {
 	XTAL_t xtal;
 	unsigned char gpio;
 	unsigned long long gpio_write_tstates;
-	double gpio_write_elapsed;
+	uint64_t gpio_write_elapsed;
 	USB_t usb;
 } SE_AUX_t;
 
@@ -9,7 +9,7 @@
 #pragma warning(push)
 #pragma warning( disable : 4100 )
 
-static double timer_freq[4] = { 1.0 / 800.0, 1.0 / 400.0, 3.0 / 800.0, 1.0 / 200.0 };
+static uint64_t timer_freq[4] = { CLOCK_HZ(800), CLOCK_HZ(400), CLOCK_HZ(800) * 3, CLOCK_HZ(200) };
 
 static void port10(CPU_t *, device_t *);
 
@@ -52,7 +52,7 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	
 	if (cpu->input) {
 		unsigned char result = 0;
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) result += 4;
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) result += 4;
 		if (cpu->pio.lcd->active) result += 2;
 		if (stdint->on_latch) result += 1;
 		else result += 8;
@@ -74,9 +74,9 @@ static void port3(CPU_t *cpu, device_t *dev) {
 	}
 	
 	if (!(stdint->intactive & 0x04) && cpu->pio.lcd->active == TRUE) {
-		if ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1) {
+		if (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1) {
 			cpu->interrupt = TRUE;
-			while ((cpu->timer_c->elapsed - stdint->lastchk1) > stdint->timermax1)
+			while (tc_clock(cpu->timer_c) > stdint->lastchk1 + stdint->timermax1)
 				stdint->lastchk1 += stdint->timermax1;
 		}
 	}
@@ -100,7 +100,7 @@ static void port4(CPU_t *cpu, device_t *dev) {
 		dev->aux = (void *) (size_t) cpu->bus;
 		int freq = (cpu->bus >> 1) & 0x3;
 		cpu->pio.stdint->timermax1 = cpu->pio.stdint->freq[freq];
-		cpu->pio.stdint->lastchk1 = cpu->timer_c->elapsed;
+		cpu->pio.stdint->lastchk1 = tc_clock(cpu->timer_c);
 		int lcd_mode = (cpu->bus >> 3) & 0x3;
 		if (lcd_mode == 0) {
 			cpu->pio.lcd->width = 80;
@@ -199,7 +199,7 @@ static STDINT_t* INT86_init(CPU_t* cpu) {
 	memcpy(stdint->freq, timer_freq, sizeof(timer_freq));
 	stdint->intactive = 0;
 	stdint->timermax1 = stdint->freq[3];
-	stdint->lastchk1 = cpu->timer_c->elapsed;
+	stdint->lastchk1 = tc_clock(cpu->timer_c);
 	stdint->on_backup = 0;
 	stdint->on_latch = FALSE;
 	return stdint;
@@ -250,11 +250,13 @@ int device_init_86(CPU_t *cpu) {
 	cpu->pio.devices[0x05].active = TRUE;
 	cpu->pio.devices[0x05].aux = stdint;
 	cpu->pio.devices[0x05].code = (devp) &port5;
+	cpu->pio.devices[0x05].mem_map = TRUE;
 
 	// RAM page swap
 	cpu->pio.devices[0x06].active = TRUE;
 	cpu->pio.devices[0x06].aux = NULL;
 	cpu->pio.devices[0x06].code = (devp) &port6;
+	cpu->pio.devices[0x06].mem_map = TRUE;
 
 	cpu->pio.devices[0x07].active = TRUE;
 	cpu->pio.devices[0x07].aux = link;
@@ -296,12 +298,10 @@ int memory_init_86(memc *mc) {
 	mc->flash_version = 1;
 	mc->flash_size = mc->flash_pages * PAGE_SIZE;
 	mc->flash = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
-	mc->flash_break = (unsigned char *) calloc(mc->flash_pages, PAGE_SIZE);
 	memset(mc->flash, 0xFF, mc->flash_size);
 	
 	mc->ram_size = mc->ram_pages * PAGE_SIZE;
 	mc->ram = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
-	mc->ram_break = (unsigned char *) calloc(mc->ram_pages, PAGE_SIZE);
 
 	if (!mc->flash || !mc->ram) {
 		_tprintf_s(_T("Couldn't allocate memory in memory_init_86\n"));
@@ -1,6 +1,7 @@
 #include "stdafx.h"
 
 #include "colorlcd.h"
+#include "device.h"
 
 #define PIXEL_OFFSET(x, y) ((y) * COLOR_LCD_WIDTH + (x)) * COLOR_LCD_DEPTH 
 #define TRUCOLOR(color, bits) ((color) * (0xFF / ((1 << (bits)) - 1)))
@@ -122,6 +123,8 @@ typedef enum {
 static int read_pixel(ColorLCD_t *lcd);
 static void write_pixel18(ColorLCD_t *lcd);
 static void write_pixel16(ColorLCD_t *lcd);
+static void write_gram(ColorLCD_t *lcd);
+static void count_write(CPU_t *cpu, ColorLCD_t *lcd);
 static void update_x(ColorLCD_t *lcd, BOOL should_update_row);
 static void update_y(ColorLCD_t *lcd, BOOL should_update_col);
 
@@ -131,7 +134,8 @@ static void ColorLCD_LCDreset(ColorLCD_t *lcd);
 static void ColorLCD_free(CPU_t *);
 static void ColorLCD_command(CPU_t *, device_t *);
 static void ColorLCD_data(CPU_t *, device_t *);
-uint8_t *ColorLCD_Image(LCDBase_t *);
+static int ColorLCD_data_span(CPU_t *, device_t *, const uint8_t *, int, int);
+static BOOL ColorLCD_render_into(LCDBase_t *, uint8_t *, size_t, LCD_PIXEL_FORMAT);
 
 ColorLCD_t *ColorLCD_init(CPU_t *, int) {
 	ColorLCD_t* lcd = (ColorLCD_t *)malloc(sizeof(ColorLCD_t));
@@ -149,7 +153,7 @@ void set_line_time(ColorLCD_t *lcd) {
 	uint64_t refresh_time = lcd->frame_rate * (lcd->display_lines + lcd->front_porch + lcd->back_porch) * lcd->clocks_per_line;
 	refresh_time /= lcd->clock_divider;
 	//refresh_time /= COLOR_LCD_HEIGHT;
-	lcd->line_time = 1.0 / refresh_time;
+	lcd->line_time = refresh_time ? TIMER_CLOCK_RATE / refresh_time : ~(uint64_t) 0;
 }
 
 
@@ -436,7 +440,7 @@ static void ColorLCD_enqueue(CPU_t *cpu, ColorLCD_t *lcd) {
 		}
 	}
 
-	lcd->last_draw = cpu->timer_c->elapsed;
+	lcd->last_draw = tc_clock(cpu->timer_c);
 	lcd->draw_gate++;
 	if (lcd->draw_gate == COLOR_LCD_WIDTH + lcd->front_porch + lcd->back_porch) {
 		lcd->draw_gate = 0;
@@ -481,45 +485,11 @@ void ColorLCD_data(CPU_t *cpu, device_t *device) {
 	ColorLCD_t *lcd = (ColorLCD_t *)device->aux;
 	uint16_t reg_index = lcd->current_register & 0xFF;
 	if (cpu->output) {
-		// Run some sanity checks on the write vars
-		if (lcd->base.write_last > cpu->timer_c->elapsed)
-			lcd->base.write_last = cpu->timer_c->elapsed;
-
-		double write_delay = cpu->timer_c->elapsed - lcd->base.write_last;
-		if (lcd->base.write_avg == 0.0) lcd->base.write_avg = write_delay;
-		lcd->base.write_last = cpu->timer_c->elapsed;
-		lcd->base.last_tstate = cpu->timer_c->tstates;
-
-		// If there is a delay that is significantly longer than the
-		// average write delay, we can assume a frame has just terminated
-		// and you can push this complete frame towards generating the
-		// final image.
-
-		// If you are in steady mode, then this simply serves as a
-		// FPS calculator
-		if (write_delay < lcd->base.write_avg * 100.0) {
-			lcd->base.write_avg = (lcd->base.write_avg * 0.90) + (write_delay * 0.10);
-		} else {
-			double ufps_length = cpu->timer_c->elapsed - lcd->base.ufps_last;
-			lcd->base.ufps = 1.0 / ufps_length;
-			lcd->base.ufps_last = cpu->timer_c->elapsed;
-		}
+		count_write(cpu, lcd);
 
 		lcd->write_buffer = lcd->write_buffer << 8 | cpu->bus;
 		if (reg_index == GRAM_REG) {
-			int mode = LCD_REG_MASK(ENTRY_MODE_REG, TRI_MASK);
-			if (mode & EIGHTEEN_BIT_MASK) {
-				lcd->write_step++;
-				if (lcd->write_step >= 3) {
-					lcd->write_step = 0;
-					write_pixel18(lcd);
-				}
-			} else {
-				lcd->write_step = !lcd->write_step;
-				if (!lcd->write_step) {
-					write_pixel16(lcd);
-				}
-			}
+			write_gram(lcd);
 		} else {
 			lcd->write_step = !lcd->write_step;
 			if (!lcd->write_step) {
@@ -563,28 +533,113 @@ void ColorLCD_data(CPU_t *cpu, device_t *device) {
 	}
 
 	// Make sure timers are valid
-	if (lcd->base.time > cpu->timer_c->elapsed)
-		lcd->base.time = cpu->timer_c->elapsed;
-	//else if (cpu->timer_c->elapsed - lcd->base.time > (2.0 / STEADY_FREQ_MIN))
-	//	lcd->base.time = cpu->timer_c->elapsed - (2.0 / STEADY_FREQ_MIN);
+	if (lcd->base.time > tc_clock(cpu->timer_c))
+		lcd->base.time = tc_clock(cpu->timer_c);
+	//else if (tc_clock(cpu->timer_c) - lcd->base.time > CLOCK_HZ(STEADY_FREQ_MIN) * 2)
+	//	lcd->base.time = tc_clock(cpu->timer_c) - CLOCK_HZ(STEADY_FREQ_MIN) * 2;
 
 #ifdef REAL_LCD
-	if (((cpu->timer_c->elapsed - lcd->base.time) >= (1.0 / lcd->frame_rate)) && !lcd->is_drawing) {
+	if (lcd->frame_rate != 0 && ((tc_clock(cpu->timer_c) - lcd->base.time) >= CLOCK_HZ(lcd->frame_rate)) && !lcd->is_drawing) {
 		ColorLCD_enqueue(cpu, lcd);
-		lcd->base.time += (1.0 / lcd->frame_rate);
+		lcd->base.time += CLOCK_HZ(lcd->frame_rate);
 	}
 
-	while (cpu->timer_c->elapsed - lcd->last_draw >= lcd->line_time) {
+	while (tc_clock(cpu->timer_c) - lcd->last_draw >= lcd->line_time) {
 		ColorLCD_enqueue(cpu, lcd);
 	}
 #else
-	if (((cpu->timer_c->elapsed - lcd->base.time) >= (1.0 / lcd->frame_rate)) && !lcd->is_drawing) {
-		ColorLCD_enqueue(cpu, lcd);
-		lcd->base.time += (1.0 / lcd->frame_rate);
+	if (lcd->frame_rate != 0) {
+		if (((tc_clock(cpu->timer_c) - lcd->base.time) >= CLOCK_HZ(lcd->frame_rate)) && !lcd->is_drawing) {
+			ColorLCD_enqueue(cpu, lcd);
+			lcd->base.time += CLOCK_HZ(lcd->frame_rate);
+		}
+
+		Schedule_interrupt_device(device, clock_to_tstates(cpu, lcd->base.time + CLOCK_HZ(lcd->frame_rate)));
 	}
 #endif
 }
 
+/*
+ * GRAM writes from otir, one byte every spacing tstates. Stops before the
+ * first byte that is due to queue the next frame, writes to any other
+ * register go through ColorLCD_data.
+ */
+static int ColorLCD_data_span(CPU_t *cpu, device_t *device, const uint8_t *src, int len, int spacing) {
+#ifdef REAL_LCD
+	return 0;
+#else
+	ColorLCD_t *lcd = (ColorLCD_t *)device->aux;
+	uint16_t reg_index = lcd->current_register & 0xFF;
+	if (reg_index != GRAM_REG || lcd->register_breakpoint[reg_index]) {
+		return 0;
+	}
+
+	uint64_t frame_length = lcd->frame_rate != 0 ? CLOCK_HZ(lcd->frame_rate) : 0;
+	int written;
+	for (written = 0; written < len; written++) {
+		tc_add(cpu->timer_c, spacing);
+		if (frame_length != 0 && tc_clock(cpu->timer_c) - lcd->base.time >= frame_length) {
+			tc_sub(cpu->timer_c, spacing);
+			break;
+		}
+
+		count_write(cpu, lcd);
+		lcd->write_buffer = lcd->write_buffer << 8 | src[written];
+		write_gram(lcd);
+	}
+
+	if (written > 0 && frame_length != 0) {
+		Schedule_interrupt_device(device, clock_to_tstates(cpu, lcd->base.time + frame_length));
+	}
+	return written;
+#endif
+}
+
+/*
+ * Keeps the write rate and user FPS up to date for a write to the data port
+ */
+static void count_write(CPU_t *cpu, ColorLCD_t *lcd) {
+	// Run some sanity checks on the write vars
+	if (lcd->base.write_last > tc_clock(cpu->timer_c))
+		lcd->base.write_last = tc_clock(cpu->timer_c);
+
+	uint64_t write_delay = tc_clock(cpu->timer_c) - lcd->base.write_last;
+	if (lcd->base.write_avg == 0) lcd->base.write_avg = write_delay;
+	lcd->base.write_last = tc_clock(cpu->timer_c);
+	lcd->base.last_tstate = cpu->timer_c->tstates;
+
+	// If there is a delay that is significantly longer than the
+	// average write delay, we can assume a frame has just terminated
+	// and you can push this complete frame towards generating the
+	// final image.
+
+	// If you are in steady mode, then this simply serves as a
+	// FPS calculator
+	if (write_delay < lcd->base.write_avg * 100) {
+		lcd->base.write_avg = (lcd->base.write_avg * 9 + write_delay) / 10;
+	} else {
+		uint64_t ufps_length = tc_clock(cpu->timer_c) - lcd->base.ufps_last;
+		lcd->base.ufps = (double) TIMER_CLOCK_RATE / ufps_length;
+		lcd->base.ufps_last = tc_clock(cpu->timer_c);
+	}
+}
+
+static void write_gram(ColorLCD_t *lcd) {
+	int mode = LCD_REG_MASK(ENTRY_MODE_REG, TRI_MASK);
+	if (mode & EIGHTEEN_BIT_MASK) {
+		lcd->write_step++;
+		if (lcd->write_step >= 3) {
+			lcd->write_step = 0;
+			write_pixel18(lcd);
+		}
+	} else {
+		lcd->write_step = !lcd->write_step;
+		if (!lcd->write_step) {
+			write_pixel16(lcd);
+		}
+	}
+}
+
 static int read_pixel(ColorLCD_t *lcd) {
 	int x = lcd->base.x % COLOR_LCD_WIDTH;
 	int y = lcd->base.y % COLOR_LCD_HEIGHT;
@@ -710,7 +765,8 @@ void ColorLCD_LCDreset(ColorLCD_t *lcd) {
 	lcd->base.reset = &ColorLCD_reset;
 	lcd->base.command = (devp)&ColorLCD_command;
 	lcd->base.data = (devp)&ColorLCD_data;
-	lcd->base.image = &ColorLCD_Image;
+	lcd->base.data_span = (devspan)&ColorLCD_data_span;
+	lcd->base.render_into = &ColorLCD_render_into;
 
 	lcd->base.width = COLOR_LCD_WIDTH;
 	lcd->base.display_width = COLOR_LCD_WIDTH;
@@ -904,28 +960,66 @@ static void draw_row(ColorLCD_t *lcd, uint8_t *dest, uint8_t* src,
 	}
 }
 
-uint8_t *ColorLCD_Image(LCDBase_t *lcdBase) {
+/*
+ * Copies a row drawn as RGB888 to dst in format
+ */
+static void store_row(uint8_t *dst, const uint8_t *row, LCD_PIXEL_FORMAT format) {
+	if (format == LCD_PIXEL_RGB888) {
+		if (dst != row) {
+			memcpy(dst, row, COLOR_LCD_WIDTH * COLOR_LCD_DEPTH);
+		}
+		return;
+	}
+
+	if (format == LCD_PIXEL_RGB565) {
+		uint16_t *pixel = (uint16_t *) dst;
+		for (int i = 0; i < COLOR_LCD_WIDTH; i++, row += COLOR_LCD_DEPTH) {
+			pixel[i] = (row[0] >> 3) << 11 | (row[1] >> 2) << 5 | row[2] >> 3;
+		}
+		return;
+	}
+
+	uint32_t *pixel = (uint32_t *) dst;
+	for (int i = 0; i < COLOR_LCD_WIDTH; i++, row += COLOR_LCD_DEPTH) {
+		pixel[i] = row[0] << 16 | row[1] << 8 | row[2];
+	}
+}
+
+/*
+ * Draws the displayed image into dst as RGB888, XRGB8888 or RGB565,
+ * COLOR_LCD_WIDTH by COLOR_LCD_HEIGHT pixels
+ */
+static BOOL ColorLCD_render_into(LCDBase_t *lcdBase, uint8_t *dst, size_t stride, LCD_PIXEL_FORMAT format) {
 	ColorLCD_t *lcd = (ColorLCD_t *)lcdBase;
-	uint8_t *buffer = (uint8_t *)malloc(COLOR_LCD_DISPLAY_SIZE);
-	ZeroMemory(buffer, COLOR_LCD_DISPLAY_SIZE);
+	uint8_t row[COLOR_LCD_WIDTH * COLOR_LCD_DEPTH];
 
 	int p1pos, p1start, p1end, p1width, p2pos, p2start, p2end, p2width;
 
+	if (format == LCD_PIXEL_GRAY8) {
+		return FALSE;
+	}
+
 	if (!lcdBase->active || !lcd->backlight_active) {
-		return buffer;
+		memset(row, 0, sizeof(row));
+		for (int i = 0; i < COLOR_LCD_HEIGHT; i++) {
+			store_row(dst + i * stride, row, format);
+		}
+		return TRUE;
 	}
 
 	if (lcd->panic_mode) {
 		// this is not exactly what happens in panic mode
 		// but the main point is you know you fucked up
+		memset(row, 0, sizeof(row));
+		for (int j = 0; j < COLOR_LCD_HEIGHT; j += 2) {
+			row[j * COLOR_LCD_DEPTH] = 0xFF;
+			row[j * COLOR_LCD_DEPTH + 1] = 0xFF;
+			row[j * COLOR_LCD_DEPTH + 2] = 0xFF;
+		}
 		for (int i = 0; i < COLOR_LCD_HEIGHT; i++) {
-			for (int j = 0; j < COLOR_LCD_HEIGHT; j += 2) {
-				buffer[PIXEL_OFFSET(j, i)] = 0xFF;
-				buffer[PIXEL_OFFSET(j, i) + 1] = 0xFF;
-				buffer[PIXEL_OFFSET(j, i) + 2] = 0xFF;
-			}
+			store_row(dst + i * stride, row, format);
 		}
-		return buffer;
+		return TRUE;
 	}
 
 	int start_x = LCD_REG_MASK(GATE_SCAN_CONTROL_REG, BASE_START_MASK) * 8;
@@ -1004,7 +1098,6 @@ uint8_t *ColorLCD_Image(LCDBase_t *lcdBase) {
 		p2pos = COLOR_LCD_WIDTH - (p2pos + p2width);
 	}
 
-	uint8_t *dest = buffer;
 	uint8_t *src = lcd->queued_image;
 
 	int imgpos1 = p2pos * COLOR_LCD_DEPTH;
@@ -1015,14 +1108,17 @@ uint8_t *ColorLCD_Image(LCDBase_t *lcdBase) {
 	int imgsize2 = p1width * COLOR_LCD_DEPTH;
 
 	for (int i = 0; i < COLOR_LCD_HEIGHT; i++) {
+		// RGB888 rows are drawn in place
+		uint8_t *dest = format == LCD_PIXEL_RGB888 ? dst + i * stride : row;
+		memset(dest, 0, sizeof(row));
 		draw_row(lcd, dest, src,
 			start_x, display_width,
 			imgpos1, imgoffs1, imgsize1,
 			imgpos2, imgoffs2, imgsize2);
+		store_row(dst + i * stride, dest, format);
 
-		dest += COLOR_LCD_WIDTH * COLOR_LCD_DEPTH;
 		src += COLOR_LCD_WIDTH * COLOR_LCD_DEPTH;
 	}
 
-	return buffer;
+	return TRUE;
 }
\ No newline at end of file
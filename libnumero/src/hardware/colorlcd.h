@@ -10,7 +10,7 @@
 #define COLOR_LCD_BUFFERS 3
 #define COLOR_LCD_DISPLAY_SIZE COLOR_LCD_WIDTH * COLOR_LCD_HEIGHT * COLOR_LCD_DEPTH
 #define MAX_BACKLIGHT_LEVEL 32
-#define BACKLIGHT_OFF_DELAY 0.002
+#define BACKLIGHT_OFF_DELAY CLOCK_MS(2)
 
 typedef struct ColorLCD {
 	LCDBase_t base;
@@ -23,9 +23,9 @@ typedef struct ColorLCD {
 
 	int front;
 
-	double last_draw;
+	uint64_t last_draw;
 	int draw_gate;
-	double line_time;
+	uint64_t line_time;
 	BOOL is_drawing;
 
 	BOOL panic_mode;
@@ -43,7 +43,7 @@ typedef struct ColorLCD {
 	int clock_divider;
 
 	BOOL backlight_active;
-	double backlight_off_elapsed;
+	uint64_t backlight_off_elapsed;
 } ColorLCD_t;
 
 ColorLCD_t *ColorLCD_init(CPU_t *cpu, int model);
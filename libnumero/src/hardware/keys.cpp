@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "keys.h"
+#include "device.h"
 
 #ifdef MACVER
 enum {
@@ -496,6 +497,8 @@ void keypad_press(CPU_t *cpu, int group, int bit)
 	if (group == KEYGROUP_ON && bit == KEYBIT_ON)
 	{
 		cpu->pio.keypad->on_pressed |= KEY_KEYBOARDPRESS;
+		// the ON latch is only checked when the interrupt device is polled
+		Reset_interrupt_schedule(cpu);
 	}
 	else
 	{
@@ -540,6 +543,7 @@ void keypad_release(CPU_t *cpu, int group, int bit)
 	if (group == KEYGROUP_ON && bit == KEYBIT_ON)
 	{
 		cpu->pio.keypad->on_pressed &= ~KEY_KEYBOARDPRESS;
+		Reset_interrupt_schedule(cpu);
 	}
 	else
 	{
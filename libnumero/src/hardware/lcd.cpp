@@ -1,6 +1,7 @@
 #include "stdafx.h"
 
 #include "lcd.h"
+#include "device.h"
 
 /* 
  * Differing interpretations of contrast require that
@@ -60,12 +61,14 @@ while ((CRD_TEST & (CRD_##zz##_MASK))==CRD_##zz) {LINECAT(A)
  */
 static void LCD_advance_cursor(LCD_t *);
 static void LCD_enqueue(CPU_t *cpu, LCD_t *lcd);
+static void LCD_count_gray(uint8_t *sum, unsigned int old_data, unsigned int data);
 static void LCD_free(CPU_t *);
 static void LCD_reset(CPU_t *);
 unsigned char *LCD_update_image(LCD_t *lcd);
-unsigned char* LCD_image(LCDBase_t *lcdBase);
+static BOOL LCD_render_into(LCDBase_t *lcdBase, uint8_t *dst, size_t stride, LCD_PIXEL_FORMAT format);
 static void LCD_command(CPU_t *cpu, device_t *dev);
 static void LCD_data(CPU_t *cpu, device_t *dev);
+static int LCD_data_span(CPU_t *cpu, device_t *dev, const uint8_t *src, int len, int spacing);
 
 #define NORMAL_DELAY 60		//tstates
 #define MICROSECONDS(xx) (((cpu->timer_c->freq * 10 / MHZ_6) * NORMAL_DELAY) / 10) + (xx - NORMAL_DELAY)
@@ -107,7 +110,8 @@ LCD_t* LCD_init(CPU_t* cpu, int model) {
 	lcd->base.reset = &LCD_reset;
 	lcd->base.command = (devp) &LCD_command;
 	lcd->base.data = (devp) &LCD_data;
-	lcd->base.image = &LCD_image;
+	lcd->base.data_span = (devspan) &LCD_data_span;
+	lcd->base.render_into = &LCD_render_into;
 	lcd->base.bytes_per_pixel = 1;
 	
 	set_model_baselevel(lcd, model);
@@ -123,7 +127,7 @@ LCD_t* LCD_init(CPU_t* cpu, int model) {
 	// Set all values to the defaults
 	lcd->shades = LCD_DEFAULT_SHADES;
 	lcd->mode = MODE_PERFECT_GRAY;
-	lcd->steady_frame = 1.0 / FPS;
+	lcd->steady_frame = CLOCK_HZ(FPS);
 	lcd->lcd_delay = NORMAL_DELAY;
 
 	if (lcd->shades > LCD_MAX_SHADES) {
@@ -132,13 +136,14 @@ LCD_t* LCD_init(CPU_t* cpu, int model) {
 		lcd->shades = LCD_DEFAULT_SHADES;
 	}
 
-	lcd->base.time = cpu->timer_c->elapsed;
-	lcd->base.ufps_last = cpu->timer_c->elapsed;
+	lcd->base.time = tc_clock(cpu->timer_c);
+	lcd->base.ufps_last = tc_clock(cpu->timer_c);
 	lcd->base.ufps = 0.0f;
-	lcd->base.lastgifframe = cpu->timer_c->elapsed;
-	lcd->base.lastaviframe = cpu->timer_c->elapsed;
-	lcd->base.write_avg = 0.0f;
-	lcd->base.write_last = cpu->timer_c->elapsed;
+	lcd->base.lastgifframe = tc_clock(cpu->timer_c);
+	lcd->base.lastaviframe = tc_clock(cpu->timer_c);
+	lcd->base.write_avg = 0;
+	lcd->base.write_last = tc_clock(cpu->timer_c);
+	LCD_rebuild_gray(lcd);
 	return lcd;
 }
 
@@ -160,6 +165,7 @@ static void LCD_reset(CPU_t *cpu) {
 	
 	lcd->front = 0;
 	memset(lcd->queue, 0, sizeof(lcd->queue[0]) * LCD_MAX_SHADES);
+	LCD_rebuild_gray(lcd);
 }
 
 /* 
@@ -257,12 +263,12 @@ static void LCD_data(CPU_t *cpu, device_t *dev) {
 
 	if (cpu->output) {
 		// Run some sanity checks on the write vars
-		if (lcd->base.write_last > cpu->timer_c->elapsed)
-			lcd->base.write_last = cpu->timer_c->elapsed;
+		if (lcd->base.write_last > tc_clock(cpu->timer_c))
+			lcd->base.write_last = tc_clock(cpu->timer_c);
 
-		double write_delay = cpu->timer_c->elapsed - lcd->base.write_last;
-		if (lcd->base.write_avg == 0.0) lcd->base.write_avg = write_delay;
-		lcd->base.write_last = cpu->timer_c->elapsed;
+		uint64_t write_delay = tc_clock(cpu->timer_c) - lcd->base.write_last;
+		if (lcd->base.write_avg == 0) lcd->base.write_avg = write_delay;
+		lcd->base.write_last = tc_clock(cpu->timer_c);
 		lcd->base.last_tstate = cpu->timer_c->tstates;
 	
 		// If there is a delay that is significantly longer than the
@@ -272,23 +278,23 @@ static void LCD_data(CPU_t *cpu, device_t *dev) {
 		
 		// If you are in steady mode, then this simply serves as a
 		// FPS calculator
-		if (write_delay < lcd->base.write_avg * 100.0) {
-			lcd->base.write_avg = (lcd->base.write_avg * 0.90) + (write_delay * 0.10);
+		if (write_delay < lcd->base.write_avg * 100) {
+			lcd->base.write_avg = (lcd->base.write_avg * 9 + write_delay) / 10;
 		} else {
-			double ufps_length = cpu->timer_c->elapsed - lcd->base.ufps_last;
-			lcd->base.ufps = 1.0 / ufps_length;
-			lcd->base.ufps_last = cpu->timer_c->elapsed;
+			uint64_t ufps_length = tc_clock(cpu->timer_c) - lcd->base.ufps_last;
+			lcd->base.ufps = (double) TIMER_CLOCK_RATE / ufps_length;
+			lcd->base.ufps_last = tc_clock(cpu->timer_c);
 			
 			if (lcd->mode == MODE_PERFECT_GRAY) {
 				LCD_enqueue(cpu, lcd);
-				lcd->base.time = cpu->timer_c->elapsed;
+				lcd->base.time = tc_clock(cpu->timer_c);
 			}
 		}
 		
 		if (lcd->mode == MODE_GAME_GRAY) {
 			if ((lcd->base.x == 0) && (lcd->base.y == 0)) {
 				LCD_enqueue(cpu, lcd);
-				lcd->base.time = cpu->timer_c->elapsed;
+				lcd->base.time = tc_clock(cpu->timer_c);
 			}
 		}
 
@@ -321,25 +327,49 @@ static void LCD_data(CPU_t *cpu, device_t *dev) {
 	}
 	
 	// Make sure timers are valid
-	if (lcd->base.time > cpu->timer_c->elapsed)
-		lcd->base.time = cpu->timer_c->elapsed;
+	if (lcd->base.time > tc_clock(cpu->timer_c))
+		lcd->base.time = tc_clock(cpu->timer_c);
 	
-	else if (cpu->timer_c->elapsed - lcd->base.time > (2.0 / STEADY_FREQ_MIN))
-		lcd->base.time = cpu->timer_c->elapsed - (2.0 / STEADY_FREQ_MIN);
+	else if (tc_clock(cpu->timer_c) - lcd->base.time > CLOCK_HZ(STEADY_FREQ_MIN) * 2)
+		lcd->base.time = tc_clock(cpu->timer_c) - CLOCK_HZ(STEADY_FREQ_MIN) * 2;
 	
 	// Perfect gray mode should time out too in case the screen update rate is too slow for
 	// proper grayscale (essentially a fallback on steady freq)
 	if (lcd->mode == MODE_PERFECT_GRAY || lcd->mode == MODE_GAME_GRAY) {	
-		if ((cpu->timer_c->elapsed - lcd->base.time) >= (1.0 / STEADY_FREQ_MIN)) {
+		if ((tc_clock(cpu->timer_c) - lcd->base.time) >= CLOCK_HZ(STEADY_FREQ_MIN)) {
 			LCD_enqueue(cpu, lcd);
-			lcd->base.time += (1.0 / STEADY_FREQ_MIN);
+			lcd->base.time += CLOCK_HZ(STEADY_FREQ_MIN);
 		}
 	} else if (lcd->mode == MODE_STEADY) {
-		if ((cpu->timer_c->elapsed - lcd->base.time) >= lcd->steady_frame) {
+		if ((tc_clock(cpu->timer_c) - lcd->base.time) >= lcd->steady_frame) {
 			LCD_enqueue(cpu, lcd);
 			lcd->base.time += lcd->steady_frame;
 		}
 	}
+
+	// Nothing else happens until the next frame is due
+	if (lcd->mode == MODE_PERFECT_GRAY || lcd->mode == MODE_GAME_GRAY) {
+		Schedule_interrupt_device(dev, clock_to_tstates(cpu, lcd->base.time + CLOCK_HZ(STEADY_FREQ_MIN)));
+	} else if (lcd->mode == MODE_STEADY) {
+		Schedule_interrupt_device(dev, clock_to_tstates(cpu, lcd->base.time + lcd->steady_frame));
+	} else {
+		Schedule_interrupt_device(dev, NO_DEVICE_EVENT);
+	}
+}
+
+/*
+ * Output of a span to the LCD data port, one byte every spacing tstates.
+ * Every byte still goes through LCD_data, so the ones written while the
+ * driver is busy (lcd_delay) are dropped like before.
+ */
+static int LCD_data_span(CPU_t *cpu, device_t *dev, const uint8_t *src, int len, int spacing) {
+	for (int i = 0; i < len; i++) {
+		tc_add(cpu->timer_c, spacing);
+		cpu->bus = src[i];
+		cpu->output = TRUE;
+		LCD_data(cpu, dev);
+	}
+	return len;
 }
 
 /* 
@@ -376,13 +406,26 @@ static void LCD_advance_cursor(LCD_t *lcd) {
  * Add a black and white LCD image to the LCD grayscale queue
  */
 static void LCD_enqueue(CPU_t *cpu, LCD_t *lcd) {
+	if (lcd->gray_shades != lcd->shades) {
+		LCD_rebuild_gray(lcd);
+	}
 
 	if (lcd->front == 0) lcd->front = lcd->shades;
 	lcd->front--;
 	
-	for (int i = 0; i < LCD_HEIGHT; i++)
-		for (int j = 0; j < LCD_MEM_WIDTH; j++)
-			lcd->queue[lcd->front][LCD_OFFSET(j, i, LCD_HEIGHT - lcd->base.z)] = lcd->display[LCD_OFFSET(j, i, 0)];
+	// the replaced frame leaves gray_sum as the new one enters it
+	uint8_t *frame = lcd->queue[lcd->front];
+	for (int i = 0; i < LCD_HEIGHT; i++) {
+		for (int j = 0; j < LCD_MEM_WIDTH; j++) {
+			int offset = LCD_OFFSET(j, i, LCD_HEIGHT - lcd->base.z);
+			uint8_t data = lcd->display[LCD_OFFSET(j, i, 0)];
+			if (frame[offset] != data) {
+				LCD_count_gray(&lcd->gray_sum[offset * 8], frame[offset], data);
+				frame[offset] = data;
+				lcd->image_dirty = TRUE;
+			}
+		}
+	}
 
 	if (cpu->lcd_enqueue_callback != NULL) {
 		cpu->lcd_enqueue_callback(cpu);
@@ -396,6 +439,32 @@ static void LCD_enqueue(CPU_t *cpu, LCD_t *lcd) {
 }
 
 
+/*
+ * Moves the 8 pixels of a queue byte from old_data to data in gray_sum
+ */
+static void LCD_count_gray(uint8_t *sum, unsigned int old_data, unsigned int data) {
+	for (int i = 7; i >= 0; i--) {
+		sum[i] += (data & 1) - (old_data & 1);
+		data >>= 1;
+		old_data >>= 1;
+	}
+}
+
+/*
+ * Counts gray_sum again, for when the queue or the number of shades
+ * changed without going through LCD_enqueue
+ */
+void LCD_rebuild_gray(LCD_t *lcd) {
+	memset(lcd->gray_sum, 0, GRAY_DISPLAY_SIZE);
+	for (unsigned int i = 0; i < lcd->shades && i < LCD_MAX_SHADES; i++) {
+		for (int offset = 0; offset < DISPLAY_SIZE; offset++) {
+			LCD_count_gray(&lcd->gray_sum[offset * 8], 0, lcd->queue[i][offset]);
+		}
+	}
+	lcd->gray_shades = lcd->shades;
+	lcd->image_dirty = TRUE;
+}
+
 /*
  * Clear the LCD's display, including all grayscale buffers
  */
@@ -403,20 +472,16 @@ void LCD_clear(LCD_t *lcd) {
 	int i;
 	for (i = 0; i < LCD_MAX_SHADES; i++) 
 		memset(lcd->queue[i], 0x00, DISPLAY_SIZE);
+	LCD_rebuild_gray(lcd);
 }
 
-//Neil - reuse screen instead of calling malloc every frame
-unsigned char* screen = NULL;
-bool screen_allocated = false;
-
 unsigned char *LCD_update_image(LCD_t *lcd) {
-	if (!screen_allocated)
-	{
-		screen = (unsigned char*)malloc(GRAY_DISPLAY_SIZE);
-		ZeroMemory(screen, GRAY_DISPLAY_SIZE);
-		screen_allocated = true;
+	if (lcd->gray_shades != lcd->shades) {
+		LCD_rebuild_gray(lcd);
+	}
+	if (!lcd->image_dirty && lcd->image_contrast == lcd->base.contrast) {
+		return lcd->screen;
 	}
-	
 
 	int bits = 0;
 	int n = lcd->shades;
@@ -441,51 +506,67 @@ unsigned char *LCD_update_image(LCD_t *lcd) {
 	int alpha_overlay = (alpha * contrast_color / 100);
 	int inverse_alpha = 100 - alpha;
 
-	unsigned int row, col;
-	for (row = 0; row < LCD_HEIGHT; row++) {
-		for (col = 0; col < LCD_MEM_WIDTH; col++) {
-			unsigned int p0 = 0, p1 = 0, p2 = 0, p3 = 0, p4 = 0, p5 = 0, p6 = 0, p7 = 0;
-			unsigned int i;
-			
-			for (i = 0; i < lcd->shades; i++) {
-				unsigned int u = lcd->queue[i][row * LCD_MEM_WIDTH + col];
-				p7 += u & 1; u >>= 1;
-				p6 += u & 1; u >>= 1;
-				p5 += u & 1; u >>= 1;
-				p4 += u & 1; u >>= 1;
-				p3 += u & 1; u >>= 1;
-				p2 += u & 1; u >>= 1;
-				p1 += u & 1; u >>= 1;
-				p0 += u;
-			}
-			
-			unsigned char *scol = &screen[row * LCD_WIDTH + col * 8];
-			scol[0] = (unsigned char)(alpha_overlay + TRUCOLOR(p0, bits) * inverse_alpha / 100);
-			scol[1] = (unsigned char)(alpha_overlay + TRUCOLOR(p1, bits) * inverse_alpha / 100);
-			scol[2] = (unsigned char)(alpha_overlay + TRUCOLOR(p2, bits) * inverse_alpha / 100);
-			scol[3] = (unsigned char)(alpha_overlay + TRUCOLOR(p3, bits) * inverse_alpha / 100);
-			scol[4] = (unsigned char)(alpha_overlay + TRUCOLOR(p4, bits) * inverse_alpha / 100);
-			scol[5] = (unsigned char)(alpha_overlay + TRUCOLOR(p5, bits) * inverse_alpha / 100);
-			scol[6] = (unsigned char)(alpha_overlay + TRUCOLOR(p6, bits) * inverse_alpha / 100);
-			scol[7] = (unsigned char)(alpha_overlay + TRUCOLOR(p7, bits) * inverse_alpha / 100);
-		}
+	// gray_sum holds how many of the queued frames had each pixel set
+	unsigned char level[LCD_MAX_SHADES + 1];
+	unsigned int i;
+	for (i = 0; i <= LCD_MAX_SHADES; i++) {
+		level[i] = (unsigned char)(alpha_overlay + TRUCOLOR(i, bits) * inverse_alpha / 100);
+	}
+
+	for (i = 0; i < GRAY_DISPLAY_SIZE; i++) {
+		lcd->screen[i] = level[lcd->gray_sum[i]];
 	}
 
-	return screen;
+	lcd->image_dirty = FALSE;
+	lcd->image_contrast = lcd->base.contrast;
+	return lcd->screen;
 }
 
 /* 
  * Generate a grayscale image from the black and white images
- * pushed to the queue.  If there are no images in the queue,
- * the generated image will be blank
+ * pushed to the queue and write it to dst, LCD_WIDTH by LCD_HEIGHT
+ * pixels. If the LCD is off the image is blank
  */
-unsigned char* LCD_image(LCDBase_t *lcdBase) {
+static BOOL LCD_render_into(LCDBase_t *lcdBase, uint8_t *dst, size_t stride, LCD_PIXEL_FORMAT format) {
 	LCD_t *lcd = (LCD_t *)lcdBase;
-	if (lcdBase->active == FALSE) {
-		unsigned char *screen = (unsigned char *)malloc(GRAY_DISPLAY_SIZE);
-		ZeroMemory(screen, GRAY_DISPLAY_SIZE);
-		return screen;
+	const uint8_t *screen = NULL;
+	if (lcdBase->active) {
+		screen = LCD_update_image(lcd);
+	}
+
+	for (int row = 0; row < LCD_HEIGHT; row++, dst += stride) {
+		const uint8_t *src = screen ? screen + row * LCD_WIDTH : NULL;
+		int col;
+		switch (format) {
+		case LCD_PIXEL_GRAY8:
+			if (screen) {
+				memcpy(dst, src, LCD_WIDTH);
+			} else {
+				memset(dst, 0, LCD_WIDTH);
+			}
+			break;
+		case LCD_PIXEL_RGB888:
+			for (col = 0; col < LCD_WIDTH; col++) {
+				uint8_t shade = screen ? 0xFF - src[col] : 0xFF;
+				dst[col * 3] = dst[col * 3 + 1] = dst[col * 3 + 2] = shade;
+			}
+			break;
+		case LCD_PIXEL_XRGB8888:
+			for (col = 0; col < LCD_WIDTH; col++) {
+				uint32_t shade = screen ? 0xFF - src[col] : 0xFF;
+				((uint32_t *) dst)[col] = shade * 0x010101;
+			}
+			break;
+		case LCD_PIXEL_RGB565:
+			for (col = 0; col < LCD_WIDTH; col++) {
+				uint16_t shade = screen ? 0xFF - src[col] : 0xFF;
+				((uint16_t *) dst)[col] = (shade >> 3) << 11 | (shade >> 2) << 5 | shade >> 3;
+			}
+			break;
+		default:
+			return FALSE;
+		}
 	}
 
-	return LCD_update_image(lcd);
+	return TRUE;
 }
\ No newline at end of file
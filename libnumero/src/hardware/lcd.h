@@ -58,6 +58,17 @@ typedef enum _LCD_MODE {
 } LCD_MODE;
 
 
+/*
+ * Pixel layouts render_into can write. GRAY8 is the mono LCD's shade,
+ * 0 being blank, the others are colors as shown.
+ */
+typedef enum _LCD_PIXEL_FORMAT {
+	LCD_PIXEL_GRAY8 = 0,
+	LCD_PIXEL_RGB888,
+	LCD_PIXEL_XRGB8888,
+	LCD_PIXEL_RGB565,
+} LCD_PIXEL_FORMAT;
+
 /* Main structure describing all attributes specific to one LCD,
  * additionally calculation buffers (such as screen) are stored
  * here to prevent thread related issues with a static buffer
@@ -65,9 +76,10 @@ typedef enum _LCD_MODE {
 typedef struct LCDBase {
 	void(*free)(CPU_t *);					// Function to free this aux
 	void(*reset)(CPU_t *);					// Reset lcd function
-	uint8_t *(*image)(struct LCDBase *);	// Generate image function
+	BOOL(*render_into)(struct LCDBase *, uint8_t *, size_t, LCD_PIXEL_FORMAT);	// Draw image into a buffer, rows stride bytes apart
 	devp command;							// Port 10 function
 	devp data;								// Port 11 function
+	devspan data_span;						// Port 11 function for a span of writes
 	BOOL active;							// TRUE = on, FALSE = off
 	unsigned int x, y, z;							// LCD cursors
 	unsigned int contrast;							// 0 to 39 or 31
@@ -75,12 +87,13 @@ typedef struct LCDBase {
 	int width;
 	int display_width;
 	int height;
-	double ufps, ufps_last;					// User frames per second
-	double write_avg, write_last;			// Used to determine freq. of writes to the LCD
-	double time;							// Last lcd update in seconds
+	double ufps;							// User frames per second
+	uint64_t ufps_last;
+	uint64_t write_avg, write_last;			// Used to determine freq. of writes to the LCD
+	uint64_t time;							// Last lcd update on the hardware clock
 	long long last_tstate;					// timer_c->tstate of the last write
-	double lastgifframe;
-	double lastaviframe;
+	uint64_t lastgifframe;
+	uint64_t lastaviframe;
 	int bytes_per_pixel;
 } LCDBase_t;
 
@@ -95,13 +108,19 @@ typedef struct LCD {
 	int front;
 	uint8_t queue[LCD_MAX_SHADES][DISPLAY_SIZE];	// holds previous buffers for grey
 	unsigned int shades;					// number of shades of grey
+	uint8_t gray_sum[GRAY_DISPLAY_SIZE];	// per pixel count of set bits in queue[0..shades)
+	unsigned int gray_shades;				// shades gray_sum was counted over
+	BOOL image_dirty;						// gray_sum changed since the last image
+	unsigned int image_contrast;			// contrast of the last image
+	uint8_t screen[GRAY_DISPLAY_SIZE];		// last image made from gray_sum
 	LCD_MODE mode;					// Mode of LCD rendering
-	double steady_frame;			// Length of a steady frame in seconds
+	uint64_t steady_frame;			// Length of a steady frame in clock ticks
 	uint16_t screen_addr;			// mem mapped screen address
 } LCD_t;
 
 /* Device functions */
 LCD_t* LCD_init(CPU_t *, int);
 void set_model_baselevel(LCD_t *lcd, int model);
+void LCD_rebuild_gray(LCD_t *lcd);
 
 #endif /* #ifndef LCD_H */
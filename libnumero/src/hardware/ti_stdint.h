@@ -5,19 +5,11 @@
 
 typedef struct STDINT {
 	unsigned char intactive;
-#ifdef NO_TIMER_ELAPSED
 	uint64_t lastchk1;
 	uint64_t timermax1;
 	uint64_t lastchk2;
 	uint64_t timermax2;
 	uint64_t freq[4];
-#else
-	double lastchk1;
-	double timermax1;
-	double lastchk2;
-	double timermax2;
-	double freq[4];
-#endif
 	unsigned char mem;
 	unsigned char xy;	
 	BOOL on_backup;
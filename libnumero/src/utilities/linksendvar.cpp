@@ -2,6 +2,7 @@
 
 #include "linksendvar.h"
 #include "keys.h"
+#include "device.h"
 #include "state.h"
 
 extern jmp_buf exc_pkt;
@@ -20,8 +21,10 @@ LINK_ERR link_send_backup(CPU_t *cpu, TIFILE_t *tifile) {
 	if (!cpu->pio.lcd->active) {
 		link_wait(cpu, MHZ_6);
 		cpu->pio.keypad->on_pressed |= KEY_FALSEPRESS;
+		Reset_interrupt_schedule(cpu);
 		link_wait(cpu, MHZ_6 / 2);
 		cpu->pio.keypad->on_pressed &= ~KEY_FALSEPRESS;
+		Reset_interrupt_schedule(cpu);
 		link_wait(cpu, MHZ_6);
 
 		if (!cpu->pio.lcd->active)
@@ -188,8 +191,10 @@ LINK_ERR link_send_var(CPU_t *cpu, TIFILE_t *tifile, SEND_FLAG dest) {
 	if (!cpu->pio.lcd->active) {
 		link_wait(cpu, cpu->timer_c->freq);
 		cpu->pio.keypad->on_pressed |= KEY_FALSEPRESS;
+		Reset_interrupt_schedule(cpu);
 		link_wait(cpu, cpu->timer_c->freq / 2);
 		cpu->pio.keypad->on_pressed &= ~KEY_FALSEPRESS;
+		Reset_interrupt_schedule(cpu);
 		link_wait(cpu, cpu->timer_c->freq);
 
 		if (!cpu->pio.lcd->active)
@@ -199,6 +204,8 @@ LINK_ERR link_send_var(CPU_t *cpu, TIFILE_t *tifile, SEND_FLAG dest) {
 	// Here's some code to temporarily pass off the apps
 	// to a send app function
 	if (tifile->type == FLASH_TYPE) {
+		// these write straight into flash
+		set_flash_dirty(cpu->mem_c, 0, cpu->mem_c->flash_size);
 		switch (tifile->flash->type) {
 		case FLASH_TYPE_OS:
 			return forceload_os(cpu, tifile);
@@ -675,6 +682,7 @@ static LINK_ERR forceload_app(CPU_t *cpu, TIFILE_t *tifile) {
 		// -8 is for the start of user mem
 		cpu->mem_c->protected_page[i / 8] &= ~(1 << (i % 8));
 	}
+	update_page_table(cpu->mem_c);
 
 	return LERR_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "stdafx.h"
+
+#include "lz.h"
+
+#define LZ_HASH_BITS	14
+#define LZ_MIN_MATCH	4
+#define LZ_MAX_OFFSET	0xFFFF
+// the end of a block is always literals, so the decoder never overruns
+#define LZ_LAST_LITERALS	5
+#define LZ_MATCH_LIMIT	12
+
+static inline uint32_t read32(const unsigned char *pnt) {
+	uint32_t value;
+	memcpy(&value, pnt, sizeof(value));
+	return value;
+}
+
+static inline uint64_t read64(const unsigned char *pnt) {
+	uint64_t value;
+	memcpy(&value, pnt, sizeof(value));
+	return value;
+}
+
+static inline void write64(unsigned char *pnt, uint64_t value) {
+	memcpy(pnt, &value, sizeof(value));
+}
+
+// copies length bytes 8 at a time, the caller makes sure 8 more fit
+static inline void lz_wild_copy(unsigned char *dst, const unsigned char *src, int length) {
+	unsigned char *end = dst + length;
+	do {
+		write64(dst, read64(src));
+		dst += 8;
+		src += 8;
+	} while (dst < end);
+}
+
+static inline int lz_hash(uint32_t value) {
+	return (int) ((value * 2654435761U) >> (32 - LZ_HASH_BITS));
+}
+
+static unsigned char *lz_write_length(unsigned char *op, int length) {
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (unsigned char) length;
+	return op;
+}
+
+static unsigned char *lz_write_sequence(unsigned char *op, const unsigned char *literals, int literal_length, int match_length) {
+	unsigned char *token = op++;
+	*token = (unsigned char) ((literal_length < 15 ? literal_length : 15) << 4);
+	if (literal_length >= 15) {
+		op = lz_write_length(op, literal_length - 15);
+	}
+	if (literal_length > 0) {
+		memcpy(op, literals, literal_length);
+		op += literal_length;
+	}
+	if (match_length >= 0) {
+		*token |= match_length < 15 ? match_length : 15;
+	}
+	return op;
+}
+
+int lz_compress(const unsigned char *src, int size, unsigned char *dst, int capacity, int level) {
+	if (capacity < lz_bound(size)) {
+		return 0;
+	}
+	if (level < LZ_MIN_LEVEL) {
+		level = LZ_MIN_LEVEL;
+	} else if (level > LZ_MAX_LEVEL) {
+		level = LZ_MAX_LEVEL;
+	}
+
+	// positions are stored plus one, zero is an empty slot
+	static int table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	const unsigned char *ip = src;
+	const unsigned char *anchor = src;
+	const unsigned char *end = src + size;
+	// too short to hold a match, the limits stay inside the buffer
+	const unsigned char *match_end = size >= LZ_MATCH_LIMIT ? end - LZ_LAST_LITERALS : src;
+	const unsigned char *limit = size >= LZ_MATCH_LIMIT ? end - LZ_MATCH_LIMIT : src;
+	unsigned char *op = dst;
+	// each miss in a row moves the search on a little further
+	const int skip_shift = level + 2;
+	int misses = 0;
+
+	while (ip < limit) {
+		uint32_t sequence = read32(ip);
+		int hash = lz_hash(sequence);
+		int candidate = table[hash] - 1;
+		table[hash] = (int) (ip - src) + 1;
+		if (candidate < 0 || (ip - src) - candidate > LZ_MAX_OFFSET || read32(src + candidate) != sequence) {
+			ip += (misses++ >> skip_shift) + 1;
+			continue;
+		}
+
+		const unsigned char *ref = src + candidate;
+
+		while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+			ip--;
+			ref--;
+		}
+		const unsigned char *mp = ip + LZ_MIN_MATCH;
+		const unsigned char *rp = ref + LZ_MIN_MATCH;
+		while (mp + 8 <= match_end && read64(mp) == read64(rp)) {
+			mp += 8;
+			rp += 8;
+		}
+		while (mp < match_end && *mp == *rp) {
+			mp++;
+			rp++;
+		}
+
+		int match_length = (int) (mp - ip) - LZ_MIN_MATCH;
+		op = lz_write_sequence(op, anchor, (int) (ip - anchor), match_length);
+		int offset = (int) (ip - ref);
+		*op++ = offset & 0xFF;
+		*op++ = offset >> 8;
+		if (match_length >= 15) {
+			op = lz_write_length(op, match_length - 15);
+		}
+
+		ip = mp;
+		anchor = ip;
+		misses = 0;
+		if (ip < limit) {
+			table[lz_hash(read32(ip - 2))] = (int) (ip - 2 - src) + 1;
+		}
+	}
+
+	op = lz_write_sequence(op, anchor, (int) (end - anchor), -1);
+	return (int) (op - dst);
+}
+
+int lz_decompress(const unsigned char *src, int size, unsigned char *dst, int capacity) {
+	const unsigned char *ip = src;
+	const unsigned char *end = src + size;
+	unsigned char *op = dst;
+	unsigned char *op_end = dst + capacity;
+
+	while (ip < end) {
+		int token = *ip++;
+		int length = token >> 4;
+		if (length == 15) {
+			int extra;
+			do {
+				// no valid length is past capacity, stop before it overflows
+				if (ip >= end || length > capacity) {
+					return -1;
+				}
+				extra = *ip++;
+				length += extra;
+			} while (extra == 255);
+		}
+		if (length > end - ip || length > op_end - op) {
+			return -1;
+		}
+		if (length + 8 <= end - ip && length + 8 <= op_end - op) {
+			lz_wild_copy(op, ip, length);
+		} else {
+			memcpy(op, ip, length);
+		}
+		ip += length;
+		op += length;
+		if (ip == end) {
+			break;
+		}
+
+		if (end - ip < 2) {
+			return -1;
+		}
+		int offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > op - dst) {
+			return -1;
+		}
+		length = (token & 0x0F);
+		if (length == 15) {
+			int extra;
+			do {
+				// no valid length is past capacity, stop before it overflows
+				if (ip >= end || length > capacity) {
+					return -1;
+				}
+				extra = *ip++;
+				length += extra;
+			} while (extra == 255);
+		}
+		length += LZ_MIN_MATCH;
+		if (length > op_end - op) {
+			return -1;
+		}
+
+		// the match may overlap what it writes, copy it a period at a time
+		const unsigned char *match = op - offset;
+		if (offset >= 8 && length + 8 <= op_end - op) {
+			lz_wild_copy(op, match, length);
+			op += length;
+			continue;
+		}
+		while (length > 0) {
+			int count = (int) (op - match) < length ? (int) (op - match) : length;
+			memcpy(op, match, count);
+			op += count;
+			length -= count;
+		}
+	}
+	return (int) (op - dst);
+}
@@ -0,0 +1,22 @@
+#ifndef LZ_H
+#define LZ_H
+
+/*
+ * Byte oriented LZ77 codec in the style of LZ4 blocks, used for savestate
+ * chunks. Sequences are a token (literal length << 4 | match length - 4),
+ * the literals, then a 16 bit offset. Lengths of 15 or more continue in
+ * bytes of 255.
+ */
+
+#define LZ_MIN_LEVEL	1
+#define LZ_MAX_LEVEL	9
+
+// worst case size of compressing size bytes
+#define lz_bound(size) ((size) + (size) / 255 + 16)
+
+// level 1 is the fastest, 9 gives up on incompressible data the slowest
+int lz_compress(const unsigned char *src, int size, unsigned char *dst, int capacity, int level);
+// returns the decompressed size, or -1 if src is corrupt or does not fit
+int lz_decompress(const unsigned char *src, int size, unsigned char *dst, int capacity);
+
+#endif
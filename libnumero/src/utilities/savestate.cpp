@@ -3,14 +3,14 @@
 #include "corecalc.h"
 #include "83psehw.h"
 #include "link.h"
+#include "device.h"
 #include "calc.h"
 #include "fileutilities.h"
 #include "savestate.h"
+#include "lz.h"
 
 #include <streams/file_stream.h>
 
-extern int def(FILE *source, FILE *dest, int level);
-extern int inf(FILE *source, FILE *dest);
 #ifdef _ANDROID
 extern char cache_dir[MAX_PATH];
 #endif
@@ -158,6 +158,7 @@ CHUNK_t* NewChunk(SAVESTATE_t* save, const char* tag) {
 	save->chunks[chunk]->tag[2]	= tag[2];
 	save->chunks[chunk]->tag[3]	= tag[3];
 	save->chunks[chunk]->size	= 0;
+	save->chunks[chunk]->alloc	= 0;
 	save->chunks[chunk]->data	= NULL;
 	save->chunks[chunk]->pnt	= 0;
 	save->chunk_count++;
@@ -192,141 +193,124 @@ void CheckPNT(CHUNK_t* chunk) {
 	}
 }
 
+/************************************************************************
+ * Grows the chunk by length bytes and returns where they start. The
+ * buffer at least doubles each time it is reallocated, so writing a
+ * chunk field by field stays linear.
+ ************************************************************************/
+unsigned char *ExtendChunk(CHUNK_t* chunk, int length) {
+	if (chunk->size + length > chunk->alloc) {
+		int alloc = chunk->alloc * 2;
+		if (alloc < chunk->size + length) {
+			alloc = chunk->size + length;
+		}
+		if (alloc < MIN_CHUNK_ALLOC) {
+			alloc = MIN_CHUNK_ALLOC;
+		}
+		unsigned char *tmppnt = (unsigned char *) realloc(chunk->data, alloc);
+		if (tmppnt == NULL) {
+			_putts(_T("Error could not realloc data"));
+			return NULL;
+		}
+		chunk->data = tmppnt;
+		chunk->alloc = alloc;
+	}
+
+	unsigned char *pnt = chunk->data + chunk->size;
+	chunk->size += length;
+	return pnt;
+}
+
+static void PutValue(unsigned char *dest, const void *value, int length) {
+#ifdef __BIG_ENDIAN__
+	const unsigned char *pnt = (const unsigned char *) value + length;
+	for (int i = 0; i < length; i++) {
+		dest[i] = *--pnt;
+	}
+#else
+	memcpy(dest, value, length);
+#endif
+}
+
 BOOL WriteChar(CHUNK_t* chunk, char value) {
-	unsigned char * tmppnt;
-	tmppnt = (unsigned char *) realloc(chunk->data, chunk->size + sizeof(char));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-	chunk->data[chunk->size] = value;
-	chunk->size += sizeof(char);
+	*pnt = value;
 	return TRUE;
 }
 
-
 BOOL WriteShort(CHUNK_t* chunk, uint16_t value) {
-	int i;
-	unsigned char  *tmppnt;
-	unsigned char  *pnt = (unsigned char *)(&value);
-	tmppnt = (unsigned char *) realloc(chunk->data,chunk->size + sizeof(value));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-#ifdef __BIG_ENDIAN__
-	for(i=sizeof(value)-1;i>=0;i--) {
-#else
-	for(i=0;i<sizeof(value);i++) {
-#endif	
-		chunk->data[i+chunk->size] = *pnt++;
-	}
-	chunk->size += sizeof(value);
+	PutValue(pnt, &value, sizeof(value));
 	return TRUE;
 }
+
 BOOL WriteInt(CHUNK_t* chunk, uint32_t value) {
-	int i;
-	unsigned char *tmppnt;
-	unsigned char *pnt = (unsigned char *)(&value);
-	tmppnt = (unsigned char *) realloc(chunk->data,chunk->size + sizeof(value));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-#ifdef __BIG_ENDIAN__
-	for(i=sizeof(value)-1;i>=0;i--) {
-#else
-	for(i = 0;i < sizeof(value); i++) {
-#endif
-		chunk->data[i+chunk->size] = *pnt++;
-	}
-	chunk->size += sizeof(uint32_t);
+	PutValue(pnt, &value, sizeof(value));
 	return TRUE;
 }
 
 BOOL WriteLong(CHUNK_t* chunk, uint64_t value) {
-	int i;
-	unsigned char *tmppnt;
-	unsigned char *pnt = (unsigned char *)(&value);
-	tmppnt = (unsigned char  *) realloc(chunk->data, chunk->size + sizeof(value));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-#ifdef __BIG_ENDIAN__
-	for(i=sizeof(value)-1;i>=0;i--) {
-#else
-	for(i = 0; i < sizeof(value); i++) {
-#endif
-		chunk->data[i+chunk->size] = *pnt++;
-	}
-	chunk->size += sizeof(value);
+	PutValue(pnt, &value, sizeof(value));
 	return TRUE;
 }
 
 BOOL WriteFloat(CHUNK_t* chunk, float value) {
-	int i;
-	unsigned char *tmppnt;
-	unsigned char *pnt = (unsigned char *)(&value);
-	tmppnt = (unsigned char *) realloc(chunk->data,chunk->size + sizeof(value));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-#ifdef __BIG_ENDIAN__
-	for(i=sizeof(value)-1;i>=0;i--) {
-#else
-	for(i = 0; i < sizeof(value); i++) {
-#endif
-		chunk->data[i+chunk->size] = *pnt++;
-	}
-	chunk->size += sizeof(value);
+	PutValue(pnt, &value, sizeof(value));
 	return TRUE;
-}	
+}
+
 BOOL WriteDouble(CHUNK_t* chunk, double value) {
-	int i;
-	unsigned char *tmppnt;
-	unsigned char *pnt = (unsigned char *)(&value);
-	tmppnt = (unsigned char *) realloc(chunk->data,chunk->size + sizeof(value));
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *pnt = ExtendChunk(chunk, sizeof(value));
+	if (pnt == NULL) {
+		return FALSE;
+	}
+	PutValue(pnt, &value, sizeof(value));
+	return TRUE;
+}
+
+/* Same as count WriteInt calls */
+BOOL WriteIntBlock(CHUNK_t* chunk, const uint32_t *values, int count) {
+	unsigned char *pnt = ExtendChunk(chunk, count * sizeof(uint32_t));
+	if (pnt == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
 #ifdef __BIG_ENDIAN__
-	for(i=sizeof(value)-1;i>=0;i--) {
+	for (int i = 0; i < count; i++) {
+		PutValue(pnt + i * sizeof(uint32_t), &values[i], sizeof(uint32_t));
+	}
 #else
-	for(i = 0;i < sizeof(value); i++) {
+	memcpy(pnt, values, count * sizeof(uint32_t));
 #endif
-		chunk->data[i+chunk->size] = *pnt++;
-	}
-	chunk->size += sizeof(value);
 	return TRUE;
 }
 
 BOOL WriteBlock(CHUNK_t* chunk, unsigned char *pnt, int length) {
-	int i;
-	unsigned char *tmppnt;
-	tmppnt = (unsigned char *) realloc(chunk->data,chunk->size+length);
-	if (tmppnt == NULL) {
-		_putts(_T("Error could not realloc data"));
+	unsigned char *dest = ExtendChunk(chunk, length);
+	if (dest == NULL) {
 		return FALSE;
 	}
-	chunk->data = tmppnt;
-	for(i = 0; i < length; i++) {
-		chunk->data[i+chunk->size] = pnt[i];
-	}
-	chunk->size += length;
+	memcpy(dest, pnt, length);
 	return TRUE;
-}		
-	
+}
 
-	
 unsigned char ReadChar(CHUNK_t* chunk) {
 	if (chunk->data == NULL) {
 		return 0;
@@ -440,20 +424,30 @@ uint64_t ReadLong(CHUNK_t* chunk) {
 	return value;
 }
 
+/* Hardware clock values, older builds saved them as seconds */
+uint64_t ReadClock(SAVESTATE_t *save, CHUNK_t *chunk) {
+	if (save->version_build >= TIMER_CLOCK_BUILD) {
+		return ReadLong(chunk);
+	}
+
+	double seconds = ReadDouble(chunk);
+	if (seconds <= 0) {
+		return 0;
+	}
+	return (uint64_t) (seconds * TIMER_CLOCK_RATE);
+}
+
 void ReadBlock(CHUNK_t* chunk, unsigned char *pnt, int length) {
 	if (chunk->data == NULL) {
 		ZeroMemory(pnt, length);
 		return;
 	}
 
-	int i;
 	// we do this min because if the length and the chunk are not
 	// the same size we could end up reading bad data. CheckPNT will
 	// handle the error
 	int min = length < chunk->size ? length : chunk->size;
-	for(i = 0; i < min; i++) {
-		pnt[i] = chunk->data[i+chunk->pnt];
-	}
+	memcpy(pnt, chunk->data + chunk->pnt, min);
 	chunk->pnt += length;
 	CheckPNT(chunk);
 }
@@ -465,7 +459,7 @@ void SaveCPU(SAVESTATE_t* save, CPU_t* cpu) {
 	CHUNK_t* chunk = NewChunk(save,CPU_tag);
 	
 	WriteChar(chunk, cpu->a);
-	WriteChar(chunk, cpu->f);
+	WriteChar(chunk, get_f(cpu));
 	WriteChar(chunk, cpu->b);
 	WriteChar(chunk, cpu->c);
 	WriteChar(chunk, cpu->d);
@@ -510,17 +504,71 @@ void SaveCPU(SAVESTATE_t* save, CPU_t* cpu) {
 
 	
 	/* pio */
-	for(i = 0; i < 256; i++) {
+	uint32_t interrupts[MAX_DEVICES * 3];
+	for(i = 0; i < MAX_DEVICES; i++) {
 		interrupt_t *val = &cpu->pio.interrupt[i];
-		WriteInt(chunk, (uint32_t) (val->device - cpu->pio.devices));
-		WriteInt(chunk, val->skip_factor);
-		WriteInt(chunk, val->skip_count);
+		interrupts[i * 3] = (uint32_t) (val->device - cpu->pio.devices);
+		interrupts[i * 3 + 1] = val->skip_factor;
+		interrupts[i * 3 + 2] = val->skip_count;
 	}
+	WriteIntBlock(chunk, interrupts, MAX_DEVICES * 3);
 
 	WriteInt(chunk, cpu->model_bits);
 }
 	
-void SaveMEM(SAVESTATE_t* save, memc* mem) {
+/*
+ * Writes the flash pages that differ from the base the calc was booted
+ * from. Returns FALSE if there is no base or the full ROM is smaller.
+ */
+BOOL SaveROMDelta(SAVESTATE_t* save, memc* mem) {
+	int i, count = 0;
+	if (mem->flash_base == NULL) {
+		return FALSE;
+	}
+
+	for (i = 0; i < mem->flash_pages; i++) {
+		if (mem->flash_dirty[i]) {
+			if (memcmp(mem->flash + i * PAGE_SIZE, mem->flash_base + i * PAGE_SIZE, PAGE_SIZE)) {
+				count++;
+			} else {
+				mem->flash_dirty[i] = FALSE;
+			}
+		}
+	}
+	if (8 + 12 + 8 + count * (4 + PAGE_SIZE) > 8 + mem->flash_size) {
+		return FALSE;
+	}
+
+	CHUNK_t *chunk = NewChunk(save, ROM_BASE_tag);
+	WriteLong(chunk, mem->flash_base_hash);
+	WriteInt(chunk, mem->flash_size);
+
+	chunk = NewChunk(save, ROM_DELTA_tag);
+	for (i = 0; i < mem->flash_pages; i++) {
+		if (mem->flash_dirty[i]) {
+			WriteInt(chunk, i);
+			WriteBlock(chunk, mem->flash + i * PAGE_SIZE, PAGE_SIZE);
+		}
+	}
+	return TRUE;
+}
+
+static void SaveBreaks(SAVESTATE_t* save, memc* mem, BOOL is_ram) {
+	int count = 0;
+	CHUNK_t* chunk = NewChunk(save, is_ram ? RAM_BREAKS_tag : FLASH_BREAKS_tag);
+	for (int i = 0; i < mem->break_table_size; i++) {
+		const uint32_t key = mem->break_table[i].key;
+		if (key != BREAK_EMPTY && break_key_is_ram(key) == is_ram) {
+			count++;
+			WriteInt(chunk, break_key_offset(key));
+			WriteInt(chunk, mem->break_table[i].type);
+		}
+	}
+	chunk = NewChunk(save, is_ram ? NUM_RAM_BREAKS_tag : NUM_FLASH_BREAKS_tag);
+	WriteInt(chunk, count);
+}
+
+void SaveMEM(SAVESTATE_t* save, memc* mem, BOOL delta) {
 	int i;
 	if (!mem) return;
 	CHUNK_t *chunk = NewChunk(save, MEM_tag);
@@ -552,8 +600,10 @@ void SaveMEM(SAVESTATE_t* save, memc* mem) {
 	WriteInt(chunk, mem->flash_upper);
 	WriteInt(chunk, mem->flash_lower);
 
-	chunk = NewChunk(save, ROM_tag);
-	WriteBlock(chunk, mem->flash, mem->flash_size);
+	if (!delta || !SaveROMDelta(save, mem)) {
+		chunk = NewChunk(save, ROM_tag);
+		WriteBlock(chunk, mem->flash, mem->flash_size);
+	}
 
 	chunk = NewChunk(save, RAM_tag);
 	WriteBlock(chunk, mem->ram, mem->ram_size);
@@ -566,42 +616,17 @@ void SaveMEM(SAVESTATE_t* save, memc* mem) {
 	WriteInt(chunk, mem->ram_upper);
 	WriteInt(chunk, mem->ram_lower);
 
-	int count = 0;
-	chunk = NewChunk(save, FLASH_BREAKS_tag);
-	for (int i = 0; i < mem->flash_size; i++)
-	{
-		if (mem->flash_break[i])
-		{
-			count++;
-			WriteInt(chunk, i);
-			WriteInt(chunk, mem->flash_break[i]);
-		}
-	}
-	chunk = NewChunk(save, NUM_FLASH_BREAKS_tag);
-	WriteInt(chunk, count);
-
-	count = 0;
-	chunk = NewChunk(save, RAM_BREAKS_tag);
-	for (int i = 0; i < mem->ram_size; i++)
-	{
-		if (mem->ram_break[i])
-		{
-			count++;
-			WriteInt(chunk, i);
-			WriteInt(chunk, mem->ram_break[i]);
-		}
-	}
-	chunk = NewChunk(save, NUM_RAM_BREAKS_tag);
-	WriteInt(chunk, count);
+	SaveBreaks(save, mem, FALSE);
+	SaveBreaks(save, mem, TRUE);
 }
 
-void SaveTIMER(SAVESTATE_t *save, timerc *time) {
+void SaveTIMER(SAVESTATE_t *save, timerc *time, time_t time_error) {
 	if (!time) return;
 	CHUNK_t* chunk = NewChunk(save,TIMER_tag);
 	WriteLong(chunk, time->tstates);
 	WriteLong(chunk, time->freq);
-	WriteDouble(chunk, time->elapsed);
-	WriteDouble(chunk, time->lasttime);
+	WriteLong(chunk, tc_clock(time));
+	WriteLong(chunk, time_error);
 }
 
 void SaveLINK(SAVESTATE_t* save, link_t* link) {
@@ -625,12 +650,12 @@ void SaveSTDINT(SAVESTATE_t* save, STDINT_t *stdint) {
 	CHUNK_t* chunk = NewChunk(save, STDINT_tag);
 	WriteChar(chunk, stdint->intactive);
 
-	WriteDouble(chunk, stdint->lastchk1);
-	WriteDouble(chunk, stdint->timermax1);
-	WriteDouble(chunk, stdint->lastchk2);
-	WriteDouble(chunk, stdint->timermax2);
+	WriteLong(chunk, stdint->lastchk1);
+	WriteLong(chunk, stdint->timermax1);
+	WriteLong(chunk, stdint->lastchk2);
+	WriteLong(chunk, stdint->timermax2);
 	for(i = 0; i < 4; i++) {
-		WriteDouble(chunk, stdint->freq[i]);
+		WriteLong(chunk, stdint->freq[i]);
 	}
 	WriteInt(chunk, stdint->mem);
 	WriteInt(chunk, stdint->xy);
@@ -646,7 +671,7 @@ void SaveLinkAssist(CHUNK_t *chunk, LINKASSIST_t *linka) {
 	WriteInt(chunk, linka->ready);
 	WriteInt(chunk, linka->error);
 	WriteInt(chunk, linka->sending);
-	WriteDouble(chunk, linka->last_access);
+	WriteLong(chunk, linka->last_access);
 	WriteInt(chunk, linka->bit);
 }
 
@@ -668,7 +693,7 @@ void SaveSE_AUX(SAVESTATE_t* save, SE_AUX_t *se_aux) {
 	WriteChar(chunk, se_aux->clock.enable);
 	WriteInt(chunk, (uint32_t)se_aux->clock.set);
 	WriteInt(chunk, (uint32_t)se_aux->clock.base);
-	WriteDouble(chunk, se_aux->clock.lasttime);
+	WriteLong(chunk, se_aux->clock.lasttime);
 
 	SaveLinkAssist(chunk, &se_aux->linka);
 	
@@ -682,7 +707,7 @@ void SaveSE_AUX(SAVESTATE_t* save, SE_AUX_t *se_aux) {
 	WriteChar(chunk, se_aux->md5.s);
 	WriteChar(chunk, se_aux->md5.mode);
 	
-	WriteDouble(chunk, se_aux->xtal.lastTime);
+	WriteLong(chunk, se_aux->xtal.lastTime);
 	WriteLong(chunk, se_aux->xtal.ticks);
 	for(i = 0; i < 3; i++) {
 		WriteLong(chunk, se_aux->xtal.timers[i].lastTstates);
@@ -729,12 +754,12 @@ void SaveLCD(SAVESTATE_t* save, LCD_t* lcd) {
 	
 	WriteInt(chunk, lcd->shades);
 	WriteInt(chunk, lcd->mode);
-	WriteDouble(chunk, lcd->base.time);
+	WriteLong(chunk, lcd->base.time);
 	WriteDouble(chunk, lcd->base.ufps);
-	WriteDouble(chunk, lcd->base.ufps_last);
-	WriteDouble(chunk, lcd->base.lastgifframe);
-	WriteDouble(chunk, lcd->base.write_avg);
-	WriteDouble(chunk, lcd->base.write_last);
+	WriteLong(chunk, lcd->base.ufps_last);
+	WriteLong(chunk, lcd->base.lastgifframe);
+	WriteLong(chunk, lcd->base.write_avg);
+	WriteLong(chunk, lcd->base.write_last);
 	WriteShort(chunk, lcd->screen_addr);
 }
 
@@ -748,12 +773,12 @@ void SaveColorLCD(SAVESTATE_t *save, ColorLCD_t *lcd) {
 	WriteInt(chunk, lcd->base.z);
 	WriteInt(chunk, lcd->base.cursor_mode);
 	WriteInt(chunk, lcd->base.contrast);
-	WriteDouble(chunk, lcd->base.time);
+	WriteLong(chunk, lcd->base.time);
 	WriteDouble(chunk, lcd->base.ufps);
-	WriteDouble(chunk, lcd->base.ufps_last);
-	WriteDouble(chunk, lcd->base.lastgifframe);
-	WriteDouble(chunk, lcd->base.write_avg);
-	WriteDouble(chunk, lcd->base.write_last);
+	WriteLong(chunk, lcd->base.ufps_last);
+	WriteLong(chunk, lcd->base.lastgifframe);
+	WriteLong(chunk, lcd->base.write_avg);
+	WriteLong(chunk, lcd->base.write_last);
 
 	WriteBlock(chunk, lcd->display, COLOR_LCD_DISPLAY_SIZE);
 	WriteBlock(chunk, lcd->queued_image, COLOR_LCD_DISPLAY_SIZE);
@@ -767,7 +792,7 @@ void SaveColorLCD(SAVESTATE_t *save, ColorLCD_t *lcd) {
 	WriteInt(chunk, lcd->front);
 }
 
-SAVESTATE_t* SaveSlot(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment) {
+static SAVESTATE_t* SaveCalc(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment, BOOL delta) {
 	SAVESTATE_t* save;
 	BOOL runsave;
 	if (lpCalc == NULL || lpCalc->active == FALSE) {
@@ -780,8 +805,8 @@ SAVESTATE_t* SaveSlot(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment)
 	save = CreateSave(author, comment, lpCalc->model);
 
 	SaveCPU(save, &lpCalc->cpu);
-	SaveMEM(save, &lpCalc->mem_c);
-	SaveTIMER(save, &lpCalc->timer_c);
+	SaveMEM(save, &lpCalc->mem_c, delta);
+	SaveTIMER(save, &lpCalc->timer_c, lpCalc->time_error);
 	if (lpCalc->model >= TI_84PCSE) {
 		SaveColorLCD(save, (ColorLCD_t *) lpCalc->cpu.pio.lcd);
 	} else {
@@ -791,11 +816,27 @@ SAVESTATE_t* SaveSlot(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment)
 	SaveKeypad(save, lpCalc->cpu.pio.keypad);
 	SaveSTDINT(save, lpCalc->cpu.pio.stdint);
 	SaveSE_AUX(save, lpCalc->cpu.pio.se_aux);
+	// retro_serialize_size hands out GetSlotSize before any save is made
+	assert(delta ? GetSaveSize(save) <= GetSlotSize(lpCalc) : GetSaveSize(save) == GetSlotSize(lpCalc));
 
 	lpCalc->running = runsave;
 	return save;
 }
 
+SAVESTATE_t* SaveSlot(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment) {
+	return SaveCalc(lpCalc, author, comment, FALSE);
+}
+
+/*
+ * Like SaveSlot, but flash is stored as the pages that changed since the
+ * calc was booted. It can only be loaded back into a calc booted from the
+ * same ROM, and is never bigger than GetSlotSize. A calc that was not
+ * booted from a ROM image gets the full ROM, like SaveSlot.
+ */
+SAVESTATE_t* SaveSlotDelta(LPCALC lpCalc, const TCHAR *author, const TCHAR *comment) {
+	return SaveCalc(lpCalc, author, comment, TRUE);
+}
+
 BOOL LoadCPU(SAVESTATE_t* save, CPU_t* cpu) {
 	CHUNK_t* chunk = FindChunk(save, CPU_tag);
 	if (chunk == NULL) {
@@ -805,7 +846,7 @@ BOOL LoadCPU(SAVESTATE_t* save, CPU_t* cpu) {
 	chunk->pnt = 0;
 	
 	cpu->a = ReadChar(chunk);
-	cpu->f = ReadChar(chunk);
+	set_f(cpu, ReadChar(chunk));
 	cpu->b = ReadChar(chunk);
 	cpu->c = ReadChar(chunk);
 	cpu->d = ReadChar(chunk);
@@ -867,6 +908,77 @@ BOOL LoadCPU(SAVESTATE_t* save, CPU_t* cpu) {
 
 
 
+/* Whether the save's flash can be restored into this calc */
+BOOL CheckROMBase(SAVESTATE_t* save, memc* mem) {
+	if (FindChunk(save, ROM_tag) != NULL) {
+		return TRUE;
+	}
+
+	CHUNK_t* chunk = FindChunk(save, ROM_BASE_tag);
+	if (chunk == NULL || mem->flash_base == NULL) {
+		return FALSE;
+	}
+	uint64_t hash = ReadLong(chunk);
+	int flash_size = ReadInt(chunk);
+	if (hash != mem->flash_base_hash || flash_size != mem->flash_size) {
+		_putts(_T("Save was made from a different ROM"));
+		return FALSE;
+	}
+	return FindChunk(save, ROM_DELTA_tag) != NULL;
+}
+
+BOOL LoadROMDelta(SAVESTATE_t* save, memc* mem) {
+	CHUNK_t* chunk = FindChunk(save, ROM_DELTA_tag);
+	if (chunk == NULL || mem->flash_base == NULL) {
+		return FALSE;
+	}
+
+	// pages never written since boot already match the base
+	for (int i = 0; i < mem->flash_pages; i++) {
+		if (mem->flash_dirty[i]) {
+			memcpy(mem->flash + i * PAGE_SIZE, mem->flash_base + i * PAGE_SIZE, PAGE_SIZE);
+			mem->flash_dirty[i] = FALSE;
+			set_flash_changed(mem, i * PAGE_SIZE, PAGE_SIZE);
+		}
+	}
+
+	while (chunk->pnt + 4 + PAGE_SIZE <= chunk->size) {
+		int page = ReadInt(chunk);
+		if (page < 0 || page >= mem->flash_pages) {
+			return FALSE;
+		}
+		ReadBlock(chunk, mem->flash + page * PAGE_SIZE, PAGE_SIZE);
+		set_flash_dirty(mem, page * PAGE_SIZE, PAGE_SIZE);
+	}
+	return TRUE;
+}
+
+static void LoadBreaks(SAVESTATE_t* save, memc* mem, BOOL is_ram) {
+	CHUNK_t* chunk = FindChunk(save, is_ram ? NUM_RAM_BREAKS_tag : NUM_FLASH_BREAKS_tag);
+	if (chunk == NULL) {
+		return;
+	}
+	const int num_breaks = ReadInt(chunk);
+	chunk = FindChunk(save, is_ram ? RAM_BREAKS_tag : FLASH_BREAKS_tag);
+	if (chunk == NULL) {
+		return;
+	}
+	for (int i = 0; i < num_breaks; i++) {
+		const int addr = ReadInt(chunk);
+		const waddr_t waddr = MAKE_WADDR((uint16_t)(addr % PAGE_SIZE), (uint8_t)(addr / PAGE_SIZE), is_ram);
+		const int type = ReadInt(chunk);
+		if (type & MEM_READ_BREAK) {
+			set_mem_read_break(mem, waddr);
+		}
+		if (type & MEM_WRITE_BREAK) {
+			set_mem_write_break(mem, waddr);
+		}
+		if ((type & NORMAL_BREAK) || !(type & (MEM_READ_BREAK | MEM_WRITE_BREAK))) {
+			set_break(mem, waddr);
+		}
+	}
+}
+
 BOOL LoadMEM(SAVESTATE_t* save, memc* mem) {
 	int i;
 	CHUNK_t* chunk = FindChunk(save, MEM_tag);
@@ -920,12 +1032,12 @@ BOOL LoadMEM(SAVESTATE_t* save, memc* mem) {
 	mem->flash_lower = (unsigned short)ReadInt(chunk);
 
 	chunk = FindChunk(save, ROM_tag);
-	if (chunk == NULL) {
+	if (chunk != NULL) {
+		ReadBlock(chunk, (unsigned char *)mem->flash, mem->flash_size);
+		set_flash_dirty(mem, 0, mem->flash_size);
+	} else if (!LoadROMDelta(save, mem)) {
 		return FALSE;
 	}
-
-	chunk->pnt = 0;
-	ReadBlock(chunk, (unsigned char *)mem->flash, mem->flash_size);
 	
 	chunk = FindChunk(save, RAM_tag);
 	if (chunk == NULL) {
@@ -949,60 +1061,14 @@ BOOL LoadMEM(SAVESTATE_t* save, memc* mem) {
 		mem->ram_lower = (unsigned short)ReadInt(chunk);
 	}
 
-	chunk = FindChunk(save, NUM_FLASH_BREAKS_tag);
-	if (chunk) {
-		const int num_flash_breaks = ReadInt(chunk);
-		chunk = FindChunk(save, FLASH_BREAKS_tag);
-		if (chunk) {
-			for (int i = 0; i < num_flash_breaks; i++)
-			{
-				const int addr = ReadInt(chunk);
-				const waddr_t waddr = MAKE_WADDR((uint16_t)(addr % PAGE_SIZE), (uint8_t)(addr / PAGE_SIZE), FALSE);
-				const BREAK_TYPE type = (BREAK_TYPE) ReadInt(chunk);
-				switch (type) {
-				case MEM_READ_BREAK:
-					set_mem_read_break(mem, waddr);
-					break;
-				case MEM_WRITE_BREAK:
-					set_mem_read_break(mem, waddr);
-					break;
-				default:
-					set_break(mem, waddr);
-					break;
-				}
-			}
-		}
-	}
-
-	chunk = FindChunk(save, NUM_RAM_BREAKS_tag);
-	if (chunk) {
-		const int num_ram_breaks = ReadInt(chunk);
-		chunk = FindChunk(save, RAM_BREAKS_tag);
-		if (chunk) {
-			for (int i = 0; i < num_ram_breaks; i++)
-			{
-				const int addr = ReadInt(chunk);
-				const waddr_t waddr = MAKE_WADDR((uint16_t)(addr % PAGE_SIZE), (uint8_t)(addr / PAGE_SIZE), TRUE);
-				const BREAK_TYPE type = (BREAK_TYPE) ReadInt(chunk);
-				switch (type) {
-				case MEM_READ_BREAK:
-					set_mem_read_break(mem, waddr);
-					break;
-				case MEM_WRITE_BREAK:
-					set_mem_read_break(mem, waddr);
-					break;
-				default:
-					set_break(mem, waddr);
-					break;
-				}
-			}
-		}
-	}
+	LoadBreaks(save, mem, FALSE);
+	LoadBreaks(save, mem, TRUE);
 
+	update_page_table(mem);
 	return TRUE;
 }
 
-BOOL LoadTIMER(SAVESTATE_t* save, timerc* time) {
+BOOL LoadTIMER(SAVESTATE_t* save, timerc* time, time_t *time_error) {
 	CHUNK_t* chunk = FindChunk(save,TIMER_tag);
 	if (chunk == NULL) {
 		return FALSE;
@@ -1012,8 +1078,15 @@ BOOL LoadTIMER(SAVESTATE_t* save, timerc* time) {
 
 	time->tstates	= ReadLong(chunk);
 	time->freq		= (uint32_t) ReadLong(chunk);
-	time->elapsed	= ReadDouble(chunk);
-	time->lasttime	= ReadDouble(chunk);	// this isn't used.
+	time->clock_base	= ReadClock(save, chunk);
+	time->tstates_base	= time->tstates;
+	time->clock_scale	= (uint32_t) (TIMER_CLOCK_RATE / time->freq);
+	// how far the last run went past its end, needed to replay it exactly
+	if (save->version_build >= TIME_ERROR_BUILD) {
+		*time_error = (time_t) ReadLong(chunk);
+	} else {
+		*time_error = 0;
+	}
 	return TRUE;
 }
 
@@ -1045,13 +1118,14 @@ BOOL LoadLCD(SAVESTATE_t* save, LCD_t* lcd) {
 	lcd->front		= ReadInt(chunk);
 	ReadBlock(chunk,  (unsigned char *) lcd->queue, LCD_MAX_SHADES * DISPLAY_SIZE);
 	lcd->shades		= ReadInt(chunk);
+	LCD_rebuild_gray(lcd);
 	lcd->mode		= (LCD_MODE) ReadInt(chunk);
-	lcd->base.time = ReadDouble(chunk);
+	lcd->base.time = ReadClock(save, chunk);
 	lcd->base.ufps = ReadDouble(chunk);
-	lcd->base.ufps_last = ReadDouble(chunk);
-	lcd->base.lastgifframe = ReadDouble(chunk);
-	lcd->base.write_avg	= ReadDouble(chunk);
-	lcd->base.write_last = ReadDouble(chunk);
+	lcd->base.ufps_last = ReadClock(save, chunk);
+	lcd->base.lastgifframe = ReadClock(save, chunk);
+	lcd->base.write_avg	= ReadClock(save, chunk);
+	lcd->base.write_last = ReadClock(save, chunk);
 	if (save->version_build >= LCD_SCREEN_ADDR_BUILD) {
 		lcd->screen_addr = ReadShort(chunk);
 	} else {
@@ -1077,12 +1151,12 @@ BOOL LoadColorLCD(SAVESTATE_t *save, ColorLCD_t *lcd) {
 	lcd->base.z = ReadInt(chunk);
 	lcd->base.cursor_mode = (LCD_CURSOR_MODE)ReadInt(chunk);
 	lcd->base.contrast = ReadInt(chunk);
-	lcd->base.time = ReadDouble(chunk);
+	lcd->base.time = ReadClock(save, chunk);
 	lcd->base.ufps = ReadDouble(chunk);
-	lcd->base.ufps_last = ReadDouble(chunk);
-	lcd->base.lastgifframe = ReadDouble(chunk);
-	lcd->base.write_avg = ReadDouble(chunk);
-	lcd->base.write_last = ReadDouble(chunk);
+	lcd->base.ufps_last = ReadClock(save, chunk);
+	lcd->base.lastgifframe = ReadClock(save, chunk);
+	lcd->base.write_avg = ReadClock(save, chunk);
+	lcd->base.write_last = ReadClock(save, chunk);
 
 	ReadBlock(chunk, lcd->display, COLOR_LCD_DISPLAY_SIZE);
 	ReadBlock(chunk, lcd->queued_image, COLOR_LCD_DISPLAY_SIZE);
@@ -1136,12 +1210,12 @@ BOOL LoadSTDINT(SAVESTATE_t* save, STDINT_t* stdint) {
 	chunk->pnt = 0;
 
 	stdint->intactive	= ReadChar(chunk);
-	stdint->lastchk1	= ReadDouble(chunk);
-	stdint->timermax1	= ReadDouble(chunk);
-	stdint->lastchk2	= ReadDouble(chunk);
-	stdint->timermax2	= ReadDouble(chunk);
+	stdint->lastchk1	= ReadClock(save, chunk);
+	stdint->timermax1	= ReadClock(save, chunk);
+	stdint->lastchk2	= ReadClock(save, chunk);
+	stdint->timermax2	= ReadClock(save, chunk);
 	for(i = 0; i < 4; i++) {
-		stdint->freq[i]	= ReadDouble(chunk);
+		stdint->freq[i]	= ReadClock(save, chunk);
 	}
 	stdint->mem			= (unsigned char) ReadInt(chunk);
 	stdint->xy			= (unsigned char) ReadInt(chunk);
@@ -1173,7 +1247,7 @@ void LoadSE_AUX(SAVESTATE_t* save, CPU_t *cpu, SE_AUX_t *se_aux) {
 		linka->ready		= ReadInt(chunk);
 		linka->error		= ReadInt(chunk);
 		linka->sending		= ReadInt(chunk);
-		linka->last_access	= ReadDouble(chunk);
+		linka->last_access	= ReadClock(save, chunk);
 		linka->bit			= ReadInt(chunk);
 		return;
 	}
@@ -1181,7 +1255,7 @@ void LoadSE_AUX(SAVESTATE_t* save, CPU_t *cpu, SE_AUX_t *se_aux) {
 	se_aux->clock.enable		= ReadChar(chunk);
 	se_aux->clock.set			= ReadInt(chunk);
 	se_aux->clock.base			= ReadInt(chunk);
-	se_aux->clock.lasttime		= ReadDouble(chunk);
+	se_aux->clock.lasttime		= ReadClock(save, chunk);
 	
 	for(i = 0; i < 7; i++) {
 		se_aux->delay.reg[i]	= ReadChar(chunk);
@@ -1203,16 +1277,16 @@ void LoadSE_AUX(SAVESTATE_t* save, CPU_t *cpu, SE_AUX_t *se_aux) {
 	se_aux->linka.ready			= ReadInt(chunk);
 	se_aux->linka.error			= ReadInt(chunk);
 	se_aux->linka.sending		= ReadInt(chunk);
-	se_aux->linka.last_access	= ReadDouble(chunk);
+	se_aux->linka.last_access	= ReadClock(save, chunk);
 	se_aux->linka.bit			= ReadInt(chunk);
 
-	se_aux->xtal.lastTime		= ReadDouble(chunk);
+	se_aux->xtal.lastTime		= ReadClock(save, chunk);
 	se_aux->xtal.ticks			= ReadLong(chunk);
 
 	for(i = 0; i < 3; i++) {
 		se_aux->xtal.timers[i].lastTstates	= ReadLong(chunk);
-		se_aux->xtal.timers[i].lastTicks	= ReadDouble(chunk);
-		se_aux->xtal.timers[i].divsor		= ReadDouble(chunk);
+		se_aux->xtal.timers[i].lastTicks	= (unsigned long long) ReadDouble(chunk);
+		se_aux->xtal.timers[i].divsor		= (unsigned int) ReadDouble(chunk);
 		se_aux->xtal.timers[i].loop			= ReadInt(chunk);
 		se_aux->xtal.timers[i].interrupt	= ReadInt(chunk);
 		se_aux->xtal.timers[i].underflow	= ReadInt(chunk);
@@ -1255,6 +1329,10 @@ BOOL LoadSlot_Unsafe(SAVESTATE_t *save, LPCALC lpCalc) {
 		return FALSE;
 	}
 
+	if (!CheckROMBase(save, &lpCalc->mem_c)) {
+		return FALSE;
+	}
+
 	runsave = lpCalc->running;
 	lpCalc->running = FALSE;
 
@@ -1268,7 +1346,7 @@ BOOL LoadSlot_Unsafe(SAVESTATE_t *save, LPCALC lpCalc) {
 		return FALSE;
 	}
 
-	success = LoadTIMER(save, &lpCalc->timer_c);
+	success = LoadTIMER(save, &lpCalc->timer_c, &lpCalc->time_error);
 	if (success == FALSE) {
 		return FALSE;
 	}
@@ -1299,6 +1377,8 @@ BOOL LoadSlot_Unsafe(SAVESTATE_t *save, LPCALC lpCalc) {
 	}
 
 	LoadSE_AUX(save, &lpCalc->cpu, lpCalc->cpu.pio.se_aux);
+	// device deadlines were computed against the old timer
+	Reset_interrupt_schedule(&lpCalc->cpu);
 	lpCalc->running = runsave;
 
 	return TRUE;
@@ -1325,34 +1405,44 @@ char* GetRomOnly(SAVESTATE_t *save, int *size) {
 int tempInt[1];
 
 
-void WriteSave(const TCHAR *fn, SAVESTATE_t* save, int compress) {
+void WriteSave(const TCHAR *fn, SAVESTATE_t* save, int compress, int level) {
 
 	//convert to RFILE
 
 	int i;
 	RFILE* ofile = NULL;
-	FILE* cfile;
-	
-	//if (!save) {
-	//	_putts(_T("Save was null for write"));
-	//	return;
-	//}
+	unsigned char *packed = NULL;
 
-	if (compress == 0) {
-		//_tfopen_s(&ofile, fn, _T("wb"));
-		ofile = filestream_open(fn,
-			RETRO_VFS_FILE_ACCESS_WRITE,
-			RETRO_VFS_FILE_ACCESS_HINT_NONE);
-	} else {
-		//tmpfile_s(&ofile);
+	if (compress != NO_CMP && compress != LZ_CMP) {
+		_putts(_T("Error bad compression format selected."));
+		return;
 	}
-		
-	//if (!ofile) {
-	//	_putts(_T("Could not open save file for write"));
-	//	return;
-	//}
 
-	int smurf = sizeof(DETECT_STR);
+	//_tfopen_s(&ofile, fn, _T("wb"));
+	ofile = filestream_open(fn,
+		RETRO_VFS_FILE_ACCESS_WRITE,
+		RETRO_VFS_FILE_ACCESS_HINT_NONE);
+	if (!ofile) {
+		_putts(_T("Could not open save file for write"));
+		return;
+	}
+
+	if (compress == LZ_CMP) {
+		int largest = 0;
+		for(i = 0; i < save->chunk_count; i++) {
+			if (save->chunks[i]->size > largest) {
+				largest = save->chunks[i]->size;
+			}
+		}
+		packed = (unsigned char *) malloc(lz_bound(largest));
+		if (!packed) {
+			filestream_close(ofile);
+			return;
+		}
+
+		filestream_write(ofile, DETECT_CMP_STR, sizeof(DETECT_CMP_STR)-1);
+		filestream_putc(ofile, LZ_CMP);
+	}
 
 	filestream_write(ofile, DETECT_STR, sizeof(DETECT_STR)-1);
 
@@ -1379,12 +1469,28 @@ void WriteSave(const TCHAR *fn, SAVESTATE_t* save, int compress) {
 	//fwrite(save->comment, 1, 64, ofile);
 	
 	for(i = 0; i < save->chunk_count; i++) {
-		filestream_putc(ofile, save->chunks[i]->tag[0]);
-		filestream_putc(ofile, save->chunks[i]->tag[1]);
-		filestream_putc(ofile, save->chunks[i]->tag[2]);
-		filestream_putc(ofile, save->chunks[i]->tag[3]);
-		filestream_write(ofile, &(save->chunks[i]->size), sizeof(int));
-		filestream_write(ofile, save->chunks[i]->data, save->chunks[i]->size);
+		CHUNK_t *chunk = save->chunks[i];
+		filestream_putc(ofile, chunk->tag[0]);
+		filestream_putc(ofile, chunk->tag[1]);
+		filestream_putc(ofile, chunk->tag[2]);
+		filestream_putc(ofile, chunk->tag[3]);
+		if (compress == LZ_CMP) {
+			// compressed chunks store their packed size, then the real size.
+			// packed and real size are equal if it did not compress
+			int size = lz_compress(chunk->data, chunk->size, packed, lz_bound(chunk->size), level);
+			if (size <= 0 || size >= chunk->size) {
+				filestream_write(ofile, &chunk->size, sizeof(int));
+				filestream_write(ofile, &chunk->size, sizeof(int));
+				filestream_write(ofile, chunk->data, chunk->size);
+			} else {
+				filestream_write(ofile, &size, sizeof(int));
+				filestream_write(ofile, &chunk->size, sizeof(int));
+				filestream_write(ofile, packed, size);
+			}
+			continue;
+		}
+		filestream_write(ofile, &chunk->size, sizeof(int));
+		filestream_write(ofile, chunk->data, chunk->size);
 
 		//fputc(save->chunks[i]->tag[0], ofile);
 		//fputc(save->chunks[i]->tag[1], ofile);
@@ -1393,100 +1499,166 @@ void WriteSave(const TCHAR *fn, SAVESTATE_t* save, int compress) {
 		//fputi(save->chunks[i]->size, ofile);
 		//fwrite(save->chunks[i]->data, 1, save->chunks[i]->size, ofile);
 	}
-	
-	if (compress) {
-		/*
-		// make sure we've written to the file, and rewind to
-		// the beginning. TODO: we should not require files,
-		// but def and inf use FILE * for now
-		fflush(ofile);
-		rewind(ofile);
-
-		_tfopen_s(&cfile, fn, _T("wb"));
-		if (!cfile) {
-			_putts(_T("Could not open compress file for write"));
-			return;
+
+	free(packed);
+	filestream_close(ofile);
+}
+
+/*
+ * Number of bytes WriteSave would write for an uncompressed save
+ */
+int GetSaveSize(SAVESTATE_t *save) {
+	int size = 8 + 4 + SAVE_HEADERSIZE;
+	for (int i = 0; i < save->chunk_count; i++) {
+		size += 4 + sizeof(int) + save->chunks[i]->size;
+	}
+	return size;
+}
+
+/*
+ * Size of the WriteSaveBuffer image of SaveSlot(lpCalc), which only
+ * depends on the model's memory, LCD and the number of breakpoints.
+ */
+int GetSlotSize(LPCALC lpCalc) {
+	const int chunk = 4 + sizeof(int);
+	memc *mem = &lpCalc->mem_c;
+	if (lpCalc->active == FALSE) {
+		return 0;
+	}
+
+	int size = 8 + 4 + SAVE_HEADERSIZE;
+	size += chunk + 20 + 2 * 2 + 3 + 11 * 4 + 256 * 3 * 4 + 4;
+	// MEM, ROM, RAM, REMAP, RAM_LIMIT and the breakpoint lists
+	size += chunk + 8 * 4 + NUM_BANKS * 4 * 4 + 8 * 4;
+	size += chunk + mem->flash_size;
+	size += chunk + mem->ram_size;
+	size += 2 * (chunk + 2 * 4);
+	size += 2 * chunk + 2 * (chunk + 4) + mem->break_count * 2 * 4;
+	size += chunk + 4 * 8;
+	if (lpCalc->model >= TI_84PCSE) {
+		size += chunk + 6 * 4 + 6 * 8 + 2 * COLOR_LCD_DISPLAY_SIZE +
+			sizeof(((ColorLCD_t *) NULL)->registers) + 7 * 4;
+	} else {
+		size += chunk + 8 * 4 + (LCD_MAX_SHADES + 1) * DISPLAY_SIZE + 3 * 4 + 6 * 8 + 2;
+	}
+	if (lpCalc->cpu.pio.link != NULL) {
+		size += chunk + 1;
+	}
+	size += chunk + 1;
+	size += chunk + 1 + 8 * 8 + 2 * 4;
+	if (lpCalc->cpu.pio.se_aux != NULL) {
+		if (lpCalc->model == TI_83P) {
+			size += chunk + 36;
+		} else if (lpCalc->model > TI_83P) {
+			size += chunk + 243 + chunk + 31;
 		}
+	}
+	return size;
+}
 
-		fputs(DETECT_CMP_STR, cfile);
-		switch(compress) {
-#ifdef ZLIB_WINAPI
-			case ZLIB_CMP:
-				{
-					fputc(ZLIB_CMP, cfile);
-				
-					def(ofile, cfile, 9);
-					break;
-				}
-#endif
-			default:
-				_putts(_T("Error bad compression format selected."));
-				break;
+/*
+ * Writes the same image as an uncompressed WriteSave into buffer. Returns
+ * the number of bytes written, or 0 if buffer is too small.
+ */
+int WriteSaveBuffer(unsigned char *buffer, int size, SAVESTATE_t *save) {
+	if (GetSaveSize(save) > size) {
+		_putts(_T("Save buffer is too small"));
+		return 0;
+	}
+
+	unsigned char *pnt = buffer;
+	int header[6];
+	header[0] = SAVE_HEADERSIZE;
+	header[1] = save->version_major;
+	header[2] = save->version_minor;
+	header[3] = save->version_build;
+	header[4] = save->model;
+	header[5] = save->chunk_count;
+
+	memcpy(pnt, DETECT_STR, 8);
+	pnt += 8;
+	memcpy(pnt, header, sizeof(header));
+	pnt += sizeof(header);
+	memcpy(pnt, save->author, MAX_SAVESTATE_AUTHOR_LENGTH);
+	pnt += MAX_SAVESTATE_AUTHOR_LENGTH;
+	memcpy(pnt, save->comment, MAX_SAVESTATE_COMMENT_LENGTH);
+	pnt += MAX_SAVESTATE_COMMENT_LENGTH;
+
+	for (int i = 0; i < save->chunk_count; i++) {
+		CHUNK_t *chunk = save->chunks[i];
+		memcpy(pnt, chunk->tag, 4);
+		pnt += 4;
+		memcpy(pnt, &chunk->size, sizeof(int));
+		pnt += sizeof(int);
+		// empty chunks, like breakpoint lists, may have no data at all
+		if (chunk->size != 0) {
+			memcpy(pnt, chunk->data, chunk->size);
+			pnt += chunk->size;
 		}
-		fclose(cfile);
-		*/
 	}
 
-	filestream_close(ofile);
+	return (int) (pnt - buffer);
+}
+
+/* Reads the data of an LZ_CMP chunk whose packed size is in chunk->size */
+static BOOL ReadPackedChunk(RFILE *ifile, CHUNK_t *chunk) {
+	int packed_size = chunk->size;
+	int size;
+	filestream_read(ifile, &size, sizeof(int));
+	if (packed_size < 0 || size < 0 || filestream_eof(ifile)) {
+		return FALSE;
+	}
+
+	chunk->size = size;
+	chunk->alloc = size;
+	chunk->data = (unsigned char *) malloc(size);
+	if (chunk->data == NULL && size != 0) {
+		return FALSE;
+	}
+	if (packed_size == size) {
+		return filestream_read(ifile, chunk->data, size) == size;
+	}
+
+	unsigned char *packed = (unsigned char *) malloc(packed_size);
+	if (packed == NULL) {
+		return FALSE;
+	}
+	BOOL success = filestream_read(ifile, packed, packed_size) == packed_size &&
+		lz_decompress(packed, packed_size, chunk->data, size) == size;
+	free(packed);
+	return success;
 }
 
 SAVESTATE_t* ReadSave(RFILE *ifile) {
 	int i;
-	int compressed = FALSE;
+	int compressed = NO_CMP;
+	int header_offset = 0;
 	int chunk_offset, chunk_count;
 	char string[128];
 	static SAVESTATE_t *save = NULL;
 	CHUNK_t *chunk;
-	FILE *tmpFile;
 
 	filestream_read(ifile,string, 8 );
 	string[8] = 0;
 	if (strncmp(DETECT_CMP_STR, string, 8) == 0) {
-		i = filestream_getc(ifile);
-		tmpfile_s(&tmpFile);
-		if (!tmpFile) {
+		// the rest is a normal save with each chunk compressed on its own
+		compressed = filestream_getc(ifile);
+		if (compressed != LZ_CMP) {
+			_putts(_T("Unknown save compression"));
 			return NULL;
 		}
-		
-		switch(i) {
-#ifdef ZLIB_WINAPI
-			case ZLIB_CMP:
-				{
-					int error = inf(ifile, tmpFile);
-					if (error) {
-						fclose(ifile);
-						return NULL;
-					}
-					// TODO: fix this so we don't need this temp file
-					// we've written it out to file, but fclosing this will
-					// delete it. Make sure we've written it out and rewind
-					fflush(tmpFile);
-					rewind(tmpFile);
-					ifile = tmpFile;
-					break;
-				}
-#endif
-			default:
-				fclose(tmpFile);
-				return NULL;
-		}
-		
-		compressed = TRUE;
+		header_offset = 8 + 1;
 		filestream_read(ifile,string, 8);
 	}
 		
 	if (strncmp(DETECT_STR, string, 8) != 0) {
 		_putts(_T("Readsave detect string failed."));
-		if (compressed == TRUE) {
-			filestream_close(ifile);
-		}
 		return NULL;
 	}		
 	
 	save = (SAVESTATE_t *) malloc(sizeof(SAVESTATE_t));
 	if (!save) {
 		_putts(_T("Save could not be allocated"));
-		if (compressed == TRUE) filestream_close(ifile);
 		return NULL;
 	}
 
@@ -1521,7 +1693,7 @@ SAVESTATE_t* ReadSave(RFILE *ifile) {
 	//fread(save->author, 1, MAX_SAVESTATE_AUTHOR_LENGTH, ifile);
 	//fread(save->comment, 1 , MAX_SAVESTATE_COMMENT_LENGTH, ifile);
 
-	filestream_seek(ifile, chunk_offset + 8 + 4, SEEK_SET);
+	filestream_seek(ifile, header_offset + chunk_offset + 8 + 4, SEEK_SET);
 	
 	for(i = 0; i < MAX_CHUNKS; i++) {
 		save->chunks[i] = NULL;
@@ -1550,13 +1722,97 @@ SAVESTATE_t* ReadSave(RFILE *ifile) {
 			FreeSave(save);
 			return NULL;
 		}
+		if (compressed == LZ_CMP) {
+			if (!ReadPackedChunk(ifile, chunk)) {
+				FreeSave(save);
+				return NULL;
+			}
+			continue;
+		}
 		chunk->data = (unsigned char *)malloc(chunk->size);
+		chunk->alloc = chunk->size;
 		filestream_read(ifile, chunk->data, chunk->size);
 	}
 
-	if (compressed == TRUE) {
-		filestream_close(ifile);
-	}
 /* check for read errors... */
 	return save;
 }
+
+/*
+ * Reads an uncompressed save image, as written by WriteSaveBuffer or
+ * WriteSave, from memory
+ */
+SAVESTATE_t* ReadSaveBuffer(const unsigned char *buffer, int size) {
+	int header[6];
+	const unsigned char *pnt = buffer;
+	const unsigned char *end = buffer + size;
+
+	// the header, author and comment have to be there before any is read
+	if (size < 8 + 4 + SAVE_HEADERSIZE || memcmp(DETECT_STR, buffer, 8) != 0) {
+		_putts(_T("Readsave detect string failed."));
+		return NULL;
+	}
+	memcpy(header, buffer + 8, sizeof(header));
+	if (header[1] != CUR_MAJOR) {
+		_putts(_T("Save not compatible at all, sorry\n"));
+		return NULL;
+	}
+	if (header[0] < SAVE_HEADERSIZE || header[0] > size - 8 - 4) {
+		return NULL;
+	}
+
+	SAVESTATE_t *save = (SAVESTATE_t *) malloc(sizeof(SAVESTATE_t));
+	if (!save) {
+		_putts(_T("Save could not be allocated"));
+		return NULL;
+	}
+
+	save->version_major = header[1];
+	save->version_minor = header[2];
+	save->version_build = header[3];
+	save->model = (CalcModel) header[4];
+	int chunk_count = header[5];
+	memcpy(save->author, buffer + 8 + sizeof(header), MAX_SAVESTATE_AUTHOR_LENGTH);
+	memcpy(save->comment, buffer + 8 + sizeof(header) + MAX_SAVESTATE_AUTHOR_LENGTH, MAX_SAVESTATE_COMMENT_LENGTH);
+
+	for (int i = 0; i < MAX_CHUNKS; i++) {
+		save->chunks[i] = NULL;
+	}
+	save->chunk_count = 0;
+
+	pnt = buffer + header[0] + 8 + 4;
+	for (int i = 0; i < chunk_count && i < MAX_CHUNKS; i++) {
+		char tag[4];
+		int chunk_size;
+		if (end - pnt < 4 + (int) sizeof(int)) {
+			FreeSave(save);
+			return NULL;
+		}
+		memcpy(tag, pnt, 4);
+		memcpy(&chunk_size, pnt + 4, sizeof(int));
+		pnt += 4 + sizeof(int);
+		if (chunk_size < 0 || chunk_size > end - pnt) {
+			FreeSave(save);
+			return NULL;
+		}
+
+		CHUNK_t *chunk = NewChunk(save, tag);
+		if (chunk == NULL) {
+			FreeSave(save);
+			return NULL;
+		}
+		chunk->data = (unsigned char *) malloc(chunk_size);
+		if (chunk->data == NULL && chunk_size != 0) {
+			FreeSave(save);
+			return NULL;
+		}
+		if (chunk_size != 0) {
+			memcpy(chunk->data, pnt, chunk_size);
+		}
+		chunk->size = chunk_size;
+		chunk->alloc = chunk_size;
+		pnt += chunk_size;
+	}
+
+	return save;
+}
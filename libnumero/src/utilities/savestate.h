@@ -11,11 +11,13 @@ typedef struct {
 	char tag[4];
 	int pnt;
 	int size;
+	int alloc;
 	unsigned char *data;
 } CHUNK_t;
 
 
 #define MAX_CHUNKS 512
+#define MIN_CHUNK_ALLOC 64
 
 typedef struct {
 	int version_major;
@@ -31,7 +33,7 @@ typedef struct {
 
 #define CUR_MAJOR 0
 #define CUR_MINOR 1
-#define CUR_BUILD 3
+#define CUR_BUILD 5
 
 // old save state compatibility
 #define MEM_C_CMD_BUILD				1
@@ -39,6 +41,8 @@ typedef struct {
 #define SEAUX_MODEL_BITS_BUILD		1
 #define CPU_MODEL_BITS_BUILD		2
 #define NEW_CONTRAST_MODEL_BUILD	3
+#define TIMER_CLOCK_BUILD			4
+#define TIME_ERROR_BUILD			5
 
 #define DETECT_STR		"*WABBIT*"
 #define DETECT_CMP_STR	"*WABCMP*"
@@ -46,6 +50,7 @@ typedef struct {
 
 #define NO_CMP			0
 #define ZLIB_CMP		1
+#define LZ_CMP			2
 
 #define SAVE_HEADERSIZE	116
 
@@ -67,14 +72,21 @@ typedef struct {
 #define FLASH_BREAKS_tag		"FBRK"
 #define NUM_FLASH_BREAKS_tag	"NFBK"
 #define NUM_RAM_BREAKS_tag		"NRBK"
+#define ROM_BASE_tag			"RBAS"
+#define ROM_DELTA_tag			"RDLT"
 
 #define MAX_SAVESTATE_AUTHOR_LENGTH 32
 #define MAX_SAVESTATE_COMMENT_LENGTH 64
 
 LPCALC DuplicateCalc(LPCALC lpCalc);
-void WriteSave(const TCHAR *, SAVESTATE_t *, int);
+void WriteSave(const TCHAR *, SAVESTATE_t *, int compress, int level);
+int GetSaveSize(SAVESTATE_t *);
+int GetSlotSize(LPCALC);
+int WriteSaveBuffer(unsigned char *, int, SAVESTATE_t *);
+SAVESTATE_t* ReadSaveBuffer(const unsigned char *, int);
 BOOL LoadSlot(SAVESTATE_t* , LPCALC);
 SAVESTATE_t* SaveSlot(LPCALC, const TCHAR *author, const TCHAR *comment);
+SAVESTATE_t* SaveSlotDelta(LPCALC, const TCHAR *author, const TCHAR *comment);
 SAVESTATE_t* CreateSave(const TCHAR *author, const TCHAR *comment, const CalcModel model);
 SAVESTATE_t* ReadSave(RFILE *ifile);
 void FreeSave(SAVESTATE_t *);
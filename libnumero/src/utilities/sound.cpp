@@ -29,10 +29,11 @@ static void CALLBACK FillSoundBuffer(HWAVEOUT,
 				waveOutWrite(audio->hWaveOut, waveheader, sizeof(WAVEHDR));
 			} else audio->endsnd++;
 		} else {
-			if ((audio->PlayTime + (BANK_TIME * 1.5f)) < (audio->timer_c->elapsed)) {
-				if ((audio->PlayTime + (BANK_TIME * ((float)(BUFFER_BANKS * 2)))) < audio->timer_c->elapsed) {
+			int64_t now = (int64_t) tc_clock(audio->timer_c);
+			if ((audio->PlayTime + (BANK_TIME * 3 / 2)) < now) {
+				if ((audio->PlayTime + (BANK_TIME * (BUFFER_BANKS * 2))) < now) {
 
-					audio->PlayTime = audio->timer_c->elapsed - (BANK_TIME * ((float)BUFFER_BANKS));
+					audio->PlayTime = now - (BANK_TIME * BUFFER_BANKS);
 					audio->PlayPnt = (audio->CurPnt - (PREFERED_SAMPLES * BUFFER_BANKS)) % BUFFER_SMAPLES;
 				}
 
@@ -113,12 +114,12 @@ int soundinit(AUDIO_t *audio) {
 	audio->PlayPnt = 0;
 	audio->CurPnt = BUFFER_BANKS * PREFERED_SAMPLES;
 
-	audio->PlayTime = audio->timer_c->elapsed - (((float)BUFFER_BANKS) * ((float)PREFERED_SAMPLES)) / ((float)SAMPLE_RATE);
-	audio->LastFlipLeft = audio->timer_c->elapsed;
+	audio->PlayTime = (int64_t) tc_clock(audio->timer_c) - BANK_TIME * BUFFER_BANKS;
+	audio->LastFlipLeft = (int64_t) tc_clock(audio->timer_c);
 	audio->HighLengLeft = 0;
-	audio->LastFlipRight = audio->timer_c->elapsed;
+	audio->LastFlipRight = (int64_t) tc_clock(audio->timer_c);
 	audio->HighLengRight = 0;
-	audio->LastSample = audio->timer_c->elapsed;
+	audio->LastSample = (int64_t) tc_clock(audio->timer_c);
 	audio->LeftOn = 0;
 	audio->RightOn = 0;
 
@@ -190,7 +191,7 @@ int playsound(AUDIO_t *audio) {
 		soundinit(audio);
 	} else {
 		int i, b;
-		audio->PlayTime = audio->timer_c->elapsed - (BANK_TIME * ((float)BUFFER_BANKS));
+		audio->PlayTime = (int64_t) tc_clock(audio->timer_c) - (BANK_TIME * BUFFER_BANKS);
 		audio->PlayPnt = (audio->CurPnt - (PREFERED_SAMPLES * BUFFER_BANKS)) % BUFFER_SMAPLES;
 		for (b = 0; b < BUFFER_BANKS; b++) {
 			for (i = 0; i < PREFERED_SAMPLES; i++) {
@@ -221,9 +222,9 @@ int FlippedLeft(CPU_t *cpu, int on) {
 	AUDIO_t *audio = &link->audio;
 	if (!audio->enabled) return 1;
 	if (on == 1) {
-		audio->LastFlipLeft = cpu->timer_c->elapsed;
+		audio->LastFlipLeft = (int64_t) tc_clock(cpu->timer_c);
 	} else if (on == 0) {
-		audio->HighLengLeft += (cpu->timer_c->elapsed - audio->LastFlipLeft);
+		audio->HighLengLeft += ((int64_t) tc_clock(cpu->timer_c) - audio->LastFlipLeft);
 	}
 	audio->LeftOn = on;
 	return 0;
@@ -234,9 +235,9 @@ int FlippedRight(CPU_t *cpu, int on) {
 	AUDIO_t* audio = &link->audio;
 	if (!audio->enabled) return 1;
 	if (on == 1) {
-		audio->LastFlipRight = cpu->timer_c->elapsed;
+		audio->LastFlipRight = (int64_t) tc_clock(cpu->timer_c);
 	} else if (on == 0) {
-		audio->HighLengRight += (cpu->timer_c->elapsed - audio->LastFlipRight);
+		audio->HighLengRight += ((int64_t) tc_clock(cpu->timer_c) - audio->LastFlipRight);
 	}
 	audio->RightOn = on;
 	return 0;
@@ -253,7 +254,7 @@ int nextsample(CPU_t *cpu) {
 	unsigned char right;
 	if (!audio->enabled) return 1;
 
-	if (cpu->timer_c->elapsed < (audio->LastSample + SAMPLE_LENGTH)) return 0;
+	if ((int64_t) tc_clock(cpu->timer_c) < (audio->LastSample + SAMPLE_LENGTH)) return 0;
 
 	if (audio->RightOn == 1) {
 		if ((audio->LastSample + SAMPLE_LENGTH) > audio->LastFlipRight) {
@@ -287,7 +288,7 @@ int nextsample(CPU_t *cpu) {
 		//		puts("right greater than Sample length");
 	}
 
-	tmp = (audio->HighLengLeft * max * SAMPLE_RATE) + lower;
+	tmp = (((double) audio->HighLengLeft / SAMPLE_LENGTH) * max) + lower;
 	if (tmp < 0) {
 		puts("Left less than 0");
 		tmp = 0;
@@ -298,7 +299,7 @@ int nextsample(CPU_t *cpu) {
 	}
 	left = (unsigned char)tmp;
 
-	tmp = (audio->HighLengRight * max * SAMPLE_RATE) + lower;
+	tmp = (((double) audio->HighLengRight / SAMPLE_LENGTH) * max) + lower;
 	if (tmp < 0) {
 		puts("Right less than 0");
 		tmp = 0;
@@ -318,9 +319,9 @@ int nextsample(CPU_t *cpu) {
 	audio->HighLengLeft = 0;
 	audio->LastSample += SAMPLE_LENGTH;
 
-	if ((audio->LastSample + (SAMPLE_LENGTH*2.0f)) < cpu->timer_c->elapsed) {
+	if ((audio->LastSample + (SAMPLE_LENGTH * 2)) < (int64_t) tc_clock(cpu->timer_c)) {
 		puts("Last sample out of sync");
-		audio->LastSample = cpu->timer_c->elapsed;
+		audio->LastSample = (int64_t) tc_clock(cpu->timer_c);
 	}
 
 	return 0;
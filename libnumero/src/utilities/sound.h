@@ -10,8 +10,8 @@
 #define BUFFER_BANKS		(4)
 
 
-#define BANK_TIME			(((float) PREFERED_SAMPLES) / ((float) SAMPLE_RATE))
-#define SAMPLE_LENGTH		((1.0f) / ((float) SAMPLE_RATE))
+#define SAMPLE_LENGTH		((int64_t) CLOCK_HZ(SAMPLE_RATE))
+#define BANK_TIME			(SAMPLE_LENGTH * PREFERED_SAMPLES)
 #define SAMPLE_SIZE_BITS	(SAMPLE_SIZE << 3)
 #define BANK_SIZE			(PREFERED_SAMPLES * CHANNELS * SAMPLE_SIZE)
 
@@ -48,16 +48,16 @@ typedef struct {
 	int CurPnt;
 	int PlayPnt;
 	
-	double PlayTime;
-	double LastSample;
+	int64_t PlayTime;
+	int64_t LastSample;
 	
 	int LeftOn;
-	double LastFlipLeft;
-	double HighLengLeft;
+	int64_t LastFlipLeft;
+	int64_t HighLengLeft;
 	
 	int RightOn;
-	double LastFlipRight;
-	double HighLengRight;
+	int64_t LastFlipRight;
+	int64_t HighLengRight;
 	
 	double volume;
 
@@ -0,0 +1,136 @@
+#include "stdafx.h"
+
+#include "tests.h"
+#include "savestate.h"
+
+#define BREAK_TSTATES	500000
+#define BREAK_SETS		3000
+
+// counts de in a loop at 0004
+static const unsigned char break_main[] = {
+	0xF3,						// 0000 di
+	0x31, 0xF0, 0xFF,			// 0001 ld sp,FFF0
+	0x13,						// 0004 inc de
+	0x7A,						// 0005 ld a,d
+	0xAB,						// 0006 xor e
+	0x18, 0xFB,					// 0007 jr 0004
+};
+
+static int break_hits;
+
+static void count_break(LPCALC) {
+	break_hits++;
+}
+
+// the expected type of every address, flash first, then ram
+static unsigned char *break_types(memc *mem) {
+	return (unsigned char *) calloc(mem->flash_size + mem->ram_size, 1);
+}
+
+static BOOL same_breaks(memc *mem, const unsigned char *types) {
+	int count = 0;
+	for (int i = 0; i < mem->flash_size + mem->ram_size; i++) {
+		BOOL is_ram = i >= mem->flash_size;
+		waddr_t waddr = addr32_to_waddr(is_ram ? i - mem->flash_size : i, is_ram);
+		if (check_break(mem, waddr) != ((types[i] & NORMAL_BREAK) != 0) ||
+			check_mem_write_break(mem, waddr) != ((types[i] & MEM_WRITE_BREAK) != 0) ||
+			check_mem_read_break(mem, waddr) != ((types[i] & MEM_READ_BREAK) != 0)) {
+			return FALSE;
+		}
+		count += types[i] != 0;
+	}
+	return count == mem->break_count;
+}
+
+/*
+ * Every address of flash and ram reports exactly the breakpoints set on
+ * it while the set grows, loses entries and goes through a save.
+ */
+BOOL test_break_set(void) {
+	LPCALC lpCalc = test_boot(break_main, sizeof(break_main));
+	CHECK(lpCalc != NULL);
+	memc *mem = &lpCalc->mem_c;
+	unsigned char *types = break_types(mem);
+	CHECK(types != NULL);
+	CHECK(same_breaks(mem, types));
+
+	int total = mem->flash_size + mem->ram_size;
+	for (int i = 0; i < BREAK_SETS; i++) {
+		int addr = (int) (((unsigned int) i * 7919u * 977u) % (unsigned int) total);
+		BOOL is_ram = addr >= mem->flash_size;
+		waddr_t waddr = addr32_to_waddr(is_ram ? addr - mem->flash_size : addr, is_ram);
+		switch (i % 3) {
+			case 0:
+				set_break(mem, waddr);
+				types[addr] |= NORMAL_BREAK;
+				break;
+			case 1:
+				set_mem_write_break(mem, waddr);
+				types[addr] |= MEM_WRITE_BREAK;
+				break;
+			default:
+				set_mem_read_break(mem, waddr);
+				set_break(mem, waddr);
+				types[addr] |= MEM_READ_BREAK | NORMAL_BREAK;
+				break;
+		}
+	}
+	CHECK(same_breaks(mem, types));
+
+	// through a save into a calc without breakpoints
+	SAVESTATE_t *save = SaveSlot(lpCalc, "test", "breaks");
+	CHECK(save != NULL);
+	LPCALC loaded = test_boot(break_main, sizeof(break_main));
+	CHECK(loaded != NULL);
+	CHECK(LoadSlot(save, loaded));
+	CHECK(same_breaks(&loaded->mem_c, types));
+	FreeSave(save);
+	test_free(loaded);
+
+	for (int i = 0; i < BREAK_SETS; i += 2) {
+		int addr = (int) (((unsigned int) i * 7919u * 977u) % (unsigned int) total);
+		BOOL is_ram = addr >= mem->flash_size;
+		waddr_t waddr = addr32_to_waddr(is_ram ? addr - mem->flash_size : addr, is_ram);
+		clear_break(mem, waddr);
+		clear_mem_read_break(mem, waddr);
+		types[addr] &= ~(NORMAL_BREAK | MEM_READ_BREAK);
+	}
+	CHECK(same_breaks(mem, types));
+
+	free(types);
+	test_free(lpCalc);
+	return TRUE;
+}
+
+/*
+ * A breakpoint stops the run before its instruction, even in code that
+ * was already translated, and once cleared the run goes on to the end.
+ */
+BOOL test_break_run(void) {
+	LPCALC lpCalc = test_boot(break_main, sizeof(break_main));
+	CHECK(lpCalc != NULL);
+	lpCalc->breakpoint_callback = count_break;
+	break_hits = 0;
+	calc_run_tstates(lpCalc, BREAK_TSTATES);
+	CHECK(break_hits == 0 && lpCalc->running);
+
+	waddr_t waddr = addr16_to_waddr(&lpCalc->mem_c, 0x0006);
+	set_break(&lpCalc->mem_c, waddr);
+	uint64_t start = lpCalc->timer_c.tstates;
+	calc_run_tstates(lpCalc, BREAK_TSTATES);
+	CHECK(break_hits == 1 && !lpCalc->running);
+	CHECK(lpCalc->cpu.pc == 0x0006);
+	CHECK(lpCalc->timer_c.tstates - start < 100);
+
+	// stopped at the breakpoint, the next run starts on it
+	clear_break(&lpCalc->mem_c, waddr);
+	CHECK(lpCalc->mem_c.break_count == 0);
+	calc_set_running(lpCalc, TRUE);
+	start = lpCalc->timer_c.tstates;
+	calc_run_tstates(lpCalc, BREAK_TSTATES);
+	CHECK(break_hits == 1 && lpCalc->running);
+	CHECK(lpCalc->timer_c.tstates - start >= BREAK_TSTATES - 100);
+
+	test_free(lpCalc);
+	return TRUE;
+}
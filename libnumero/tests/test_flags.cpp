@@ -0,0 +1,267 @@
+#include "stdafx.h"
+
+#include "tests.h"
+
+#define FLAGS_TSTATES	3000000
+#define FLAGS_LOG		0xFFF0		// the cases push af downwards from here
+#define FLAGS_IX		0xC100
+
+/*
+ * FNV-1a of ram and the final registers after the program below, recorded
+ * with eager flags. Lazy flags have to reproduce it exactly.
+ */
+#define FLAGS_DIGEST	0x770c0b5accb10da8ULL
+
+typedef struct {
+	unsigned char bytes[4];
+	int size;
+} op_t;
+
+typedef struct {
+	unsigned char code[PAGE_SIZE];
+	int pos;
+	int log;					// where the next case pushes af
+} program_t;
+
+// add, adc, sub, sbc, and, xor, or, cp a,b
+static const op_t alu_ops[] = {
+	{ { 0x80 }, 1 }, { { 0x88 }, 1 }, { { 0x90 }, 1 }, { { 0x98 }, 1 },
+	{ { 0xA0 }, 1 }, { { 0xA8 }, 1 }, { { 0xB0 }, 1 }, { { 0xB8 }, 1 },
+};
+
+// the flags of these are only recorded with lazy flags
+static const op_t lazy_ops[] = {
+	{ { 0x80 }, 1 },			// add a,b
+	{ { 0x90 }, 1 },			// sub b
+	{ { 0xA0 }, 1 },			// and b
+	{ { 0xB0 }, 1 },			// or b
+	{ { 0xB8 }, 1 },			// cp b
+	{ { 0x3C }, 1 },			// inc a
+	{ { 0x3D }, 1 },			// dec a
+};
+
+// each reads or keeps part of the flags a lazy op left behind
+static const op_t flag_readers[] = {
+	{ { 0x37 }, 1 },			// scf
+	{ { 0x3F }, 1 },			// ccf
+	{ { 0x2F }, 1 },			// cpl
+	{ { 0x27 }, 1 },			// daa
+	{ { 0x17 }, 1 },			// rla
+	{ { 0x1F }, 1 },			// rra
+	{ { 0x07 }, 1 },			// rlca
+	{ { 0x0F }, 1 },			// rrca
+	{ { 0x88 }, 1 },			// adc a,b
+	{ { 0x98 }, 1 },			// sbc a,b
+	{ { 0x3C }, 1 },			// inc a
+	{ { 0x3D }, 1 },			// dec a
+	{ { 0xED, 0x44 }, 2 },		// neg
+	{ { 0xCB, 0x7F }, 2 },		// bit 7,a
+	{ { 0xCB, 0x47 }, 2 },		// bit 0,a
+	{ { 0xCB, 0x17 }, 2 },		// rl a
+	{ { 0xCB, 0x1F }, 2 },		// rr a
+	{ { 0x08, 0x80, 0x08 }, 3 },	// ex af,af' / add a,b / ex af,af'
+	{ { 0xF5, 0xC1, 0xC5, 0xF1 }, 4 },	// push af / pop bc / push bc / pop af
+	{ { 0x30, 0x00 }, 2 },		// jr nc,$+2
+	{ { 0x28, 0x00 }, 2 },		// jr z,$+2
+};
+
+// the same ops through the ix and iy handler sets, (ix+0) holds the operand
+static const op_t index_ops[] = {
+	{ { 0xDD, 0x86, 0x00 }, 3 },	// add a,(ix+0)
+	{ { 0xDD, 0x8E, 0x00 }, 3 },	// adc a,(ix+0)
+	{ { 0xDD, 0x96, 0x00 }, 3 },	// sub (ix+0)
+	{ { 0xDD, 0x9E, 0x00 }, 3 },	// sbc a,(ix+0)
+	{ { 0xDD, 0xA6, 0x00 }, 3 },	// and (ix+0)
+	{ { 0xDD, 0xAE, 0x00 }, 3 },	// xor (ix+0)
+	{ { 0xDD, 0xB6, 0x00 }, 3 },	// or (ix+0)
+	{ { 0xFD, 0xBE, 0x00 }, 3 },	// cp (iy+0)
+	{ { 0xDD, 0x34, 0x00 }, 3 },	// inc (ix+0)
+	{ { 0xFD, 0x35, 0x00 }, 3 },	// dec (iy+0)
+	{ { 0xDD, 0x85 }, 2 },		// add a,ixl
+	{ { 0xFD, 0x24 }, 2 },		// inc iyh
+};
+
+// add hl,bc / adc hl,bc / sbc hl,bc
+static const op_t wide_ops[] = {
+	{ { 0x09 }, 1 }, { { 0xED, 0x4A }, 2 }, { { 0xED, 0x42 }, 2 },
+};
+
+static const int values[] = { 0x00, 0x01, 0x0F, 0x10, 0x7F, 0x80, 0xFF };
+static const int index_values[] = { 0x00, 0x7F, 0x80, 0xFF };
+static const int wide_values[] = { 0x0000, 0x0001, 0x7FFF, 0x8000, 0xFFFF };
+static const int reader_pairs[][2] = { { 0x7F, 0x01 }, { 0x0F, 0x01 }, { 0xFF, 0xFF } };
+
+static void emit(program_t *p, int count, ...) {
+	va_list args;
+	va_start(args, count);
+	for (int i = 0; i < count; i++) {
+		int value = va_arg(args, int);
+		if (p->pos < PAGE_SIZE) {
+			p->code[p->pos] = (unsigned char) value;
+		}
+		p->pos++;
+	}
+	va_end(args);
+}
+
+static void emit_op(program_t *p, const op_t *op) {
+	for (int i = 0; i < op->size; i++) {
+		emit(p, 1, op->bytes[i]);
+	}
+}
+
+// ld bc,a:f / push bc / pop af / ld b,operand
+static void emit_af(program_t *p, int a, int f, int operand) {
+	emit(p, 5, 0x01, f, a, 0xC5, 0xF1);
+	emit(p, 2, 0x06, operand);
+}
+
+// push af onto the log, returns where f landed
+static int emit_log(program_t *p) {
+	emit(p, 1, 0xF5);
+	p->log -= 2;
+	return p->log;
+}
+
+/*
+ * Interrupts log a and f of the code they interrupted at (C000), the main
+ * part logs every case on the stack and then loops on ops that feed their
+ * carry into the next round.
+ */
+static int build_flags(program_t *p, int *add_log, int *sub_log) {
+	p->pos = 0;
+	p->log = FLAGS_LOG;
+	emit(p, 1, 0xF3);							// di
+	emit(p, 3, 0x31, FLAGS_LOG & 0xFF, FLAGS_LOG >> 8);	// ld sp,FFF0
+	emit(p, 4, 0xDD, 0x21, FLAGS_IX & 0xFF, FLAGS_IX >> 8);	// ld ix,C100
+	emit(p, 4, 0xFD, 0x21, FLAGS_IX & 0xFF, FLAGS_IX >> 8);	// ld iy,C100
+	emit(p, 3, 0xC3, 0x00, 0x01);				// jp 0100
+
+	p->pos = 0x38;
+	emit(p, 4, 0xF5, 0xC5, 0xE5, 0xF5);			// push af / bc / hl / af
+	emit(p, 1, 0xC1);							// pop bc
+	emit(p, 3, 0x2A, 0x00, 0xC0);				// ld hl,(C000)
+	emit(p, 4, 0x71, 0x23, 0x70, 0x23);			// ld (hl),c / inc hl / ld (hl),b / inc hl
+	emit(p, 3, 0x22, 0x00, 0xC0);				// ld (C000),hl
+	emit(p, 7, 0xAF, 0xD3, 0x03, 0x3E, 0x0A, 0xD3, 0x03);	// acknowledge
+	emit(p, 5, 0xE1, 0xC1, 0xF1, 0xFB, 0xC9);	// pop hl / bc / af, ei, ret
+
+	p->pos = 0x100;
+	for (int op = 0; op < (int) ARRAYSIZE(alu_ops); op++) {
+		BOOL reads_carry = alu_ops[op].bytes[0] == 0x88 || alu_ops[op].bytes[0] == 0x98;
+		for (int i = 0; i < (int) ARRAYSIZE(values); i++) {
+			for (int j = 0; j < (int) ARRAYSIZE(values); j++) {
+				for (int f = reads_carry ? 0 : (i + j) & 1; f < 2; f++) {
+					emit_af(p, values[i], f ? 0xFF : 0x00, values[j]);
+					emit_op(p, &alu_ops[op]);
+					int log = emit_log(p);
+					if (op == 0 && values[i] == 0x7F && values[j] == 0x01) {
+						*add_log = log;
+					}
+					if (op == 2 && values[i] == 0x00 && values[j] == 0x01) {
+						*sub_log = log;
+					}
+				}
+			}
+		}
+	}
+
+	for (int op = 0; op < (int) ARRAYSIZE(lazy_ops); op++) {
+		for (int reader = 0; reader < (int) ARRAYSIZE(flag_readers); reader++) {
+			for (int i = 0; i < (int) ARRAYSIZE(reader_pairs); i++) {
+				emit_af(p, reader_pairs[i][0], i & 1 ? 0xFF : 0x00, reader_pairs[i][1]);
+				emit_op(p, &lazy_ops[op]);
+				emit_op(p, &flag_readers[reader]);
+				emit_log(p);
+			}
+		}
+	}
+
+	for (int op = 0; op < (int) ARRAYSIZE(index_ops); op++) {
+		for (int i = 0; i < (int) ARRAYSIZE(index_values); i++) {
+			for (int j = 0; j < (int) ARRAYSIZE(index_values); j++) {
+				emit(p, 4, 0xDD, 0x36, 0x00, index_values[j]);	// ld (ix+0),operand
+				emit_af(p, index_values[i], (i + j) & 1 ? 0xFF : 0x00, 0);
+				emit_op(p, &index_ops[op]);
+				emit_log(p);
+			}
+		}
+	}
+
+	for (int op = 0; op < (int) ARRAYSIZE(wide_ops); op++) {
+		for (int i = 0; i < (int) ARRAYSIZE(wide_values); i++) {
+			for (int j = 0; j < (int) ARRAYSIZE(wide_values); j++) {
+				emit(p, 5, 0x11, (i + j) & 1 ? 0xFF : 0x00, 0x00, 0xD5, 0xF1);	// f through de
+				emit(p, 3, 0x21, wide_values[i] & 0xFF, wide_values[i] >> 8);
+				emit(p, 3, 0x01, wide_values[j] & 0xFF, wide_values[j] >> 8);
+				emit_op(p, &wide_ops[op]);
+				emit_log(p);
+				emit(p, 1, 0xE5);					// push hl
+				p->log -= 2;
+			}
+		}
+	}
+
+	// ld a,i and ld a,r copy iff2 into p/v
+	emit(p, 4, 0x3E, 0x5A, 0xED, 0x47);		// ld a,5A / ld i,a
+	emit(p, 3, 0xFB, 0xED, 0x57);			// ei / ld a,i
+	emit_log(p);
+	emit(p, 3, 0xF3, 0xED, 0x57);			// di / ld a,i
+	emit_log(p);
+	emit(p, 3, 0xFB, 0xED, 0x5F);			// ei / ld a,r
+	emit_log(p);
+	emit(p, 3, 0xF3, 0xED, 0x5F);			// di / ld a,r
+	emit_log(p);
+
+	emit(p, 3, 0x31, 0x00, 0xE0);			// ld sp,E000
+	emit(p, 6, 0x21, 0x02, 0xC0, 0x22, 0x00, 0xC0);	// ld hl,C002 / ld (C000),hl
+	emit(p, 2, 0xED, 0x56);					// im 1
+	emit(p, 4, 0x3E, 0x0A, 0xD3, 0x03);		// ld a,0A / out (3),a
+	emit(p, 1, 0xFB);						// ei
+	emit(p, 7, 0x13, 0x83, 0x8A, 0x27, 0x17, 0x18, 0xF9);	// inc de / add a,e / adc a,d / daa / rla / jr
+	return p->pos;
+}
+
+static uint64_t fnv(uint64_t hash, const unsigned char *data, int size) {
+	for (int i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ULL;
+	}
+	return hash;
+}
+
+/*
+ * Flags out of the 8 and 16 bit alu, after partial flag updates, through
+ * push/pop af, ex af,af', the index handler sets and at interrupt entry
+ * must match the eager flags bit for bit, undocumented bits included.
+ */
+BOOL test_flags(void) {
+	static program_t program;
+	int add_log = 0, sub_log = 0;
+	int size = build_flags(&program, &add_log, &sub_log);
+	CHECK(size <= PAGE_SIZE);
+
+	LPCALC lpCalc = test_boot(program.code, size);
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, FLAGS_TSTATES);
+
+	memc *mem = &lpCalc->mem_c;
+	CPU_t *cpu = &lpCalc->cpu;
+	// 7F + 01 and 00 - 01
+	CHECK(mem_read(mem, add_log) == 0x94 && mem_read(mem, add_log + 1) == 0x80);
+	CHECK(mem_read(mem, sub_log) == 0xBB && mem_read(mem, sub_log + 1) == 0xFF);
+	int interrupts = ((mem_read(mem, 0xC001) << 8 | mem_read(mem, 0xC000)) - 0xC002) / 2;
+	CHECK(interrupts > 10);
+
+	unsigned char regs[] = {
+		cpu->a, (unsigned char) get_f(cpu), cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l,
+	};
+	uint64_t digest = fnv(14695981039346656037ULL, mem->ram, mem->ram_size);
+	digest = fnv(digest, regs, sizeof(regs));
+	if (digest != FLAGS_DIGEST) {
+		printf("flags digest %016llx\n", (unsigned long long) digest);
+	}
+	CHECK(digest == FLAGS_DIGEST);
+
+	test_free(lpCalc);
+	return TRUE;
+}
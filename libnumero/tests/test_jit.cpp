@@ -0,0 +1,95 @@
+#include "stdafx.h"
+
+#include "tests.h"
+
+#define JIT_TSTATES		2000000
+
+/*
+ * Counts de in a loop at 0011 with the timer interrupt enabled. The handler
+ * at 0038 appends r to the log at (C000) and acknowledges.
+ */
+static const unsigned char jit_main[] = {
+	0xF3,						// 0000 di
+	0x31, 0xF0, 0xFF,			// 0001 ld sp,FFF0
+	0x21, 0x02, 0xC0,			// 0004 ld hl,C002
+	0x22, 0x00, 0xC0,			// 0007 ld (C000),hl
+	0xED, 0x56,					// 000A im 1
+	0x3E, 0x0A,					// 000C ld a,0A
+	0xD3, 0x03,					// 000E out (3),a
+	0xFB,						// 0010 ei
+	0x13,						// 0011 inc de
+	0x7A,						// 0012 ld a,d
+	0xAB,						// 0013 xor e
+	0x18, 0xFB,					// 0014 jr 0011
+};
+
+static const unsigned char jit_handler[] = {
+	0xF5,						// 0038 push af
+	0xE5,						// 0039 push hl
+	0x2A, 0x00, 0xC0,			// 003A ld hl,(C000)
+	0xED, 0x5F,					// 003D ld a,r
+	0x77,						// 003F ld (hl),a
+	0x23,						// 0040 inc hl
+	0x22, 0x00, 0xC0,			// 0041 ld (C000),hl
+	0xAF,						// 0044 xor a
+	0xD3, 0x03,					// 0045 out (3),a
+	0x3E, 0x0A,					// 0047 ld a,0A
+	0xD3, 0x03,					// 0049 out (3),a
+	0xE1,						// 004B pop hl
+	0xF1,						// 004C pop af
+	0xFB,						// 004D ei
+	0xC9,						// 004E ret
+};
+
+// with breakpoints set CPU_run never enters translated code
+static void run_to(LPCALC lpCalc, uint64_t end, BOOL interpret) {
+	while (lpCalc->timer_c.tstates < end) {
+		CPU_run(&lpCalc->cpu, end, &lpCalc->running, interpret);
+	}
+}
+
+// programs the boot page byte at addr the way a flash write would
+static void patch_boot_page(LPCALC lpCalc, int addr, unsigned char value) {
+	int offset = lpCalc->mem_c.flash_size - PAGE_SIZE + addr;
+	lpCalc->mem_c.flash[offset] = value;
+	set_flash_dirty(&lpCalc->mem_c, offset, 1);
+}
+
+/*
+ * Translated code has to leave the cpu, the tstates and the interrupt log
+ * exactly as the interpreter does, and must not outlive a rewrite of the
+ * flash it came from.
+ */
+BOOL test_jit(void) {
+	unsigned char code[0x38 + sizeof(jit_handler)] = { 0 };
+	memcpy(code, jit_main, sizeof(jit_main));
+	memcpy(code + 0x38, jit_handler, sizeof(jit_handler));
+
+	LPCALC interpreted = test_boot(code, sizeof(code));
+	LPCALC translated = test_boot(code, sizeof(code));
+	CHECK(interpreted != NULL && translated != NULL);
+
+	run_to(interpreted, JIT_TSTATES, TRUE);
+	run_to(translated, JIT_TSTATES, FALSE);
+	CHECK(interpreted->cpu.de != 0);
+	CHECK(test_same_cpu(&translated->cpu, &interpreted->cpu));
+	CHECK(test_same_ram(translated, interpreted));
+#ifdef WITH_JIT
+	CHECK(translated->cpu.jit != NULL);
+#endif
+
+	// inc de becomes inc bc, the old block must not run again
+	uint16_t de = translated->cpu.de;
+	patch_boot_page(interpreted, 0x11, 0x03);
+	patch_boot_page(translated, 0x11, 0x03);
+	run_to(interpreted, 2 * JIT_TSTATES, TRUE);
+	run_to(translated, 2 * JIT_TSTATES, FALSE);
+	CHECK(translated->cpu.de == de);
+	CHECK(translated->cpu.bc != 0);
+	CHECK(test_same_cpu(&translated->cpu, &interpreted->cpu));
+	CHECK(test_same_ram(translated, interpreted));
+
+	test_free(interpreted);
+	test_free(translated);
+	return TRUE;
+}
@@ -0,0 +1,97 @@
+#include "stdafx.h"
+
+#include "tests.h"
+#include "lz.h"
+
+#define LZ_TEST_SIZE	(64 * 1024)
+
+// fills data with one of the shapes savestate chunks come in
+static void lz_fill(unsigned char *data, int size, int shape) {
+	uint32_t seed = 12345;
+	for (int i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		switch (shape) {
+			case 0:
+				data[i] = 0;				// erased ram
+				break;
+			case 1:
+				data[i] = 0xFF;				// erased flash
+				break;
+			case 2:
+				data[i] = (unsigned char) (seed >> 16);	// incompressible
+				break;
+			case 3:
+				data[i] = "abc"[i % 3];		// overlapping matches
+				break;
+			default: {
+				// literals between copies from 293 to 300 bytes back
+				int from = i - 300 + (int) (seed >> 29);
+				data[i] = from < 0 || (seed >> 28) < 3 ? (unsigned char) (seed >> 16) : data[from];
+				break;
+			}
+		}
+	}
+}
+
+static BOOL check_round_trip(const unsigned char *data, int size, int level) {
+	int bound = lz_bound(size);
+	unsigned char *packed = (unsigned char *) malloc(bound);
+	unsigned char *unpacked = (unsigned char *) malloc(size + 1);
+	CHECK(packed != NULL && unpacked != NULL);
+
+	CHECK(lz_compress(data, size, packed, bound - 1, level) == 0);
+	int packed_size = lz_compress(data, size, packed, bound, level);
+	CHECK(packed_size > 0 && packed_size <= bound);
+	CHECK(lz_decompress(packed, packed_size, unpacked, size) == size);
+	CHECK(memcmp(unpacked, data, size) == 0);
+	if (size > 0) {
+		CHECK(lz_decompress(packed, packed_size, unpacked, size - 1) == -1);
+		// cut short, the decoder has to stop inside the buffers
+		int result = lz_decompress(packed, packed_size / 2, unpacked, size);
+		CHECK(result == -1 || (result >= 0 && result <= size));
+	}
+
+	free(packed);
+	free(unpacked);
+	return TRUE;
+}
+
+/*
+ * The codec round trips every shape of data at every level, never writes
+ * more than lz_bound and refuses output that does not fit.
+ */
+BOOL test_lz(void) {
+	static const int sizes[] = { 0, 1, 5, 15, 16, 270, 4096, LZ_TEST_SIZE };
+	unsigned char *data = (unsigned char *) malloc(LZ_TEST_SIZE);
+	CHECK(data != NULL);
+
+	for (int shape = 0; shape < 5; shape++) {
+		for (int i = 0; i < (int) ARRAYSIZE(sizes); i++) {
+			lz_fill(data, sizes[i], shape);
+			for (int level = LZ_MIN_LEVEL; level <= LZ_MAX_LEVEL; level += 4) {
+				if (!check_round_trip(data, sizes[i], level)) {
+					printf("shape %d, size %d, level %d\n", shape, sizes[i], level);
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	// lengths run on in 255s long enough to overflow an int
+	int run = 9 * 1024 * 1024;
+	unsigned char *stream = (unsigned char *) malloc(run + 4);
+	CHECK(stream != NULL);
+	stream[0] = 0xF0;
+	memset(stream + 1, 0xFF, run);
+	CHECK(lz_decompress(stream, run + 1, data, LZ_TEST_SIZE) == -1);
+	stream[0] = 0x1F;
+	stream[1] = 'a';
+	stream[2] = 1;
+	stream[3] = 0;
+	memset(stream + 4, 0xFF, run);
+	CHECK(lz_decompress(stream, run + 4, data, LZ_TEST_SIZE) == -1);
+	free(stream);
+
+	free(data);
+	return TRUE;
+}
@@ -0,0 +1,346 @@
+#include "stdafx.h"
+
+#include "tests.h"
+#include "savestate.h"
+#include "lz.h"
+
+#define SAVE_TSTATES	500000
+
+/*
+ * Counts through C000-FFFF from C100 with the timer interrupt enabled,
+ * the handler at 0038 counts interrupts in (C000).
+ */
+static const unsigned char save_main[] = {
+	0xF3,						// 0000 di
+	0x31, 0xF0, 0xFF,			// 0001 ld sp,FFF0
+	0x21, 0x00, 0xC1,			// 0004 ld hl,C100
+	0xED, 0x56,					// 0007 im 1
+	0x3E, 0x0A,					// 0009 ld a,0A
+	0xD3, 0x03,					// 000B out (3),a
+	0xFB,						// 000D ei
+	0x34,						// 000E inc (hl)
+	0x23,						// 000F inc hl
+	0xCB, 0xFC,					// 0010 set 7,h
+	0xCB, 0xF4,					// 0012 set 6,h
+	0x18, 0xF8,					// 0014 jr 000E
+};
+
+static const unsigned char save_handler[] = {
+	0xF5,						// 0038 push af
+	0x3A, 0x00, 0xC0,			// 0039 ld a,(C000)
+	0x3C,						// 003C inc a
+	0x32, 0x00, 0xC0,			// 003D ld (C000),a
+	0xAF,						// 0040 xor a
+	0xD3, 0x03,					// 0041 out (3),a
+	0x3E, 0x0A,					// 0043 ld a,0A
+	0xD3, 0x03,					// 0045 out (3),a
+	0xF1,						// 0047 pop af
+	0xFB,						// 0048 ei
+	0xC9,						// 0049 ret
+};
+
+static LPCALC save_boot(void) {
+	unsigned char code[0x38 + sizeof(save_handler)] = { 0 };
+	memcpy(code, save_main, sizeof(save_main));
+	memcpy(code + 0x38, save_handler, sizeof(save_handler));
+	return test_boot(code, sizeof(code));
+}
+
+/*
+ * A calc loaded from save has to run on exactly like the one it was taken
+ * from, interrupts included.
+ */
+static BOOL check_resume(LPCALC lpCalc, SAVESTATE_t *save) {
+	LPCALC loaded = save_boot();
+	CHECK(loaded != NULL);
+	CHECK(LoadSlot(save, loaded));
+	CHECK(test_same_cpu(&loaded->cpu, &lpCalc->cpu));
+	CHECK(test_same_ram(loaded, lpCalc));
+
+	uint64_t end = lpCalc->timer_c.tstates + SAVE_TSTATES;
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+	calc_run_tstates(loaded, SAVE_TSTATES);
+	CHECK(lpCalc->timer_c.tstates >= end);
+	CHECK(test_same_cpu(&loaded->cpu, &lpCalc->cpu));
+	CHECK(test_same_ram(loaded, lpCalc));
+
+	test_free(loaded);
+	return TRUE;
+}
+
+/*
+ * WriteSaveBuffer and ReadSaveBuffer, which the libretro frontend uses,
+ * round trip a save with empty chunks.
+ */
+BOOL test_save_buffer(void) {
+	LPCALC lpCalc = save_boot();
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+	CHECK(mem_read(&lpCalc->mem_c, 0xC000) != 0);
+
+	SAVESTATE_t *save = SaveSlot(lpCalc, "test", "buffer");
+	CHECK(save != NULL);
+	BOOL has_empty = FALSE;
+	for (int i = 0; i < save->chunk_count; i++) {
+		has_empty |= save->chunks[i]->size == 0;
+	}
+	CHECK(has_empty);
+
+	int size = GetSaveSize(save);
+	unsigned char *buffer = (unsigned char *) malloc(size);
+	CHECK(buffer != NULL);
+	CHECK(WriteSaveBuffer(buffer, size - 1, save) == 0);
+	CHECK(WriteSaveBuffer(buffer, size, save) == size);
+	FreeSave(save);
+
+	SAVESTATE_t *read = ReadSaveBuffer(buffer, size);
+	CHECK(read != NULL);
+	CHECK(ReadSaveBuffer(buffer, size - 1) == NULL);
+	// a header that claims to end before the author and comment
+	int short_header[6];
+	memcpy(short_header, buffer + 8, sizeof(short_header));
+	short_header[0] = 8 + sizeof(short_header);
+	unsigned char truncated[8 + sizeof(short_header) + 4 + 8];
+	memcpy(truncated, buffer, 8);
+	memcpy(truncated + 8, short_header, sizeof(short_header));
+	memset(truncated + 8 + sizeof(short_header), 0, sizeof(truncated) - 8 - sizeof(short_header));
+	CHECK(ReadSaveBuffer(truncated, sizeof(truncated)) == NULL);
+	CHECK(ReadSaveBuffer(buffer, 8 + 4 + SAVE_HEADERSIZE - 1) == NULL);
+	free(buffer);
+	CHECK(check_resume(lpCalc, read));
+	FreeSave(read);
+
+	test_free(lpCalc);
+	return TRUE;
+}
+
+/*
+ * GetSlotSize has to be the exact size of a full save and a bound for a
+ * delta save, with and without breakpoints.
+ */
+BOOL test_slot_size(void) {
+	LPCALC lpCalc = save_boot();
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+
+	for (int breaks = 0; breaks < 2; breaks++) {
+		if (breaks) {
+			set_break(&lpCalc->mem_c, addr16_to_waddr(&lpCalc->mem_c, 0x0038));
+			set_break(&lpCalc->mem_c, addr16_to_waddr(&lpCalc->mem_c, 0xC100));
+			CHECK(lpCalc->mem_c.break_count == 2);
+		}
+		SAVESTATE_t *save = SaveSlot(lpCalc, "test", "size");
+		CHECK(save != NULL);
+		CHECK(GetSaveSize(save) == GetSlotSize(lpCalc));
+		FreeSave(save);
+
+		save = SaveSlotDelta(lpCalc, "test", "size");
+		CHECK(save != NULL);
+		CHECK(GetSaveSize(save) <= GetSlotSize(lpCalc));
+		FreeSave(save);
+	}
+
+	test_free(lpCalc);
+	return TRUE;
+}
+
+static CHUNK_t *find_chunk(SAVESTATE_t *save, const char *tag) {
+	for (int i = 0; i < save->chunk_count; i++) {
+		if (memcmp(save->chunks[i]->tag, tag, 4) == 0) {
+			return save->chunks[i];
+		}
+	}
+	return NULL;
+}
+
+static uint32_t read_le32(const unsigned char *data) {
+	return data[0] | data[1] << 8 | data[2] << 16 | (uint32_t) data[3] << 24;
+}
+
+/*
+ * Chunks grow geometrically, so none holds more than twice what it needs.
+ * The interrupt table, written as one block, keeps the layout of the 768
+ * ints it replaced and loads back entry for entry.
+ */
+BOOL test_save_chunks(void) {
+	LPCALC lpCalc = save_boot();
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+
+	CPU_t *cpu = &lpCalc->cpu;
+	for (int i = 0; i < MAX_DEVICES; i++) {
+		cpu->pio.interrupt[i].skip_factor = (unsigned char) (i * 7 + 1);
+		cpu->pio.interrupt[i].skip_count = (unsigned char) (i * 3 + 1);
+	}
+
+	SAVESTATE_t *save = SaveSlot(lpCalc, "test", "chunks");
+	CHECK(save != NULL);
+	for (int i = 0; i < save->chunk_count; i++) {
+		CHUNK_t *chunk = save->chunks[i];
+		CHECK(chunk->alloc >= chunk->size);
+		CHECK(chunk->alloc <= MIN_CHUNK_ALLOC || chunk->alloc <= 2 * chunk->size);
+	}
+
+	// 20 registers, pc and sp, i, r and bus, then 11 ints
+	const int table = 20 + 2 * 2 + 3 + 11 * 4;
+	CHUNK_t *chunk = find_chunk(save, CPU_tag);
+	CHECK(chunk != NULL);
+	CHECK(chunk->size == table + MAX_DEVICES * 3 * 4 + 4);
+	for (int i = 0; i < MAX_DEVICES; i++) {
+		interrupt_t *val = &cpu->pio.interrupt[i];
+		const unsigned char *entry = chunk->data + table + i * 3 * 4;
+		CHECK(read_le32(entry) == (uint32_t) (val->device - cpu->pio.devices));
+		CHECK(read_le32(entry + 4) == val->skip_factor);
+		CHECK(read_le32(entry + 8) == val->skip_count);
+	}
+
+	// loading reschedules the devices in use, they are polled right away.
+	// Unused entries have no device to restore.
+	LPCALC loaded = save_boot();
+	CHECK(loaded != NULL);
+	CHECK(LoadSlot(save, loaded));
+	CHECK(loaded->cpu.pio.num_interrupt == cpu->pio.num_interrupt);
+	for (int i = 0; i < MAX_DEVICES; i++) {
+		interrupt_t *val = &cpu->pio.interrupt[i];
+		interrupt_t *loaded_val = &loaded->cpu.pio.interrupt[i];
+		CHECK(loaded_val->skip_factor == val->skip_factor);
+		if (i < cpu->pio.num_interrupt) {
+			CHECK(loaded_val->device - loaded->cpu.pio.devices == val->device - cpu->pio.devices);
+			CHECK(loaded_val->skip_count == 1);
+		} else {
+			CHECK(loaded_val->skip_count == val->skip_count);
+		}
+	}
+	FreeSave(save);
+
+	test_free(loaded);
+	test_free(lpCalc);
+	return TRUE;
+}
+
+static BOOL same_flash(LPCALC calc1, LPCALC calc2) {
+	return calc1->mem_c.flash_size == calc2->mem_c.flash_size &&
+		memcmp(calc1->mem_c.flash, calc2->mem_c.flash, calc1->mem_c.flash_size) == 0;
+}
+
+// an archive write to the second page from the top, which the program never runs
+static void write_archive(LPCALC lpCalc, unsigned char value) {
+	int offset = lpCalc->mem_c.flash_size - 2 * PAGE_SIZE + 0x100;
+	lpCalc->mem_c.flash[offset] = value;
+	set_flash_dirty(&lpCalc->mem_c, offset, 1);
+}
+
+// loads a save over the calc like the libretro frontend does
+static LPCALC load_file(LPCALC lpCalc, const char *path) {
+	if (lpCalc == NULL || !rom_load(lpCalc, path)) {
+		return NULL;
+	}
+	lpCalc->running = TRUE;
+	return lpCalc;
+}
+
+/*
+ * Delta saves of a calc booted from a ROM hold only the pages written
+ * since. Like the libretro progress save, a delta save taken after a full
+ * save was loaded over the ROM has to load after the next boot of the ROM.
+ */
+BOOL test_delta_save(void) {
+	char full_path[512], delta_path[512];
+	strcpy(full_path, test_path("full.sav"));
+	strcpy(delta_path, test_path("delta.sav"));
+
+	LPCALC lpCalc = save_boot();
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+	write_archive(lpCalc, 0x12);
+
+	SAVESTATE_t *save = SaveSlotDelta(lpCalc, "test", "delta");
+	CHECK(save != NULL);
+	CHECK(find_chunk(save, ROM_tag) == NULL && find_chunk(save, ROM_DELTA_tag) != NULL);
+	WriteSave(delta_path, save, NO_CMP, 0);
+	FreeSave(save);
+	LPCALC loaded = load_file(save_boot(), delta_path);
+	CHECK(loaded != NULL);
+	CHECK(same_flash(loaded, lpCalc));
+	CHECK(test_same_cpu(&loaded->cpu, &lpCalc->cpu));
+	CHECK(test_same_ram(loaded, lpCalc));
+	test_free(loaded);
+
+	save = SaveSlot(lpCalc, "test", "full");
+	CHECK(save != NULL);
+	WriteSave(full_path, save, NO_CMP, 0);
+	FreeSave(save);
+	test_free(lpCalc);
+
+	lpCalc = load_file(save_boot(), full_path);
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+	write_archive(lpCalc, 0x34);
+	save = SaveSlotDelta(lpCalc, "test", "delta");
+	CHECK(save != NULL);
+	CHECK(GetSaveSize(save) <= GetSlotSize(lpCalc));
+	WriteSave(delta_path, save, NO_CMP, 0);
+	FreeSave(save);
+
+	loaded = load_file(save_boot(), delta_path);
+	CHECK(loaded != NULL);
+	CHECK(same_flash(loaded, lpCalc));
+	CHECK(test_same_cpu(&loaded->cpu, &lpCalc->cpu));
+	CHECK(test_same_ram(loaded, lpCalc));
+	test_free(loaded);
+
+	remove(full_path);
+	remove(delta_path);
+	test_free(lpCalc);
+	return TRUE;
+}
+
+static long file_size(const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) {
+		return -1;
+	}
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+/*
+ * LZ compressed saves, full and delta, load back into the same state and
+ * are smaller than the uncompressed ones.
+ */
+BOOL test_lz_save(void) {
+	char path[512];
+	strcpy(path, test_path("lz.sav"));
+
+	LPCALC lpCalc = save_boot();
+	CHECK(lpCalc != NULL);
+	calc_run_tstates(lpCalc, SAVE_TSTATES);
+	write_archive(lpCalc, 0x56);
+
+	for (int delta = 0; delta < 2; delta++) {
+		SAVESTATE_t *save = delta ? SaveSlotDelta(lpCalc, "test", "lz") : SaveSlot(lpCalc, "test", "lz");
+		CHECK(save != NULL);
+		WriteSave(path, save, NO_CMP, 0);
+		long raw_size = file_size(path);
+		CHECK(raw_size == GetSaveSize(save));
+
+		for (int level = LZ_MIN_LEVEL; level <= LZ_MAX_LEVEL; level += LZ_MAX_LEVEL - LZ_MIN_LEVEL) {
+			WriteSave(path, save, LZ_CMP, level);
+			CHECK(file_size(path) > 0 && file_size(path) < raw_size);
+
+			LPCALC loaded = load_file(save_boot(), path);
+			CHECK(loaded != NULL);
+			CHECK(same_flash(loaded, lpCalc));
+			CHECK(test_same_cpu(&loaded->cpu, &lpCalc->cpu));
+			CHECK(test_same_ram(loaded, lpCalc));
+			test_free(loaded);
+		}
+		FreeSave(save);
+	}
+
+	remove(path);
+	test_free(lpCalc);
+	return TRUE;
+}
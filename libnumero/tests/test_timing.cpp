@@ -0,0 +1,122 @@
+#include "stdafx.h"
+
+#include "tests.h"
+#include "device.h"
+
+#define TIMING_TSTATES	3000000
+#define MAX_ENTRIES		256
+
+/*
+ * Enables the first timer interrupt in im 1 and loops at 0011. The
+ * handler at 0038 appends r to the log at (C000) and acknowledges.
+ */
+static const unsigned char timer_main[] = {
+	0xF3,						// 0000 di
+	0x31, 0xF0, 0xFF,			// 0001 ld sp,FFF0
+	0x21, 0x02, 0xC0,			// 0004 ld hl,C002
+	0x22, 0x00, 0xC0,			// 0007 ld (C000),hl
+	0xED, 0x56,					// 000A im 1
+	0x3E, 0x0A,					// 000C ld a,0A
+	0xD3, 0x03,					// 000E out (3),a
+	0xFB,						// 0010 ei
+	0x76,						// 0011 halt
+	0x18, 0xFD,					// 0012 jr 0011
+};
+
+static const unsigned char timer_handler[] = {
+	0xF5,						// 0038 push af
+	0xE5,						// 0039 push hl
+	0x2A, 0x00, 0xC0,			// 003A ld hl,(C000)
+	0xED, 0x5F,					// 003D ld a,r
+	0x77,						// 003F ld (hl),a
+	0x23,						// 0040 inc hl
+	0x22, 0x00, 0xC0,			// 0041 ld (C000),hl
+	0xAF,						// 0044 xor a
+	0xD3, 0x03,					// 0045 out (3),a
+	0x3E, 0x0A,					// 0047 ld a,0A
+	0xD3, 0x03,					// 0049 out (3),a
+	0xE1,						// 004B pop hl
+	0xF1,						// 004C pop af
+	0xFB,						// 004D ei
+	0xC9,						// 004E ret
+};
+
+// replaces the halt loop at 0011 with one that keeps the cpu busy
+static const unsigned char busy_loop[] = {
+	0x13,						// 0011 inc de
+	0x7A,						// 0012 ld a,d
+	0xAB,						// 0013 xor e
+	0x18, 0xFB,					// 0014 jr 0011
+};
+
+/*
+ * Steps until end and returns how many interrupts were taken, with the
+ * tstates of each in entries. With poll_all every interrupt device is
+ * polled after every instruction, which is when the hardware would see
+ * its interrupt.
+ */
+static int run_steps(LPCALC lpCalc, uint64_t end, uint64_t *entries, BOOL poll_all) {
+	CPU_t *cpu = &lpCalc->cpu;
+	int count = 0;
+
+	if (poll_all) {
+		for (int i = 0; i < cpu->pio.num_interrupt; i++) {
+			cpu->pio.interrupt[i].skip_factor = 1;
+		}
+	}
+
+	while (cpu->timer_c->tstates < end) {
+		if (poll_all) {
+			Reset_interrupt_schedule(cpu);
+		}
+		CPU_step(cpu);
+		if (cpu->pc == 0x0038 && count < MAX_ENTRIES) {
+			entries[count++] = cpu->timer_c->tstates;
+		}
+	}
+	return count;
+}
+
+static BOOL check_timing(const unsigned char *code, int size) {
+	LPCALC polled = test_boot(code, size);
+	LPCALC stepped = test_boot(code, size);
+	LPCALC run = test_boot(code, size);
+	CHECK(polled != NULL && stepped != NULL && run != NULL);
+
+	uint64_t polled_entries[MAX_ENTRIES];
+	uint64_t stepped_entries[MAX_ENTRIES];
+	int polled_count = run_steps(polled, TIMING_TSTATES, polled_entries, TRUE);
+	int stepped_count = run_steps(stepped, TIMING_TSTATES, stepped_entries, FALSE);
+	CHECK(polled_count > 10);
+	CHECK(stepped_count == polled_count);
+	CHECK(memcmp(stepped_entries, polled_entries, polled_count * sizeof(uint64_t)) == 0);
+	CHECK(test_same_cpu(&stepped->cpu, &polled->cpu));
+	CHECK(test_same_ram(stepped, polled));
+
+	// halt skips, decoded opcodes and the JIT, with the log in ram
+	// recording r at every interrupt
+	calc_run_tstates(run, TIMING_TSTATES);
+	CHECK(test_same_cpu(&run->cpu, &polled->cpu));
+	CHECK(test_same_ram(run, polled));
+
+	test_free(polled);
+	test_free(stepped);
+	test_free(run);
+	return TRUE;
+}
+
+/*
+ * Device deadlines and the halt skip have to raise the timer interrupt
+ * after the same instruction as polling every device after every one.
+ */
+BOOL test_interrupt_timing(void) {
+	unsigned char code[0x38 + sizeof(timer_handler)] = { 0 };
+	memcpy(code, timer_main, sizeof(timer_main));
+	memcpy(code + 0x38, timer_handler, sizeof(timer_handler));
+	if (!check_timing(code, sizeof(code))) {
+		return FALSE;
+	}
+
+	memcpy(code + 0x11, busy_loop, sizeof(busy_loop));
+	return check_timing(code, sizeof(code));
+}
@@ -0,0 +1,98 @@
+#include "stdafx.h"
+
+#include "tests.h"
+
+#define TEST_ROM_SIZE	(512 * 1024)
+
+typedef struct {
+	const char *name;
+	BOOL (*run)(void);
+} test_t;
+
+static const test_t tests[] = {
+	{ "interrupt_timing", test_interrupt_timing },
+	{ "jit", test_jit },
+	{ "flags", test_flags },
+	{ "save_buffer", test_save_buffer },
+	{ "slot_size", test_slot_size },
+	{ "save_chunks", test_save_chunks },
+	{ "delta_save", test_delta_save },
+	{ "lz", test_lz },
+	{ "lz_save", test_lz_save },
+	{ "break_set", test_break_set },
+	{ "break_run", test_break_run },
+};
+
+const char *test_path(const char *name) {
+	static char path[512];
+	const char *dir = getenv("TMPDIR");
+	snprintf(path, sizeof(path), "%s/numero_test_%s", dir != NULL ? dir : "/tmp", name);
+	return path;
+}
+
+LPCALC test_boot(const unsigned char *code, int size) {
+	unsigned char *rom = (unsigned char *) malloc(TEST_ROM_SIZE);
+	memset(rom, 0xFF, TEST_ROM_SIZE);
+	memcpy(rom + TEST_ROM_SIZE - PAGE_SIZE, code, size);
+
+	const char *path = test_path("boot.rom");
+	FILE *file = fopen(path, "wb");
+	if (file == NULL) {
+		free(rom);
+		return NULL;
+	}
+	fwrite(rom, 1, TEST_ROM_SIZE, file);
+	fclose(file);
+	free(rom);
+
+	LPCALC lpCalc = calc_slot_new();
+	if (lpCalc == NULL || !rom_load(lpCalc, path)) {
+		return NULL;
+	}
+	remove(path);
+	lpCalc->running = TRUE;
+	return lpCalc;
+}
+
+void test_free(LPCALC lpCalc) {
+	if (lpCalc != NULL) {
+		calc_slot_free(lpCalc);
+	}
+}
+
+void test_fail(const char *file, int line, const char *cond) {
+	printf("%s:%d: CHECK(%s) failed\n", file, line, cond);
+}
+
+BOOL test_same_cpu(CPU_t *cpu1, CPU_t *cpu2) {
+	return cpu1->a == cpu2->a && get_f(cpu1) == get_f(cpu2) &&
+		cpu1->bc == cpu2->bc && cpu1->de == cpu2->de && cpu1->hl == cpu2->hl &&
+		cpu1->afp == cpu2->afp && cpu1->bcp == cpu2->bcp &&
+		cpu1->dep == cpu2->dep && cpu1->hlp == cpu2->hlp &&
+		cpu1->ix == cpu2->ix && cpu1->iy == cpu2->iy &&
+		cpu1->pc == cpu2->pc && cpu1->sp == cpu2->sp &&
+		cpu1->i == cpu2->i && cpu1->r == cpu2->r &&
+		cpu1->iff1 == cpu2->iff1 && cpu1->iff2 == cpu2->iff2 &&
+		cpu1->imode == cpu2->imode && cpu1->halt == cpu2->halt &&
+		cpu1->timer_c->tstates == cpu2->timer_c->tstates;
+}
+
+BOOL test_same_ram(LPCALC calc1, LPCALC calc2) {
+	return calc1->mem_c.ram_size == calc2->mem_c.ram_size &&
+		memcmp(calc1->mem_c.ram, calc2->mem_c.ram, calc1->mem_c.ram_size) == 0;
+}
+
+int main(void) {
+	int count = (int) ARRAYSIZE(tests);
+	int failed = 0;
+	for (int i = 0; i < count; i++) {
+		BOOL passed = tests[i].run();
+		printf("%s %s\n", passed ? "ok  " : "FAIL", tests[i].name);
+		if (!passed) {
+			failed++;
+		}
+	}
+
+	printf("%d of %d tests failed\n", failed, count);
+	return failed != 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include "calc.h"
+
+/*
+ * The tests boot synthetic 83+ roms, so they need no TI rom. Each test
+ * returns FALSE after the first CHECK that fails.
+ */
+
+#define CHECK(cond) do { \
+		if (!(cond)) { \
+			test_fail(__FILE__, __LINE__, #cond); \
+			return FALSE; \
+		} \
+	} while (0)
+
+// the code goes on the boot page, which the 83+ maps at 0000 on reset.
+// The rest of the rom is erased.
+LPCALC test_boot(const unsigned char *code, int size);
+void test_free(LPCALC lpCalc);
+const char *test_path(const char *name);
+void test_fail(const char *file, int line, const char *cond);
+BOOL test_same_cpu(CPU_t *cpu1, CPU_t *cpu2);
+BOOL test_same_ram(LPCALC calc1, LPCALC calc2);
+
+BOOL test_interrupt_timing(void);
+BOOL test_jit(void);
+BOOL test_flags(void);
+BOOL test_save_buffer(void);
+BOOL test_slot_size(void);
+BOOL test_save_chunks(void);
+BOOL test_delta_save(void);
+BOOL test_lz(void);
+BOOL test_lz_save(void);
+BOOL test_break_set(void);
+BOOL test_break_run(void);
+
+#endif